@@ -0,0 +1,302 @@
+#include "DescriptorAllocator.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace
+{
+	bool isBufferDescriptor(VkDescriptorType type)
+	{
+		return
+			type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER ||
+			type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC ||
+			type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER ||
+			type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	}
+
+	template<typename T>
+	void hashCombine(size_t& seed, const T& value)
+	{
+		seed ^= std::hash<T>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	}
+}
+
+// ------------------------- DESCRIPTOR ALLOCATOR --------------------------
+
+void DescriptorAllocator::init(VkDevice device, uint32_t initialSets, const std::vector<PoolSizeRatio>& poolRatios)
+{
+	this->device = device;
+	this->ratios = poolRatios;
+	this->setsPerPool = initialSets;
+}
+
+VkDescriptorPool DescriptorAllocator::createPool(uint32_t setCount)
+{
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	for (const PoolSizeRatio& ratio : ratios)
+	{
+		VkDescriptorPoolSize poolSize{};
+		poolSize.type				= ratio.type;
+		poolSize.descriptorCount	= std::max(1u, static_cast<uint32_t>(ratio.ratio * setCount));
+		poolSizes.push_back(poolSize);
+	}
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType			= VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount	= static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes		= poolSizes.data();
+	poolInfo.maxSets		= setCount;
+	// No VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+	// sets are only ever released all at once through vkResetDescriptorPool
+
+	VkDescriptorPool pool;
+	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("[ERROR] : Failed to create descriptor pool!");
+	}
+
+	return pool;
+}
+
+VkDescriptorPool DescriptorAllocator::grabPool()
+{
+	// Reuse an already reset pool if we have one
+	if (!freePools.empty())
+	{
+		VkDescriptorPool pool = freePools.back();
+		freePools.pop_back();
+		return pool;
+	}
+
+	// Otherwise create a new one, growing every time we run out
+	VkDescriptorPool pool = createPool(setsPerPool);
+	setsPerPool = std::min(setsPerPool * 2, MAX_SETS_PER_POOL);
+	return pool;
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout)
+{
+	if (currentPool == VK_NULL_HANDLE)
+	{
+		currentPool = grabPool();
+		usedPools.push_back(currentPool);
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType					= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool		= currentPool;
+	allocInfo.descriptorSetCount	= 1;
+	allocInfo.pSetLayouts			= &layout;
+
+	VkDescriptorSet set;
+	VkResult result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+
+	// Current pool is full, move on to the next one in the chain and try again
+	if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+	{
+		currentPool = grabPool();
+		usedPools.push_back(currentPool);
+
+		allocInfo.descriptorPool = currentPool;
+		result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+	}
+
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("[ERROR] : Failed to allocate descriptor set!");
+	}
+
+	return set;
+}
+
+void DescriptorAllocator::reset()
+{
+	// Resetting a pool frees all of its sets at once,
+	// much cheaper than freeing them one-by-one
+	for (VkDescriptorPool pool : usedPools)
+	{
+		vkResetDescriptorPool(device, pool, 0);
+		freePools.push_back(pool);
+	}
+
+	usedPools.clear();
+	currentPool = VK_NULL_HANDLE;
+}
+
+void DescriptorAllocator::cleanup()
+{
+	for (VkDescriptorPool pool : usedPools)
+	{
+		vkDestroyDescriptorPool(device, pool, nullptr);
+	}
+	for (VkDescriptorPool pool : freePools)
+	{
+		vkDestroyDescriptorPool(device, pool, nullptr);
+	}
+
+	usedPools.clear();
+	freePools.clear();
+	currentPool = VK_NULL_HANDLE;
+}
+
+// --------------------------- DESCRIPTOR CACHE ----------------------------
+
+bool DescriptorBinding::operator==(const DescriptorBinding& other) const
+{
+	if (binding != other.binding || type != other.type)
+	{
+		return false;
+	}
+
+	if (isBufferDescriptor(type))
+	{
+		return
+			bufferInfo.buffer == other.bufferInfo.buffer &&
+			bufferInfo.offset == other.bufferInfo.offset &&
+			bufferInfo.range == other.bufferInfo.range;
+	}
+
+	return
+		imageInfo.sampler == other.imageInfo.sampler &&
+		imageInfo.imageView == other.imageInfo.imageView &&
+		imageInfo.imageLayout == other.imageInfo.imageLayout;
+}
+
+void DescriptorCache::init(VkDevice device, DescriptorAllocator* allocator)
+{
+	this->device = device;
+	this->allocator = allocator;
+}
+
+size_t DescriptorCache::hashSignature(VkDescriptorSetLayout layout, const std::vector<DescriptorBinding>& bindings)
+{
+	size_t seed = 0;
+	hashCombine(seed, layout);
+	for (const DescriptorBinding& binding : bindings)
+	{
+		hashCombine(seed, binding.binding);
+		hashCombine(seed, static_cast<uint32_t>(binding.type));
+	}
+	return seed;
+}
+
+size_t DescriptorCache::hashSet(VkDescriptorSetLayout layout, const std::vector<DescriptorBinding>& bindings)
+{
+	size_t seed = hashSignature(layout, bindings);
+	for (const DescriptorBinding& binding : bindings)
+	{
+		if (isBufferDescriptor(binding.type))
+		{
+			hashCombine(seed, binding.bufferInfo.buffer);
+			hashCombine(seed, binding.bufferInfo.offset);
+			hashCombine(seed, binding.bufferInfo.range);
+		}
+		else
+		{
+			hashCombine(seed, binding.imageInfo.sampler);
+			hashCombine(seed, binding.imageInfo.imageView);
+			hashCombine(seed, static_cast<uint32_t>(binding.imageInfo.imageLayout));
+		}
+	}
+	return seed;
+}
+
+VkDescriptorUpdateTemplate DescriptorCache::getTemplate(VkDescriptorSetLayout layout, const std::vector<DescriptorBinding>& bindings)
+{
+	std::vector<std::pair<uint32_t, VkDescriptorType>> signature;
+	for (const DescriptorBinding& binding : bindings)
+	{
+		signature.emplace_back(binding.binding, binding.type);
+	}
+
+	size_t key = hashSignature(layout, bindings);
+	auto range = templates.equal_range(key);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second.layout == layout && it->second.signature == signature)
+		{
+			return it->second.updateTemplate;
+		}
+	}
+
+	// Describe where the data of each binding lives inside
+	// the array of DescriptorWriteData we pass at update time
+	std::vector<VkDescriptorUpdateTemplateEntry> entries(bindings.size());
+	for (size_t i = 0; i < bindings.size(); ++i)
+	{
+		entries[i].dstBinding		= bindings[i].binding;
+		entries[i].dstArrayElement	= 0;
+		entries[i].descriptorCount	= 1;
+		entries[i].descriptorType	= bindings[i].type;
+		entries[i].offset			= i * sizeof(DescriptorWriteData);
+		entries[i].stride			= sizeof(DescriptorWriteData);
+	}
+
+	VkDescriptorUpdateTemplateCreateInfo templateInfo{};
+	templateInfo.sType						= VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+	templateInfo.descriptorUpdateEntryCount	= static_cast<uint32_t>(entries.size());
+	templateInfo.pDescriptorUpdateEntries	= entries.data();
+	templateInfo.templateType				= VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+	templateInfo.descriptorSetLayout		= layout;
+
+	VkDescriptorUpdateTemplate updateTemplate;
+	if (vkCreateDescriptorUpdateTemplate(device, &templateInfo, nullptr, &updateTemplate) != VK_SUCCESS)
+	{
+		throw std::runtime_error("[ERROR] : Failed to create descriptor update template!");
+	}
+
+	templates.emplace(key, CachedTemplate{ layout, signature, updateTemplate });
+	return updateTemplate;
+}
+
+void DescriptorCache::write(VkDescriptorSet set, VkDescriptorSetLayout layout, const std::vector<DescriptorBinding>& bindings)
+{
+	std::vector<DescriptorWriteData> data(bindings.size());
+	for (size_t i = 0; i < bindings.size(); ++i)
+	{
+		if (isBufferDescriptor(bindings[i].type))
+		{
+			data[i].bufferInfo = bindings[i].bufferInfo;
+		}
+		else
+		{
+			data[i].imageInfo = bindings[i].imageInfo;
+		}
+	}
+
+	// One call updates every binding of the set, no VkWriteDescriptorSet array to fill
+	vkUpdateDescriptorSetWithTemplate(device, set, getTemplate(layout, bindings), data.data());
+}
+
+VkDescriptorSet DescriptorCache::getOrCreate(VkDescriptorSetLayout layout, const std::vector<DescriptorBinding>& bindings)
+{
+	size_t key = hashSet(layout, bindings);
+	auto range = sets.equal_range(key);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second.layout == layout && it->second.bindings == bindings)
+		{
+			hits++;
+			return it->second.set;
+		}
+	}
+
+	misses++;
+	VkDescriptorSet set = allocator->allocate(layout);
+	write(set, layout, bindings);
+
+	sets.emplace(key, CachedSet{ layout, bindings, set });
+	return set;
+}
+
+void DescriptorCache::cleanup()
+{
+	// Sets are owned by the allocator, only the templates are ours
+	for (auto& entry : templates)
+	{
+		vkDestroyDescriptorUpdateTemplate(device, entry.second.updateTemplate, nullptr);
+	}
+
+	templates.clear();
+	sets.clear();
+}
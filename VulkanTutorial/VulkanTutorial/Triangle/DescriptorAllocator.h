@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <unordered_map>
+
+/// <summary>
+/// Growable descriptor set allocator.
+/// Allocates from a chain of descriptor pools, a new (bigger) pool is created
+/// whenever the current one runs out of memory.
+/// reset() recycles every pool at once, which makes it a good fit for
+/// transient sets that only live for a single frame.
+/// </summary>
+class DescriptorAllocator
+{
+public:
+	// Number of descriptors of a type per set in a pool
+	struct PoolSizeRatio {
+		VkDescriptorType type;
+		float ratio;
+	};
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	std::vector<PoolSizeRatio> ratios;
+	uint32_t setsPerPool = 0;
+	static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+	VkDescriptorPool currentPool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorPool> usedPools;	/* pools sets were allocated from */
+	std::vector<VkDescriptorPool> freePools;	/* reset pools, ready to be reused */
+
+	VkDescriptorPool grabPool();
+	VkDescriptorPool createPool(uint32_t setCount);
+
+public:
+	void init(VkDevice device, uint32_t initialSets, const std::vector<PoolSizeRatio>& poolRatios);
+	VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+	// Free every set allocated so far (sets must not be in use by the GPU)
+	void reset();
+	void cleanup();
+};
+
+/// <summary>
+/// Resources bound to one binding of a descriptor set.
+/// Only the info matching the descriptor type is used.
+/// </summary>
+struct DescriptorBinding {
+	uint32_t binding;
+	VkDescriptorType type;
+	VkDescriptorBufferInfo bufferInfo;
+	VkDescriptorImageInfo imageInfo;
+
+	bool operator==(const DescriptorBinding& other) const;
+};
+
+/// <summary>
+/// Cache of persistent descriptor sets, keyed by a hash of
+/// the set layout and the resources bound to it.
+/// Identical requests return the same set instead of allocating and writing a new one.
+/// Writes go through descriptor update templates (one per layout and binding list).
+/// </summary>
+class DescriptorCache
+{
+private:
+	// Template data layout: one entry per binding, tightly packed
+	union DescriptorWriteData {
+		VkDescriptorBufferInfo bufferInfo;
+		VkDescriptorImageInfo imageInfo;
+	};
+
+	struct CachedSet {
+		VkDescriptorSetLayout layout;
+		std::vector<DescriptorBinding> bindings;
+		VkDescriptorSet set;
+	};
+
+	struct CachedTemplate {
+		VkDescriptorSetLayout layout;
+		std::vector<std::pair<uint32_t, VkDescriptorType>> signature;
+		VkDescriptorUpdateTemplate updateTemplate;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	DescriptorAllocator* allocator = nullptr;
+	std::unordered_multimap<size_t, CachedSet> sets;
+	std::unordered_multimap<size_t, CachedTemplate> templates;
+
+	static size_t hashSet(VkDescriptorSetLayout layout, const std::vector<DescriptorBinding>& bindings);
+	static size_t hashSignature(VkDescriptorSetLayout layout, const std::vector<DescriptorBinding>& bindings);
+	VkDescriptorUpdateTemplate getTemplate(VkDescriptorSetLayout layout, const std::vector<DescriptorBinding>& bindings);
+	// Write bindings into an allocated set
+	void write(VkDescriptorSet set, VkDescriptorSetLayout layout, const std::vector<DescriptorBinding>& bindings);
+
+public:
+	uint32_t hits = 0;		/* requests served from the cache */
+	uint32_t misses = 0;	/* requests that allocated and wrote a new set */
+
+	void init(VkDevice device, DescriptorAllocator* allocator);
+	VkDescriptorSet getOrCreate(VkDescriptorSetLayout layout, const std::vector<DescriptorBinding>& bindings);
+	void cleanup();
+};
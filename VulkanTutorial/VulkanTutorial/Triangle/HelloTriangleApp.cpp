@@ -110,6 +110,64 @@ void DestroyDebugUtilsMessengerEXT(
 	}
 }
 
+void HelloTriangleApp::setFramesInFlight(uint32_t count)
+{
+	if (count < 1 || count > MAX_FRAMES_IN_FLIGHT)
+	{
+		throw std::runtime_error("[ERROR] : Frames in flight must be between 1 and " + std::to_string(MAX_FRAMES_IN_FLIGHT) + "!");
+	}
+
+	framesInFlight = count;
+}
+
+void HelloTriangleApp::setPresentPolicy(PresentPolicy policy)
+{
+	presentPolicy = policy;
+}
+
+void HelloTriangleApp::setSceneObjectCount(uint32_t count)
+{
+	// The exact limit depends on the render path, checked again once the scene is built
+	if (count < 1 || count > MAX_GPU_DRIVEN_OBJECTS)
+	{
+		throw std::runtime_error("[ERROR] : Scene object count must be between 1 and " + std::to_string(MAX_GPU_DRIVEN_OBJECTS) + "!");
+	}
+
+	sceneObjectCount = count;
+}
+
+void HelloTriangleApp::setGpuDrivenRendering(bool enabled)
+{
+	useGpuDrivenRendering = enabled;
+}
+
+void HelloTriangleApp::setInstancedRendering(bool enabled)
+{
+	useInstancedRendering = enabled;
+}
+
+void HelloTriangleApp::setParallelRecording(bool enabled)
+{
+	useParallelRecording = enabled;
+}
+
+void HelloTriangleApp::setCachedCommandBuffers(bool enabled)
+{
+	useCachedCommandBuffers = enabled;
+}
+
+void HelloTriangleApp::setSwapChainStressFrames(uint32_t frames)
+{
+	// Enough frames for a whole round of window changes
+	const uint32_t minFrames = (SWAP_CHAIN_STRESS_STEPS + 1) * (SWAP_CHAIN_STRESS_SETTLE_FRAMES + SWAP_CHAIN_STRESS_STEADY_FRAMES);
+	if (frames < minFrames)
+	{
+		throw std::runtime_error("[ERROR] : The swap chain check needs at least " + std::to_string(minFrames) + " frames!");
+	}
+
+	swapChainStressFrames = frames;
+}
+
 void HelloTriangleApp::framebufferResizeCallback(
 	GLFWwindow* window, 
 	int width, 
@@ -117,7 +175,36 @@ void HelloTriangleApp::framebufferResizeCallback(
 )
 {
 	auto app = reinterpret_cast<HelloTriangleApp*>(glfwGetWindowUserPointer(window));
+	{
+		std::lock_guard<std::mutex> lock(app->windowMutex);
+		app->framebufferWidth = width;
+		app->framebufferHeight = height;
+	}
 	app->framebufferResized = true;
+	// Wake up the render thread if it waits for a minimized window
+	app->windowResized.notify_all();
+}
+
+void HelloTriangleApp::keyCallback(GLFWwindow* window, int, int, int, int)
+{
+	reinterpret_cast<HelloTriangleApp*>(glfwGetWindowUserPointer(window))->recordInputEvent();
+}
+
+void HelloTriangleApp::cursorPositionCallback(GLFWwindow* window, double, double)
+{
+	reinterpret_cast<HelloTriangleApp*>(glfwGetWindowUserPointer(window))->recordInputEvent();
+}
+
+void HelloTriangleApp::mouseButtonCallback(GLFWwindow* window, int, int, int)
+{
+	reinterpret_cast<HelloTriangleApp*>(glfwGetWindowUserPointer(window))->recordInputEvent();
+}
+
+void HelloTriangleApp::recordInputEvent()
+{
+	// GLFW has no OS event timestamps : the main thread handles events as they arrive
+	// (glfwWaitEvents), so the callback time is when the event was received
+	lastInputEvent = PresentLatencyTracker::Clock::now();
 }
 
 bool HelloTriangleApp::checkValidationLayerSupport()
@@ -171,6 +258,11 @@ void HelloTriangleApp::initWindow()
 	glfwSetWindowUserPointer(window, this);
 	// Set callback for window resize
 	glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+	glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+	// Set callbacks for input events (start of the input to present latency)
+	glfwSetKeyCallback(window, keyCallback);
+	glfwSetCursorPosCallback(window, cursorPositionCallback);
+	glfwSetMouseButtonCallback(window, mouseButtonCallback);
 }
 
 void HelloTriangleApp::populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo)
@@ -276,7 +368,10 @@ void HelloTriangleApp::createInstance()
 		appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
 		// Define version of Vulkan the application will use.
 		// MUST be the highest version it will use.
-		appInfo.apiVersion = VK_API_VERSION_1_0;
+		// 1.1 : descriptor update templates are core
+		// 1.2 : vkCmdDrawIndexedIndirectCount is core (optional on the device)
+		// 1.3 : synchronization2 is core (render graph barriers)
+		appInfo.apiVersion = VK_API_VERSION_1_3;
 		// Pointer for extension information.
 		// appInfo.pNext = nullptr;
 
@@ -374,6 +469,12 @@ void HelloTriangleApp::createLogicalDevice()
 		indices.graphicsFamily.value(),
 		indices.presentFamily.value()
 	};
+	// Async compute : one more queue from the compute-only family
+	asyncComputeSupported = indices.computeFamily.has_value();
+	if (asyncComputeSupported)
+	{
+		uniqueQueueFamilies.insert(indices.computeFamily.value());
+	}
 	
 	// Assing priority to queue (even for single one).
 	float queuePriority = 1.0f;
@@ -395,6 +496,171 @@ void HelloTriangleApp::createLogicalDevice()
 	VkPhysicalDeviceFeatures deviceFeatures{};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+	// Optional features of the GPU-driven path
+	// multiDrawIndirect			: more than one draw per indirect draw call
+	// drawIndirectFirstInstance	: non-zero firstInstance inside indirect draw commands
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+	deviceFeatures.multiDrawIndirect			= supportedFeatures.multiDrawIndirect;
+	deviceFeatures.drawIndirectFirstInstance	= supportedFeatures.drawIndirectFirstInstance;
+
+	// Culling runs on the graphics queue, so its family has to support compute as well
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+	bool graphicsQueueHasCompute = queueFamilies[indices.graphicsFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT;
+
+	gpuDrivenSupported =
+		supportedFeatures.multiDrawIndirect &&
+		supportedFeatures.drawIndirectFirstInstance &&
+		graphicsQueueHasCompute;
+
+	// Features of newer Vulkan versions are queried and enabled through pNext chains
+	// drawIndirectCount : the GPU reads the number of indirect draws from a buffer
+	// synchronization2 : vkCmdPipelineBarrier2 and 64 bit stage/access flags (render graph)
+	// dynamicRendering : rendering without render pass and framebuffer objects
+	VkPhysicalDeviceVulkan12Features features12{};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceVulkan13Features features13{};
+	features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+	// isDeviceSuitable() only picks 1.3 devices with the frame loop features
+	VkPhysicalDeviceVulkan12Features supported12{};
+	supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+	VkPhysicalDeviceFeatures2 features2{};
+	features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features2.pNext = &supported12;
+	vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+	drawIndirectCountSupported = supported12.drawIndirectCount == VK_TRUE;
+	features12.drawIndirectCount = supported12.drawIndirectCount;
+	// Frame pacing with a single counter
+	features12.timelineSemaphore = VK_TRUE;
+
+	// Render graph barriers and queue submits
+	features13.synchronization2 = VK_TRUE;
+	// Main pass without render pass and framebuffer objects
+	features13.dynamicRendering = VK_TRUE;
+	features12.pNext = &features13;
+
+	// Optional extensions : present id + present wait (latency measurement)
+	std::vector<const char*> enabledExtensions = deviceExtensions;
+
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+	auto extensionAvailable = [&availableExtensions](const char* name) {
+		for (const auto& extension : availableExtensions)
+		{
+			if (strcmp(extension.extensionName, name) == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+
+	VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+	presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+	VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+	presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+	presentIdFeatures.pNext = &presentWaitFeatures;
+
+	if (extensionAvailable(VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+		extensionAvailable(VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+	{
+		VkPhysicalDeviceFeatures2 features2{};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &presentIdFeatures;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+		presentWaitSupported = presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+	}
+
+	if (presentWaitSupported)
+	{
+		enabledExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+		enabledExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+		features13.pNext = &presentIdFeatures;
+	}
+
+	// Extended dynamic state 1 + 2 are core in Vulkan 1.3 (no feature to enable)
+	// Blend state needs VK_EXT_extended_dynamic_state3, only the three features we set are enabled
+	VkPhysicalDeviceExtendedDynamicState3FeaturesEXT dynamicState3Features{};
+	dynamicState3Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+
+	if (useExtendedDynamicState && extensionAvailable(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME))
+	{
+		VkPhysicalDeviceExtendedDynamicState3FeaturesEXT supportedDynamicState3{};
+		supportedDynamicState3.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+
+		VkPhysicalDeviceFeatures2 features2{};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &supportedDynamicState3;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+		extendedDynamicState3Supported =
+			supportedDynamicState3.extendedDynamicState3ColorBlendEnable &&
+			supportedDynamicState3.extendedDynamicState3ColorBlendEquation &&
+			supportedDynamicState3.extendedDynamicState3ColorWriteMask;
+	}
+
+	if (extendedDynamicState3Supported)
+	{
+		enabledExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+		dynamicState3Features.extendedDynamicState3ColorBlendEnable		= VK_TRUE;
+		dynamicState3Features.extendedDynamicState3ColorBlendEquation	= VK_TRUE;
+		dynamicState3Features.extendedDynamicState3ColorWriteMask		= VK_TRUE;
+		dynamicState3Features.pNext = features13.pNext;
+		features13.pNext = &dynamicState3Features;
+	}
+
+	pipelineDynamicState.rasterization	= useExtendedDynamicState;
+	pipelineDynamicState.colorBlend		= extendedDynamicState3Supported;
+
+	// Graphics pipeline libraries : pipelines linked from separately compiled parts
+	// Only worth it when linking without optimization is fast (graphicsPipelineLibraryFastLinking)
+	VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipelineLibraryFeatures{};
+	pipelineLibraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+
+	if (useGraphicsPipelineLibrary &&
+		extensionAvailable(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) &&
+		extensionAvailable(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME))
+	{
+		VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT supportedPipelineLibrary{};
+		supportedPipelineLibrary.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+
+		VkPhysicalDeviceFeatures2 features2{};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &supportedPipelineLibrary;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+		VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT pipelineLibraryProperties{};
+		pipelineLibraryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT;
+
+		VkPhysicalDeviceProperties2 properties2{};
+		properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties2.pNext = &pipelineLibraryProperties;
+		vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+
+		graphicsPipelineLibrarySupported =
+			supportedPipelineLibrary.graphicsPipelineLibrary &&
+			pipelineLibraryProperties.graphicsPipelineLibraryFastLinking;
+	}
+
+	if (graphicsPipelineLibrarySupported)
+	{
+		enabledExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+		enabledExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+		pipelineLibraryFeatures.graphicsPipelineLibrary = VK_TRUE;
+		pipelineLibraryFeatures.pNext = features13.pNext;
+		features13.pNext = &pipelineLibraryFeatures;
+	}
+
 	// Logical device creation infos.
 	// Using multiple queueFamilies.
 	VkDeviceCreateInfo createInfo{};
@@ -402,11 +668,13 @@ void HelloTriangleApp::createLogicalDevice()
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 	createInfo.pEnabledFeatures = &deviceFeatures;
+	// Vulkan 1.2/1.3 features
+	createInfo.pNext = &features12;
 
 	// Enable extensions.
 	// Note: these are device specific.
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+	createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 	// Enable Validation layers.
 	// Note: older versions of Vulkan made 
@@ -432,6 +700,53 @@ void HelloTriangleApp::createLogicalDevice()
 		vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
 		vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
 	}
+
+	if (asyncComputeActive())
+	{
+		vkGetDeviceQueue(device, indices.computeFamily.value(), 0, &computeQueue);
+
+		// Buffers written/read by both queues use VK_SHARING_MODE_CONCURRENT,
+		// so no queue family ownership transfer is needed between culling and drawing
+		computeSharingFamilies = { indices.graphicsFamily.value(), indices.computeFamily.value() };
+
+		std::cout << "[ASYNC COMPUTE]: culling on queue family " << indices.computeFamily.value() << std::endl;
+	}
+
+	latencyTracker.init(device, presentWaitSupported);
+
+	// Extension commands aren't exported by the loader, ask the device for them
+	if (extendedDynamicState3Supported)
+	{
+		cmdSetColorBlendEnable = reinterpret_cast<PFN_vkCmdSetColorBlendEnableEXT>(
+			vkGetDeviceProcAddr(device, "vkCmdSetColorBlendEnableEXT"));
+		cmdSetColorBlendEquation = reinterpret_cast<PFN_vkCmdSetColorBlendEquationEXT>(
+			vkGetDeviceProcAddr(device, "vkCmdSetColorBlendEquationEXT"));
+		cmdSetColorWriteMask = reinterpret_cast<PFN_vkCmdSetColorWriteMaskEXT>(
+			vkGetDeviceProcAddr(device, "vkCmdSetColorWriteMaskEXT"));
+	}
+
+	// Descriptor set and pipeline layouts are built from shader reflection
+	layoutCache.init(device);
+
+	// Every pipeline is created through the cache loaded from the previous run
+	// Keys that only differ in dynamic state map to the same pipeline
+	pipelineCache.init(device, physicalDevice, PIPELINE_CACHE_FILE);
+	if (graphicsPipelineLibraryActive())
+	{
+		// New variants are fast-linked from libraries (no first draw hitch),
+		// the optimized link replaces them once it finished in the background
+		pipelineLibraries.init(device);
+		pipelineRegistry.init(device, pipelineCache, jobSystem,
+			[this](const GraphicsPipelineKey& key, VkPipelineCache cache) { return linkGraphicsPipeline(key, cache, true); },
+			pipelineDynamicState,
+			[this](const GraphicsPipelineKey& key, VkPipelineCache cache) { return linkGraphicsPipeline(key, cache, false); });
+	}
+	else
+	{
+		pipelineRegistry.init(device, pipelineCache, jobSystem,
+			[this](const GraphicsPipelineKey& key, VkPipelineCache cache) { return buildGraphicsPipeline(key, cache); },
+			pipelineDynamicState);
+	}
 }
 
 void HelloTriangleApp::createSwapChain()
@@ -441,11 +756,22 @@ void HelloTriangleApp::createSwapChain()
 
 	VkSurfaceFormatKHR surfaceFormat = chooseSwapSufraceFormat(swapChainSupport.formats);
 	VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+	swapChainPresentMode = presentMode;
 	VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
 	// Decide how many images we want to use in our swapchain
 	// Minimum plus one (to avoid waiting for driver internal operations)
+	// Low latency : as few queued images as possible
+	// Throughput : one more, so rendering never waits for an image to be released
 	uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+	if (presentPolicy == PresentPolicy::LowLatency)
+	{
+		imageCount = swapChainSupport.capabilities.minImageCount;
+	}
+	else if (presentPolicy == PresentPolicy::Throughput)
+	{
+		imageCount = swapChainSupport.capabilities.minImageCount + 2;
+	}
 	
 	// Also check if not exceeding maximum amount of images
 	// (value of 0 means there is no maximum)
@@ -508,7 +834,9 @@ void HelloTriangleApp::createSwapChain()
 	// Exchange old/invalid/unoptimized swap chain 
 	// by creating a new one and point to the old one
 	// (For example: when resizing window)
-	createInfo.oldSwapchain = VK_NULL_HANDLE;
+	// The driver can reuse its resources, and images already queued for presentation
+	// are still presented (swapChain is the retired one during a recreation)
+	createInfo.oldSwapchain = swapChain;
 
 	if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS)
 	{
@@ -528,40 +856,116 @@ void HelloTriangleApp::createSwapChain()
 
 void HelloTriangleApp::recreateSwapChain()
 {
-	vkDeviceWaitIdle(device);
-	
-	cleanupSwapChain();
+	// A minimized window has a zero sized framebuffer, nothing to present to
+	// Sleep until the resize callback reports a usable size instead of spinning
+	{
+		std::unique_lock<std::mutex> lock(windowMutex);
+		windowResized.wait(lock, [this] {
+			return (framebufferWidth > 0 && framebufferHeight > 0) || !running;
+		});
+	}
+	if (!running)
+	{
+		return;
+	}
+
+	// No vkDeviceWaitIdle : frames in flight keep using the old objects,
+	// they are destroyed later, once the timeline passed those frames
+	retireSwapChain();
 
-	// Better solution is to pass the old swapchain as the new one
 	createSwapChain();
 	createImageViews();
 	createDepthResources();
 	createFramebuffers();
+	buildRenderGraph();
+
+	// Cached command buffers reference the old framebuffers
+	// (and the number of swap chain images may have changed)
+	createCachedCommandBuffers();
+
+	++swapChainRecreations;
+	std::cout << "[SWAP CHAIN]: recreated (" << swapChainRecreations << ")"
+			  << "\t extent: " << swapChainExtent.width << "x" << swapChainExtent.height << std::endl;
 }
 
-void HelloTriangleApp::cleanupSwapChain()
+void HelloTriangleApp::retireSwapChain()
 {
-	// Destroy depth image
-	vkDestroyImageView(device, depthImageView, nullptr);
-	vkDestroyImage(device, depthImage, nullptr);
-	vkFreeMemory(device, depthImageMemory, nullptr);
-
-	// Destroy swap chain
-	vkDestroySwapchainKHR(device, swapChain, nullptr);
+	RetiredSwapChain retired{};
+	// Every frame submitted so far may still render to (or present) these objects
+	retired.retireValue				= frameNumber;
+	retired.swapChain				= swapChain;
+	retired.imageViews				= std::move(swapChainImageViews);
+	retired.framebuffers			= std::move(swapChainFramebuffers);
+	retired.depthImage				= depthImage;
+	retired.depthImageView			= depthImageView;
+	retired.depthImageMemory		= depthImageMemory;
+	retired.renderGraph				= std::move(renderGraph);
+	retired.cachedCommandBuffers	= std::move(cachedCommandBuffers);
+	retiredSwapChains.push_back(std::move(retired));
+
+	// swapChain is kept : it is passed as oldSwapchain to the next swap chain
+	swapChainImageViews.clear();
+	swapChainFramebuffers.clear();
+	cachedCommandBuffers.clear();
+	renderGraph = RenderGraph{};
+	depthImage = VK_NULL_HANDLE;
+	depthImageView = VK_NULL_HANDLE;
+	depthImageMemory = VK_NULL_HANDLE;
+}
 
-	// Destroy framebuffer objects
-	for (auto framebuffer : swapChainFramebuffers)
+void HelloTriangleApp::destroyRetiredSwapChains(uint64_t completedValue)
+{
+	// Retired in order, so the oldest ones complete first
+	while (!retiredSwapChains.empty() && retiredSwapChains.front().retireValue <= completedValue)
 	{
-		vkDestroyFramebuffer(device, framebuffer, nullptr);
-	}
+		RetiredSwapChain& retired = retiredSwapChains.front();
 
-	// Destroy image views
-	for (auto imageView : swapChainImageViews)
-	{
-		vkDestroyImageView(device, imageView, nullptr);
+		// Destroy render passes, framebuffers and transient images of the graph
+		retired.renderGraph.cleanup();
+
+		// Destroy depth image
+		vkDestroyImageView(device, retired.depthImageView, nullptr);
+		vkDestroyImage(device, retired.depthImage, nullptr);
+		vkFreeMemory(device, retired.depthImageMemory, nullptr);
+
+		// Destroy framebuffer objects
+		for (auto framebuffer : retired.framebuffers)
+		{
+			vkDestroyFramebuffer(device, framebuffer, nullptr);
+		}
+
+		// Destroy image views
+		for (auto imageView : retired.imageViews)
+		{
+			vkDestroyImageView(device, imageView, nullptr);
+		}
+
+		if (!retired.cachedCommandBuffers.empty())
+		{
+			vkFreeCommandBuffers(
+				device,
+				commandPool,
+				static_cast<uint32_t>(retired.cachedCommandBuffers.size()),
+				retired.cachedCommandBuffers.data()
+			);
+		}
+
+		// Destroy swap chain (after the views of its images),
+		// its presents can't be polled anymore
+		latencyTracker.releaseSwapChain(retired.swapChain);
+		vkDestroySwapchainKHR(device, retired.swapChain, nullptr);
+
+		retiredSwapChains.pop_front();
 	}
 }
 
+void HelloTriangleApp::cleanupSwapChain()
+{
+	// Only called once the device is idle : everything can go right away
+	retireSwapChain();
+	destroyRetiredSwapChains(UINT64_MAX);
+}
+
 void HelloTriangleApp::createImageViews()
 {
 	// VkImageView : object which describes how to access an image and which part to access
@@ -580,114 +984,310 @@ void HelloTriangleApp::createImageViews()
 
 void HelloTriangleApp::createDescriptorSetLayout()
 {
-	// Define descriptor set layout binding properties for UBO
-	VkDescriptorSetLayoutBinding uboLayoutBinding{};
-	uboLayoutBinding.binding			= 0; /* used for referencing in shader */
-	// Set the type of our stored resource
-	// (for more : https://registry.khronos.org/vulkan/specs/latest/man/html/VkDescriptorType.html)
-	uboLayoutBinding.descriptorType		= VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	uboLayoutBinding.descriptorCount	= 1;
-	// Set which stages of the (graphics) pipeline we want to use it
-	uboLayoutBinding.stageFlags			= VK_SHADER_STAGE_VERTEX_BIT;
-	// Only related for image sampling descriptors
-	uboLayoutBinding.pImmutableSamplers = nullptr;
-
-	// Define descriptor set layout binding properties for Sampler
-	VkDescriptorSetLayoutBinding samplerBinding{};
-	samplerBinding.binding				= 1;
-	samplerBinding.descriptorCount		= 1;
-	samplerBinding.descriptorType		= VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	samplerBinding.pImmutableSamplers	= nullptr;
-	samplerBinding.stageFlags			= VK_SHADER_STAGE_FRAGMENT_BIT;
-
-	std::array<VkDescriptorSetLayoutBinding, 2> bindings = { 
-		uboLayoutBinding,
-		samplerBinding 
-	};
-	
-	// Define descriptor set layout properties
-	VkDescriptorSetLayoutCreateInfo layoutInfo{};
-	layoutInfo.sType					= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	// Defining bindings of our descriptor set
-	layoutInfo.bindingCount				= static_cast<uint32_t>(bindings.size());
-	layoutInfo.pBindings				= bindings.data();
-
-	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
+	// Descriptor set layouts come from the shaders themselves (SPIR-V reflection) :
+	// every layout(set = ..., binding = ...) they declare, with the stages using it
+	// Layouts are cached by content, shaders declaring the same set share its layout
+	// Set 0 of shader.vert + shader.frag : uniform ring (binding = 0), texture sampler (binding = 1)
+	ShaderReflection graphicsLayout = reflectShaders({ "shader.vert", "shader.frag" });
+	descriptorSetLayout = layoutCache.getSetLayout(graphicsLayout.setBindings(0));
+
+	if (!gpuDrivenActive())
 	{
-		throw std::runtime_error("[ERROR] : Failed to create descriptor set layout!");
+		return;
 	}
+
+	// Culling compute shader (cull.comp)
+	// 0 : culling parameters (uniform ring)
+	// 1 : object data, 2 : mesh ranges (inputs)
+	// 3 : draw commands, 4 : draw count (outputs)
+	ShaderReflection cullLayout = reflectShaders({ "cull.comp" });
+	cullDescriptorSetLayout = layoutCache.getSetLayout(cullLayout.setBindings(0));
+
+	// Object data for the indirect vertex shader (set = 1)
+	ShaderReflection indirectLayout = reflectShaders({ "shader_indirect.vert", "shader.frag" });
+	objectDescriptorSetLayout = layoutCache.getSetLayout(indirectLayout.setBindings(1));
 }
 
-void HelloTriangleApp::createDescriptorSets()
+ShaderReflection HelloTriangleApp::reflectShaders(const std::vector<std::string>& sourceFiles)
 {
-	// Allocate a descriptor set layout for each frames in flight
-	std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout);
-	
-	// Define allocation of descriptor sets
-	VkDescriptorSetAllocateInfo allocInfo{};
-	allocInfo.sType					= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfo.descriptorPool		= descriptorPool;
-	allocInfo.descriptorSetCount	= static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-	allocInfo.pSetLayouts			= layouts.data();
-
-	descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-	if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS)
+	// Stages of one pipeline, compiled (or taken from the shader cache) and reflected
+	ShaderReflection reflection;
+	for (const std::string& sourceFile : sourceFiles)
 	{
-		throw std::runtime_error("[ERROR] : Failed to allocate descriptor sets!");
+		reflection.merge(ShaderReflection::reflect(ShaderCompiler::compile(sourceFile)));
 	}
 
+	// Our uniform buffers all live in the uniform ring, bound with a dynamic offset
+	reflection.makeUniformBuffersDynamic();
+	return reflection;
+}
+
+void HelloTriangleApp::createDescriptorSets()
+{
+	// Get a descriptor set for each frames in flight from the descriptor cache
+	// Sets with the same layout and resources are only allocated and written once
+	// (every frame points at the same uniform ring and texture, so they share one set)
+	descriptorSets.resize(framesInFlight);
+
 	// Populate allocated descriptor sets
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	for (size_t i = 0; i < framesInFlight; i++)
 	{
 		VkDescriptorBufferInfo bufferInfo{};
-		bufferInfo.buffer = uniformBuffers[i];			/* point to data */
-		bufferInfo.offset = 0;							/* offset of data */
+		bufferInfo.buffer = uniformBuffer;				/* point to data */
+		bufferInfo.offset = 0;							/* base offset, dynamic offset is added */
 		// For whole buffer rewrite: VK_WHOLE_SIZE
-		bufferInfo.range = sizeof(UniformBufferObject);	/* size of our data */
+		bufferInfo.range = sizeof(UniformBufferObject);	/* size of one objects data */
 
 		VkDescriptorImageInfo imageInfo{};
 		imageInfo.imageLayout	= VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 		imageInfo.imageView		= textureImageView;
 		imageInfo.sampler		= textureSampler;
 
-		std::array<VkWriteDescriptorSet, 2> descriptorWrite{};
-		// Updating configurations of descriptors
-		descriptorWrite[0].sType			= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrite[0].dstSet			= descriptorSets[i];
-		descriptorWrite[0].dstBinding		= 0;
-		// Because descriptor sets can be arrays
-		descriptorWrite[0].dstArrayElement	= 0;
-		// We need to specify descriptor type again
-		descriptorWrite[0].descriptorType	= VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		// Also need to specify the number of descriptors
-		// because we can update multiple types of buffers
-		descriptorWrite[0].descriptorCount	= 1;
-		// Reference an array of {descriptorCount} size
-		// to configure our descriptors
-		descriptorWrite[0].pBufferInfo		= &bufferInfo;	/* reference buffer data */
-		descriptorWrite[0].pImageInfo		= nullptr;		/* reference image data */
-		descriptorWrite[0].pTexelBufferView	= nullptr;		/* reference buffer view */
-
-		descriptorWrite[1].sType			= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrite[1].dstSet			= descriptorSets[i];
-		descriptorWrite[1].dstBinding		= 1;
-		descriptorWrite[1].dstArrayElement	= 0;
-		descriptorWrite[1].descriptorType	= VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		descriptorWrite[1].descriptorCount	= 1;
-		descriptorWrite[1].pImageInfo		= &imageInfo;	/* reference image data */
-
-		// There is also the option to copy entire descriptors
-		vkUpdateDescriptorSets(
-			device, 
-			static_cast<uint32_t>(descriptorWrite.size()),
-			descriptorWrite.data(),
-			0, 
-			nullptr
-		);
+		// Describe the resources of every binding
+		// The cache writes them through a descriptor update template,
+		// which replaces filling VkWriteDescriptorSet structures one-by-one
+		// (the template knows the binding, descriptor type and count already)
+		std::vector<DescriptorBinding> bindings(2);
+		bindings[0].binding		= 0;
+		bindings[0].type		= VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		bindings[0].bufferInfo	= bufferInfo;	/* reference buffer data */
+
+		bindings[1].binding		= 1;
+		bindings[1].type		= VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[1].imageInfo	= imageInfo;	/* reference image data */
+
+		descriptorSets[i] = descriptorCache.getOrCreate(descriptorSetLayout, bindings);
+	}
+
+	if (!gpuDrivenActive())
+	{
+		return;
+	}
+
+	// Every frame in flight has its own object and draw buffers,
+	// so these sets are different for each frame
+	for (size_t i = 0; i < framesInFlight; i++)
+	{
+		std::vector<DescriptorBinding> cullBindings = {
+			{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, { uniformBuffer, 0, sizeof(CullUniformData) }, {} },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, { objectBuffers[i], 0, VK_WHOLE_SIZE }, {} },
+			{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, { meshRangeBuffer, 0, VK_WHOLE_SIZE }, {} },
+			{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, { drawCommandBuffers[i], 0, VK_WHOLE_SIZE }, {} },
+			{ 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, { drawCountBuffers[i], 0, VK_WHOLE_SIZE }, {} }
+		};
+		cullDescriptorSets[i] = descriptorCache.getOrCreate(cullDescriptorSetLayout, cullBindings);
+
+		std::vector<DescriptorBinding> objectBindings = {
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, { objectBuffers[i], 0, VK_WHOLE_SIZE }, {} }
+		};
+		objectDescriptorSets[i] = descriptorCache.getOrCreate(objectDescriptorSetLayout, objectBindings);
 	}
 }
 
 void HelloTriangleApp::createGraphicsPipeline()
+{
+	// --------------------------- PIPELINE LAYOUT ----------------------------
+	// Define uniform and push values, referenced by shaders, updated at draw time
+	// Built from the reflected shaders : their descriptor sets and push_constant block
+	ShaderReflection graphicsLayout = reflectShaders({ "shader.vert", "shader.frag" });
+
+	// Push constants are the fastest way to send small per-draw data,
+	// PushConstantData is what we push, so it has to match the push_constant block
+	if (graphicsLayout.pushConstants.size != sizeof(PushConstantData))
+	{
+		throw std::runtime_error("[ERROR] : Push constant block of the shaders doesn't match PushConstantData!");
+	}
+
+	// Push constant size is limited by the device (at least 128 bytes)
+	VkPhysicalDeviceProperties properties{};
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	if (graphicsLayout.pushConstants.offset + graphicsLayout.pushConstants.size > properties.limits.maxPushConstantsSize)
+	{
+		throw std::runtime_error("[ERROR] : Push constant range exceeds maxPushConstantsSize!");
+	}
+	// vkCmdPushConstants has to name exactly the stages of the range
+	pushConstantStages = graphicsLayout.pushConstants.stageFlags;
+
+	// Create pipeline layout for our renderer
+	// Uniform values: dynamic state variables that can be changed at draw time
+	pipelineLayout = layoutCache.getPipelineLayout(graphicsLayout);
+
+	// Instanced variants push the same data and bind the same set
+	if (layoutCache.getPipelineLayout(reflectShaders({ "shader_instanced.vert", "shader.frag" })) != pipelineLayout)
+	{
+		throw std::runtime_error("[ERROR] : shader_instanced.vert must use the layout of shader.vert!");
+	}
+
+	// The GPU-driven pipeline reads its transforms from an extra set (set = 1)
+	// Set 0 is the same cached set layout and the push constant range is the same,
+	// so both layouts are compatible for set 0
+	if (gpuDrivenActive())
+	{
+		ShaderReflection indirectLayout = reflectShaders({ "shader_indirect.vert", "shader.frag" });
+		if (indirectLayout.pushConstants.stageFlags != pushConstantStages)
+		{
+			throw std::runtime_error("[ERROR] : shader_indirect.vert must push constants to the stages of shader.vert!");
+		}
+		indirectPipelineLayout = layoutCache.getPipelineLayout(indirectLayout);
+	}
+
+	// ------------------------------ PIPELINES -------------------------------
+	// Describe the variants, the registry compiles them in parallel
+
+	graphicsPipelineKey.vertexShader	= "shader.vert";
+	graphicsPipelineKey.fragmentShader	= "shader.frag";
+	graphicsPipelineKey.features		= shaderFeatures;
+	graphicsPipelineKey.layout			= pipelineLayout;
+	// Dynamic rendering : no render pass, compiled against the attachment formats
+	graphicsPipelineKey.renderPass		= renderPass;
+	if (dynamicRenderingActive())
+	{
+		graphicsPipelineKey.colorFormat	= swapChainImageFormat;
+		graphicsPipelineKey.depthFormat	= findDepthFormat();
+	}
+	pipelineRegistry.request(graphicsPipelineKey);
+
+	// Same layout, transforms come from the per-instance vertex binding
+	instancedPipelineKey = graphicsPipelineKey;
+	instancedPipelineKey.vertexShader	= "shader_instanced.vert";
+	instancedPipelineKey.vertexLayout	= VertexLayout::MeshInstanced;
+	pipelineRegistry.request(instancedPipelineKey);
+
+	// Same state, but the vertex shader fetches transforms by gl_InstanceIndex
+	if (gpuDrivenActive())
+	{
+		indirectPipelineKey = graphicsPipelineKey;
+		indirectPipelineKey.vertexShader	= "shader_indirect.vert";
+		indirectPipelineKey.layout			= indirectPipelineLayout;
+		pipelineRegistry.request(indirectPipelineKey);
+	}
+
+	// Nothing to fall back to at startup : wait (and help compiling)
+	auto compileStart = std::chrono::steady_clock::now();
+	pipelineRegistry.waitIdle();
+	auto compileTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compileStart).count();
+
+	graphicsPipeline	= pipelineRegistry.get(graphicsPipelineKey, VK_NULL_HANDLE);
+	instancedPipeline	= pipelineRegistry.get(instancedPipelineKey, VK_NULL_HANDLE);
+	indirectPipeline	= gpuDrivenActive() ? pipelineRegistry.get(indirectPipelineKey, VK_NULL_HANDLE) : VK_NULL_HANDLE;
+
+	std::cout << "[PIPELINES]: " << pipelineRegistry.size() << " variants compiled in " << compileTime << " ms" << std::endl;
+	if (graphicsPipelineLibraryActive())
+	{
+		std::cout << "[PIPELINES]: linked from " << pipelineLibraries.size() << " pipeline libraries" << std::endl;
+	}
+
+	// Shader sources live in the working directory
+	if (useShaderHotReload)
+	{
+		shaderWatcher.start(".");
+	}
+}
+
+void HelloTriangleApp::updatePipelines()
+{
+	// Edited shaders : rebuild their variants in the background (the shader cache recompiles the sources)
+	if (useShaderHotReload)
+	{
+		std::vector<std::string> changedFiles = shaderWatcher.takeChanges();
+		if (!changedFiles.empty())
+		{
+			size_t rebuilt = pipelineRegistry.reload(changedFiles);
+			librariesOutdated = librariesOutdated || rebuilt > 0;
+			std::cout << "[PIPELINES]: " << changedFiles.size() << " shader sources changed, rebuilding " << rebuilt << " variants" << std::endl;
+
+			// The culling pipeline isn't a registry variant (compute), it is rebuilt on its own
+			// (cull.comp or an include)
+			bool cullShaderChanged = std::any_of(changedFiles.begin(), changedFiles.end(), [](const std::string& file)
+			{
+				std::filesystem::path path = std::filesystem::path(file).lexically_normal();
+				return path == "cull.comp" || path.extension() == ".glsl";
+			});
+			if (gpuDrivenActive() && cullShaderChanged)
+			{
+				reloadCullPipeline();
+			}
+		}
+	}
+
+	// Rebuilt culling pipeline : swap it in, the old one is destroyed like a replaced variant
+	VkPipeline previousCull = cullPipeline;
+	if (cullPipelineReload.valid() &&
+		cullPipelineReload.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+	{
+		try
+		{
+			cullPipeline = cullPipelineReload.get();
+			pipelineRegistry.retire(previousCull);
+		}
+		catch (const std::exception& error)
+		{
+			// A broken edit must not take the app down
+			std::cerr << "[PIPELINES]: reloading cull.comp failed, keeping the previous pipeline\n" << error.what() << std::endl;
+		}
+		cullPipelineReload = {};
+
+		if (cullPipelineReloadPending)
+		{
+			cullPipelineReloadPending = false;
+			reloadCullPipeline();
+		}
+	}
+
+	// Libraries of the code a reload replaced : once the relinks finished no link needs them,
+	// the pipelines linked from them don't depend on them anymore
+	if (librariesOutdated && pipelineRegistry.idle())
+	{
+		std::lock_guard<std::mutex> lock(shaderCodeHashMutex);
+		std::vector<VkPipeline> outdated = pipelineLibraries.takeOutdated(shaderCodeHashes);
+		for (VkPipeline library : outdated)
+		{
+			pipelineRegistry.retire(library);
+		}
+		if (!outdated.empty())
+		{
+			std::cout << "[PIPELINES]: dropped " << outdated.size() << " outdated pipeline libraries" << std::endl;
+		}
+		librariesOutdated = false;
+	}
+
+	// Pipelines replaced by finished reloads are swapped below, but frames
+	// submitted so far may still use them : destroyed once the timeline passed frameNumber
+	pipelineRegistry.retireReplaced(frameNumber);
+
+	// Keep drawing with the current pipeline (the fallback) until the requested variant is ready,
+	// a variant requested at runtime never stalls the frame
+	VkPipeline previousGraphics		= graphicsPipeline;
+	VkPipeline previousInstanced	= instancedPipeline;
+	VkPipeline previousIndirect		= indirectPipeline;
+
+	graphicsPipeline	= pipelineRegistry.get(graphicsPipelineKey, graphicsPipeline);
+	instancedPipeline	= pipelineRegistry.get(instancedPipelineKey, instancedPipeline);
+	if (gpuDrivenActive())
+	{
+		indirectPipeline = pipelineRegistry.get(indirectPipelineKey, indirectPipeline);
+	}
+
+	// Cached command buffers still bind the previous pipelines
+	// (or set the dynamic state of the previous keys, the pipeline may be the same)
+	std::array<GraphicsPipelineKey, 3> currentKeys = { graphicsPipelineKey, instancedPipelineKey, indirectPipelineKey };
+	if (graphicsPipeline != previousGraphics ||
+		instancedPipeline != previousInstanced ||
+		indirectPipeline != previousIndirect ||
+		cullPipeline != previousCull ||
+		currentKeys != recordedPipelineKeys)
+	{
+		std::fill(cachedCommandBufferValid.begin(), cachedCommandBufferValid.end(), false);
+		recordedPipelineKeys = currentKeys;
+	}
+}
+
+VkPipeline HelloTriangleApp::buildGraphicsPipeline(
+	const GraphicsPipelineKey& key,				/* shaders and state of the variant */
+	VkPipelineCache cache,						/* cache of the worker thread compiling it */
+	VkGraphicsPipelineLibraryFlagsEXT libraryParts,	/* 0 : whole pipeline, otherwise a library of these parts */
+	const std::vector<uint32_t>* libraryCode		/* SPIR-V of the library's shader if the link compiled it already */
+)
 {
 	// Graphics pipeline: sequence of operations, takes in vertices/textures and renders them
 	// Stages: 
@@ -717,21 +1317,74 @@ void HelloTriangleApp::createGraphicsPipeline()
 	// ---------------------------- SHADER MODULES ----------------------------
 	// Define programable stages of the graphics pipeline
 
-	// Reading pre-compiled SPIR-V shaders
-	auto vertShaderCode = ShaderCompiler::readFile("vert.spv");
-	auto fragShaderCode = ShaderCompiler::readFile("frag.spv");
+	// Pipeline libraries only hold the stages of their parts
+	bool withVertexShader =
+		libraryParts == 0 || (libraryParts & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT);
+	bool withFragmentShader =
+		libraryParts == 0 || (libraryParts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT);
+
+	// GLSL compiled to SPIR-V at runtime (cached on disk, see ShaderCompiler)
+	// A shader library holds a single stage, its code may come from the link
+	std::vector<uint32_t> vertShaderCode;
+	std::vector<uint32_t> fragShaderCode;
+	if (withVertexShader)
+	{
+		vertShaderCode = libraryCode && !withFragmentShader ? *libraryCode : ShaderCompiler::compile(key.vertexShader);
+	}
+	if (withFragmentShader)
+	{
+		fragShaderCode = libraryCode && !withVertexShader ? *libraryCode : ShaderCompiler::compile(key.fragmentShader);
+	}
 
-	// Create shader modules for each shaders
-	VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-	VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+	// Check the interface of the shaders (reflection) against what the variant feeds them,
+	// an edited shader reading a missing attribute fails here instead of in the driver
+	ShaderReflection vertReflection = withVertexShader ? ShaderReflection::reflect(vertShaderCode) : ShaderReflection();
+	ShaderReflection fragReflection = withFragmentShader ? ShaderReflection::reflect(fragShaderCode) : ShaderReflection();
 
-	// Define vertex shader stage of graphics pipeline
-	VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT; /* define it as vertex shader */
-	vertShaderStageInfo.module = vertShaderModule;
-	// Define entry point a.k.a "main" function
-	vertShaderStageInfo.pName = "main";
+	std::vector<uint32_t> providedLocations;
+	for (const VkVertexInputAttributeDescription& attribute : Vertex::attributeDescriptions())
+	{
+		providedLocations.push_back(attribute.location);
+	}
+	if (key.vertexLayout == VertexLayout::MeshInstanced)
+	{
+		for (const VkVertexInputAttributeDescription& attribute : InstanceData::attributeDescriptions())
+		{
+			providedLocations.push_back(attribute.location);
+		}
+	}
+	for (const ReflectedInput& input : vertReflection.inputs)
+	{
+		if (std::find(providedLocations.begin(), providedLocations.end(), input.location) == providedLocations.end())
+		{
+			throw std::runtime_error("[ERROR] : " + key.vertexShader + " reads vertex input location " +
+				std::to_string(input.location) + ", which the vertex layout doesn't provide!");
+		}
+	}
+
+	// Create shader modules for each shaders
+	VkShaderModule vertShaderModule = withVertexShader ? createShaderModule(vertShaderCode) : VK_NULL_HANDLE;
+	VkShaderModule fragShaderModule = VK_NULL_HANDLE;
+	if (withFragmentShader)
+	{
+		try
+		{
+			fragShaderModule = createShaderModule(fragShaderCode);
+		}
+		catch (...)
+		{
+			vkDestroyShaderModule(device, vertShaderModule, nullptr);
+			throw;
+		}
+	}
+
+	// Define vertex shader stage of graphics pipeline
+	VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT; /* define it as vertex shader */
+	vertShaderStageInfo.module = vertShaderModule;
+	// Define entry point a.k.a "main" function
+	vertShaderStageInfo.pName = "main";
 	// Allows us to define constant values of shader constants
 	// More effecient than using it at runtime
 	// Enables optimalizations (eliminate "if"s)
@@ -744,12 +1397,61 @@ void HelloTriangleApp::createGraphicsPipeline()
 	fragShaderStageInfo.module = fragShaderModule;
 	fragShaderStageInfo.pName = "main";
 
-	// Collect the shader stage creation infos into an array
-	VkPipelineShaderStageCreateInfo shaderStages[] = {
-		vertShaderStageInfo,
-		fragShaderStageInfo
+	// Specialization constants of the fragment shader : the features of the variant
+	// Boolean constants are 32 bit (VkBool32) on the API side
+	struct FragmentSpecialization {
+		VkBool32 texturing;
+		VkBool32 vertexColor;
+		VkBool32 alphaTest;
+		uint32_t lightCount;
+	} fragmentSpecialization = {
+		key.features.texturing ? VK_TRUE : VK_FALSE,
+		key.features.vertexColor ? VK_TRUE : VK_FALSE,
+		key.features.alphaTest ? VK_TRUE : VK_FALSE,
+		key.features.lightCount
 	};
 
+	// constantID (layout(constant_id = ...) in the shader), offset and size in the data
+	std::array<VkSpecializationMapEntry, 4> fragmentSpecializationEntries = {{
+		{ 0, offsetof(FragmentSpecialization, texturing),	sizeof(VkBool32) },
+		{ 1, offsetof(FragmentSpecialization, vertexColor),	sizeof(VkBool32) },
+		{ 2, offsetof(FragmentSpecialization, alphaTest),	sizeof(VkBool32) },
+		{ 3, offsetof(FragmentSpecialization, lightCount),	sizeof(uint32_t) }
+	}};
+
+	// Every value must have the size of its constant in the shader (bool : VkBool32)
+	for (const ReflectedSpecConstant& constant : fragReflection.specConstants)
+	{
+		for (const VkSpecializationMapEntry& entry : fragmentSpecializationEntries)
+		{
+			if (entry.constantID == constant.id && entry.size != constant.size)
+			{
+				vkDestroyShaderModule(device, fragShaderModule, nullptr);
+				vkDestroyShaderModule(device, vertShaderModule, nullptr);
+				throw std::runtime_error("[ERROR] : Specialization constant " + std::to_string(constant.id) +
+					" of " + key.fragmentShader + " has a different type than its value!");
+			}
+		}
+	}
+
+	VkSpecializationInfo fragmentSpecializationInfo{};
+	fragmentSpecializationInfo.mapEntryCount	= static_cast<uint32_t>(fragmentSpecializationEntries.size());
+	fragmentSpecializationInfo.pMapEntries		= fragmentSpecializationEntries.data();
+	fragmentSpecializationInfo.dataSize			= sizeof(fragmentSpecialization);
+	fragmentSpecializationInfo.pData			= &fragmentSpecialization;
+	fragShaderStageInfo.pSpecializationInfo = &fragmentSpecializationInfo;
+
+	// Collect the shader stage creation infos into an array
+	std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+	if (withVertexShader)
+	{
+		shaderStages.push_back(vertShaderStageInfo);
+	}
+	if (withFragmentShader)
+	{
+		shaderStages.push_back(fragShaderStageInfo);
+	}
+
 	// ------------------------- FIXED-FUNCTION STATE -------------------------
 	// Define fixed stages of the graphics pipeline.
 
@@ -760,6 +1462,30 @@ void HelloTriangleApp::createGraphicsPipeline()
 		VK_DYNAMIC_STATE_VIEWPORT,	/* region of framebuffer to be transformed */
 		VK_DYNAMIC_STATE_SCISSOR	/* region of framebuffer to be filtered */
 	};
+	// Extended dynamic state : the values below only serve as defaults,
+	// recordDynamicPipelineState sets the ones of the key being drawn
+	if (pipelineDynamicState.rasterization)
+	{
+		dynamicStates.insert(dynamicStates.end(), {
+			VK_DYNAMIC_STATE_CULL_MODE,
+			VK_DYNAMIC_STATE_FRONT_FACE,
+			VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY,	/* same topology class only */
+			VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE,
+			VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE,
+			VK_DYNAMIC_STATE_DEPTH_COMPARE_OP,
+			VK_DYNAMIC_STATE_DEPTH_BIAS_ENABLE,
+			VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE,
+			VK_DYNAMIC_STATE_RASTERIZER_DISCARD_ENABLE
+		});
+	}
+	if (pipelineDynamicState.colorBlend)
+	{
+		dynamicStates.insert(dynamicStates.end(), {
+			VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT,
+			VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT,
+			VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT
+		});
+	}
 
 	VkPipelineDynamicStateCreateInfo dynamicState{};
 	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
@@ -768,14 +1494,23 @@ void HelloTriangleApp::createGraphicsPipeline()
 
 	// ---------------------------- VERTEX BUFFER -----------------------------
 	// Adding vertex binding desc. and attribute desc.
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attributeDescriptions = Vertex::attributeDescriptions();
+	std::vector<VkVertexInputBindingDescription> bindingDescriptions = { Vertex::getBindingDescription() };
+	auto vertexAttributes = Vertex::attributeDescriptions();
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions(vertexAttributes.begin(), vertexAttributes.end());
+
+	// Instanced pipelines also read the per-instance binding
+	if (key.vertexLayout == VertexLayout::MeshInstanced)
+	{
+		bindingDescriptions.push_back(InstanceData::getBindingDescription());
+		auto instanceAttributes = InstanceData::attributeDescriptions();
+		attributeDescriptions.insert(attributeDescriptions.end(), instanceAttributes.begin(), instanceAttributes.end());
+	}
 	
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 	// Defining vertex input descriptor
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+	vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+	vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
 	// Defining vertex input attribute descriptor
 	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
 	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
@@ -793,7 +1528,7 @@ void HelloTriangleApp::createGraphicsPipeline()
 	//										  without reuse
 	// VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP	: second and third vertices are 
 	//										  reused for next triangle
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	inputAssembly.topology = key.topology;
 	// Defines whether to use a special vertex index value (0xFFFFFFFF or 0xFFFF)
 	// Used for optimalisation to break up lines/triangles to _STRIP topologies
 	inputAssembly.primitiveRestartEnable = VK_FALSE;
@@ -826,12 +1561,12 @@ void HelloTriangleApp::createGraphicsPipeline()
 	// VK_CULL_MODE_FRONT_BIT		: front-facing triangles are discarded
 	// VK_CULL_MODE_BACK_BIT		: back-facing triangles are discarded
 	// VK_CULL_MODE_FRONT_AND_BACK	: all triangles are discarded
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+	rasterizer.cullMode = key.cullMode;
 	// frontFace : specifies vertex order to be considered front-facing
 	// VK_FRONT_FACE_COUNTER_CLOCKWISE	: triangle positive area is front-facing
 	// VK_FRONT_FACE_CLOCKWISE			: triangle negative area is front-facing
 	// positive/negative are calculation : https://registry.khronos.org/vulkan/specs/latest/man/html/VkFrontFace.html
-	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizer.frontFace = key.frontFace;
 	// We can also add/biasing for depth values (example: shadow mapping)
 	rasterizer.depthBiasEnable = VK_FALSE;
 	rasterizer.depthBiasConstantFactor = 0.0f;
@@ -875,6 +1610,13 @@ void HelloTriangleApp::createGraphicsPipeline()
 	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
 	// Define which blend operation to use for calculating Alpha values
 	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+	// Alpha blended variants : see the example below
+	if (key.blendMode == BlendMode::AlphaBlend)
+	{
+		colorBlendAttachment.blendEnable = VK_TRUE;
+		colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+		colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	}
 	// All possible blend factors: https://registry.khronos.org/vulkan/specs/latest/man/html/VkBlendFactor.html
 	// All possible blend operations : https://registry.khronos.org/vulkan/specs/latest/man/html/VkBlendOp.html
 	// Pseudo-code for colorblend algorithm
@@ -929,11 +1671,10 @@ void HelloTriangleApp::createGraphicsPipeline()
 	// Define depth testing in pipeline
 	VkPipelineDepthStencilStateCreateInfo depthStencil{};
 	depthStencil.sType				= VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencil.depthTestEnable		= VK_TRUE; /* Compare depth values, 
-													  discard fragments */
-	depthStencil.depthWriteEnable		= VK_TRUE; /* Write passed depth values */
+	depthStencil.depthTestEnable		= key.depthTest ? VK_TRUE : VK_FALSE;	/* Compare depth values, discard fragments */
+	depthStencil.depthWriteEnable		= key.depthWrite ? VK_TRUE : VK_FALSE;	/* Write passed depth values */
 	// Define depth test comparison
-	depthStencil.depthCompareOp			= VK_COMPARE_OP_LESS;
+	depthStencil.depthCompareOp			= key.depthCompareOp;
 	// Test if depth values are within range
 	depthStencil.depthBoundsTestEnable	= VK_FALSE;
 	depthStencil.minDepthBounds			= 0.0f;
@@ -943,33 +1684,14 @@ void HelloTriangleApp::createGraphicsPipeline()
 	depthStencil.front					= {};
 	depthStencil.back					= {};
 
-	// --------------------------- PIPELINE LAYOUT ----------------------------
-	// Define uniform and push values, referenced by shaders, updated at draw time
-	
-	// Create pipeline layout for our renderer
-	// Note: uniform values needs to be defined here
-	// Uniform values: dynamic state variables that can be changed at draw time
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	// Set descriptor set layouts we want to use
-	pipelineLayoutInfo.setLayoutCount = 1;
-	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-	pipelineLayoutInfo.pushConstantRangeCount = 0;
-	pipelineLayoutInfo.pPushConstantRanges = nullptr;
-
-	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
-	{
-		throw std::runtime_error("[ERROR] : Failed to create pipeline layout!");
-	}
-
 	// -------------------------- PIPELINE ASSEMBLY ---------------------------
 	// Assemble our graphics pipeline to dispatch drawing operations
 
 	VkGraphicsPipelineCreateInfo pipelineInfo{};
 	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 	// Define the programable stages of our pipeline
-	pipelineInfo.stageCount = 2; /* vertex/fragment stages */
-	pipelineInfo.pStages = shaderStages;
+	pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size()); /* vertex/fragment stages */
+	pipelineInfo.pStages = shaderStages.data();
 	// Define fixed-function stage of our pipeline, one-by-one
 	pipelineInfo.pVertexInputState		= &vertexInputInfo;
 	pipelineInfo.pInputAssemblyState	= &inputAssembly;
@@ -980,12 +1702,34 @@ void HelloTriangleApp::createGraphicsPipeline()
 	pipelineInfo.pColorBlendState		= &colorBlending;
 	pipelineInfo.pDynamicState			= &dynamicState;
 	// Define the pipeline layout
-	pipelineInfo.layout = pipelineLayout;
+	pipelineInfo.layout = key.layout;
 	// Define render pass of our pipeline
 	// Its possible to switch up the render pass of our pipeline
 	// More about that: https://docs.vulkan.org/spec/latest/chapters/renderpass.html#renderpass-compatibility
-	pipelineInfo.renderPass = renderPass;
-	pipelineInfo.subpass = 0;	/* no subpasses */
+	pipelineInfo.renderPass = key.renderPass;
+	pipelineInfo.subpass = key.subpass;	/* no subpasses */
+	// Without a render pass (dynamic rendering) the attachment formats are chained instead
+	// (no stencil format : rendering never binds a stencil attachment)
+	VkPipelineRenderingCreateInfo renderingInfo{};
+	renderingInfo.sType						= VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+	renderingInfo.colorAttachmentCount		= 1;
+	renderingInfo.pColorAttachmentFormats	= &key.colorFormat;
+	renderingInfo.depthAttachmentFormat		= key.depthFormat;
+	if (key.renderPass == VK_NULL_HANDLE)
+	{
+		pipelineInfo.pNext = &renderingInfo;
+	}
+	// Pipeline library : the state of libraryParts only (the rest is ignored), linked into pipelines later
+	// Retaining the link time optimization info lets the optimized link still optimize across parts
+	VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+	libraryInfo.sType	= VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+	libraryInfo.flags	= libraryParts;
+	if (libraryParts != 0)
+	{
+		libraryInfo.pNext	= pipelineInfo.pNext;
+		pipelineInfo.pNext	= &libraryInfo;
+		pipelineInfo.flags	|= VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+	}
 	// Define pipeline by deriving it from an already existing one
 	// Mainly for efficiency, when defining functionally similar pipelines
 	// Can be done with handle or with index
@@ -994,32 +1738,205 @@ void HelloTriangleApp::createGraphicsPipeline()
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 	pipelineInfo.basePipelineIndex = -1;
 
-	if (vkCreateGraphicsPipelines(
+	VkPipeline pipeline;
+	VkResult result = vkCreateGraphicsPipelines(
 		device, 
-		VK_NULL_HANDLE, /* used to significantly speed up pipeline creation */
+		cache, /* used to significantly speed up pipeline creation */
 		1, 
 		&pipelineInfo,  /* multiple pipelines can be created with a single call */
 		nullptr, 
-		&graphicsPipeline) != VK_SUCCESS)
+		&pipeline);
+
+	// Cleaning up shader modules (also when creation failed : compile jobs report
+	// the error and the application keeps running)
+	vkDestroyShaderModule(device, fragShaderModule, nullptr);
+	vkDestroyShaderModule(device, vertShaderModule, nullptr);
+
+	if (result != VK_SUCCESS)
 	{
 		throw std::runtime_error("[ERROR] : Failed to create graphics pipeline!");
 	}
 
-	// Cleaning up shader modules
-	vkDestroyShaderModule(device, fragShaderModule, nullptr);
-	vkDestroyShaderModule(device, vertShaderModule, nullptr);
+	return pipeline;
+}
+
+VkPipeline HelloTriangleApp::linkGraphicsPipeline(
+	const GraphicsPipelineKey& key,	/* shaders and state of the variant */
+	VkPipelineCache cache,			/* cache of the worker thread linking it */
+	bool optimize					/* link time optimization : slower to link, faster to draw with */
+)
+{
+	// Each part is a library shared by every variant with the same state for it,
+	// only the parts no variant compiled yet are compiled here
+	const std::array<std::pair<PipelineLibraryPart, VkGraphicsPipelineLibraryFlagsEXT>, 4> parts = {{
+		{ PipelineLibraryPart::VertexInput,			VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT },
+		{ PipelineLibraryPart::PreRasterization,	VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT },
+		{ PipelineLibraryPart::FragmentShader,		VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT },
+		{ PipelineLibraryPart::FragmentOutput,		VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT }
+	}};
+
+	// Shader parts are also keyed by their SPIR-V : an edited shader (hot reload) gets a new library
+	// The fast link compiles each shader once (shader cache) and records its hash,
+	// the optimized link of the same build finds its libraries through the recorded hashes
+	std::vector<uint32_t> vertCode;
+	std::vector<uint32_t> fragCode;
+	uint64_t vertHash = 0;
+	uint64_t fragHash = 0;
+	bool recorded = false;
+	if (optimize)
+	{
+		std::lock_guard<std::mutex> lock(shaderCodeHashMutex);
+		auto vert = shaderCodeHashes.find(key.vertexShader);
+		auto frag = shaderCodeHashes.find(key.fragmentShader);
+		if (vert != shaderCodeHashes.end() && frag != shaderCodeHashes.end())
+		{
+			vertHash = vert->second;
+			fragHash = frag->second;
+			recorded = true;
+		}
+	}
+	if (!recorded)
+	{
+		vertCode = ShaderCompiler::compile(key.vertexShader);
+		fragCode = ShaderCompiler::compile(key.fragmentShader);
+		vertHash = ShaderCompiler::hash(vertCode.data(), vertCode.size() * sizeof(uint32_t));
+		fragHash = ShaderCompiler::hash(fragCode.data(), fragCode.size() * sizeof(uint32_t));
+
+		std::lock_guard<std::mutex> lock(shaderCodeHashMutex);
+		shaderCodeHashes[key.vertexShader] = vertHash;
+		shaderCodeHashes[key.fragmentShader] = fragHash;
+	}
+
+	std::array<VkPipeline, 4> libraries{};
+	for (size_t i = 0; i < parts.size(); ++i)
+	{
+		PipelineLibraryPart part = parts[i].first;
+		VkGraphicsPipelineLibraryFlagsEXT flags = parts[i].second;
+
+		uint64_t codeHash = 0;
+		const std::vector<uint32_t>* code = nullptr;
+		if (part == PipelineLibraryPart::PreRasterization)
+		{
+			codeHash = vertHash;
+			code = vertCode.empty() ? nullptr : &vertCode;
+		}
+		else if (part == PipelineLibraryPart::FragmentShader)
+		{
+			codeHash = fragHash;
+			code = fragCode.empty() ? nullptr : &fragCode;
+		}
+
+		libraries[i] = pipelineLibraries.getOrCreate(part, PipelineLibraryCache::partKey(part, key), codeHash,
+			[this, &key, cache, flags, code] { return buildGraphicsPipeline(key, cache, flags, code); });
+	}
+
+	VkPipelineLibraryCreateInfoKHR libraryInfo{};
+	libraryInfo.sType			= VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+	libraryInfo.libraryCount	= static_cast<uint32_t>(libraries.size());
+	libraryInfo.pLibraries		= libraries.data();
+
+	// Every state comes from the libraries
+	VkGraphicsPipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType	= VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.pNext	= &libraryInfo;
+	pipelineInfo.flags	= optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+	pipelineInfo.layout	= key.layout;
+	pipelineInfo.basePipelineIndex = -1;
+
+	VkPipeline pipeline;
+	if (vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("[ERROR] : Failed to link graphics pipeline!");
+	}
+
+	return pipeline;
+}
+
+void HelloTriangleApp::createCullPipeline()
+{
+	if (!gpuDrivenActive())
+	{
+		return;
+	}
+
+	// Layout from the reflected shader (its single set is cullDescriptorSetLayout)
+	// (the compile is cached, buildCullPipeline doesn't compile it again)
+	ShaderReflection cullLayout = ShaderReflection::reflect(ShaderCompiler::compile("cull.comp"));
+	cullLayout.makeUniformBuffersDynamic();
+	cullPipelineLayout = layoutCache.getPipelineLayout(cullLayout);
+
+	cullPipeline = buildCullPipeline(pipelineCache.handle());
+}
+
+VkPipeline HelloTriangleApp::buildCullPipeline(VkPipelineCache cache)
+{
+	// Compute pipelines only have a single (compute) shader stage,
+	// no fixed-function state and no render pass
+	auto cullShaderCode = ShaderCompiler::compile("cull.comp");
+	VkShaderModule cullShaderModule = createShaderModule(cullShaderCode);
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType			= VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType	= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage	= VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module	= cullShaderModule;
+	pipelineInfo.stage.pName	= "main";
+	pipelineInfo.layout			= cullPipelineLayout;
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkResult result = vkCreateComputePipelines(device, cache, 1, &pipelineInfo, nullptr, &pipeline);
+	vkDestroyShaderModule(device, cullShaderModule, nullptr);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("[ERROR] : Failed to create culling pipeline!");
+	}
+
+	return pipeline;
+}
+
+void HelloTriangleApp::reloadCullPipeline()
+{
+	// The running rebuild may have read the old source already
+	if (cullPipelineReload.valid())
+	{
+		cullPipelineReloadPending = true;
+		return;
+	}
+
+	// The layout is kept : edits changing the interface (bindings, push constants) need a restart
+	auto promise = std::make_shared<std::promise<VkPipeline>>();
+	cullPipelineReload = promise->get_future();
+	jobSystem.runBackground([this, promise]
+	{
+		// Own pipeline cache, like the variant builds of the registry
+		VkPipelineCache workerCache = VK_NULL_HANDLE;
+		try
+		{
+			workerCache = pipelineCache.createWorkerCache();
+			VkPipeline pipeline = buildCullPipeline(workerCache);
+			pipelineCache.mergeWorkerCache(workerCache);
+			promise->set_value(pipeline);
+		}
+		catch (...)
+		{
+			if (workerCache != VK_NULL_HANDLE)
+			{
+				vkDestroyPipelineCache(device, workerCache, nullptr);
+			}
+			promise->set_exception(std::current_exception());
+		}
+	}, &cullPipelineReloading);
 }
 
-VkShaderModule HelloTriangleApp::createShaderModule(const std::vector<char>& code)
+VkShaderModule HelloTriangleApp::createShaderModule(const std::vector<uint32_t>& code)
 {
 	// Define shader module creation parameters
 	VkShaderModuleCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = code.size();
-	// Bytecode is specified in bytes, 
-	// but pCode is const uint32*, 
-	// therefore we need to recast it
-	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+	// Bytecode size is specified in bytes,
+	// pCode must be 4 byte aligned (a vector of words always is)
+	createInfo.codeSize = code.size() * sizeof(uint32_t);
+	createInfo.pCode = code.data();
 
 	VkShaderModule shaderModule;
 	if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
@@ -1032,6 +1949,13 @@ VkShaderModule HelloTriangleApp::createShaderModule(const std::vector<char>& cod
 
 void HelloTriangleApp::createRenderPass()
 {
+	// Dynamic rendering describes the attachments when rendering begins
+	if (dynamicRenderingActive())
+	{
+		renderPass = VK_NULL_HANDLE;
+		return;
+	}
+
 	// ----------------------------- RENDER PASS ------------------------------
 	// Define attachments referenced by the pipeline stages and their usage
 	
@@ -1165,6 +2089,14 @@ void HelloTriangleApp::createRenderPass()
 
 void HelloTriangleApp::createFramebuffers()
 {
+	// The render graph creates a framebuffer per swap chain image for each of its passes
+	// Dynamic rendering needs no framebuffers at all
+	if (renderGraphActive() || dynamicRenderingActive())
+	{
+		swapChainFramebuffers.clear();
+		return;
+	}
+
 	swapChainFramebuffers.resize(swapChainImageViews.size());
 
 	for (size_t i = 0; i < swapChainImageViews.size(); ++i)
@@ -1218,6 +2150,43 @@ void HelloTriangleApp::createCommandPool()
 	{
 		throw std::runtime_error("[ERROR] : Failed to create graphics queue command pool!");
 	}
+
+	// Create a command pool for each recording thread in each frame in flight
+	// Command pools are externally synchronized, one pool per thread avoids locking
+	// Their buffers are rerecorded every frame and the whole pool is reset at once
+	// (one chunk per job system thread : the workers and the render thread)
+	uint32_t threadCount = std::clamp(jobSystem.workerCount() + 1, 1u, MAX_RECORDING_THREADS);
+
+	VkCommandPoolCreateInfo threadPoolInfo{};
+	threadPoolInfo.sType			= VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	threadPoolInfo.flags			= VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	threadPoolInfo.queueFamilyIndex	= queueFamilyIndices.graphicsFamily.value();
+
+	for (size_t i = 0; i < framesInFlight; ++i)
+	{
+		threadCommandPools[i].resize(threadCount);
+		for (uint32_t t = 0; t < threadCount; ++t)
+		{
+			if (vkCreateCommandPool(device, &threadPoolInfo, nullptr, &threadCommandPools[i][t]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("[ERROR] : Failed to create recording thread command pool!");
+			}
+		}
+	}
+
+	// Command buffers are tied to the queue family of their pool
+	if (asyncComputeActive())
+	{
+		VkCommandPoolCreateInfo computePoolInfo{};
+		computePoolInfo.sType				= VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		computePoolInfo.flags				= VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		computePoolInfo.queueFamilyIndex	= queueFamilyIndices.computeFamily.value();
+
+		if (vkCreateCommandPool(device, &computePoolInfo, nullptr, &computeCommandPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[ERROR] : Failed to create compute command pool!");
+		}
+	}
 }
 
 void HelloTriangleApp::loadModel()
@@ -1229,13 +2198,21 @@ void HelloTriangleApp::loadModel()
 	std::string warn;
 	std::string err;
 
+	// Parse straight from the mapped file instead of a copy of it,
+	// the material library (mtllib) is still looked up in the working directory
+	MappedFile objFile("viking_room.obj");
+	MemoryStreamBuffer objBuffer(objFile.data(), objFile.size());
+	std::istream objStream(&objBuffer);
+	tinyobj::MaterialFileReader materialReader("");
+
 	if (!tinyobj::LoadObj(
 		&attrib,
 		&shapes,
 		&materials,
 		&warn,
 		&err,
-		"viking_room.obj"))
+		&objStream,
+		&materialReader))
 	{
 		throw std::runtime_error("[ERROR] : " + err);
 	}
@@ -1281,6 +2258,118 @@ void HelloTriangleApp::loadModel()
 			indices.push_back(uniqueVertices[vertex]);
 		}
 	}
+
+	// Bounding sphere of the mesh, used for culling on the GPU
+	// (center of the bounding box, radius reaching the farthest vertex)
+	glm::vec3 minPos(std::numeric_limits<float>::max());
+	glm::vec3 maxPos(std::numeric_limits<float>::lowest());
+	for (const Vertex& vertex : vertices)
+	{
+		minPos = glm::min(minPos, vertex.pos);
+		maxPos = glm::max(maxPos, vertex.pos);
+	}
+
+	glm::vec3 center = (minPos + maxPos) * 0.5f;
+	float radius = 0.0f;
+	for (const Vertex& vertex : vertices)
+	{
+		radius = std::max(radius, glm::length(vertex.pos - center));
+	}
+
+	meshBoundingSphere = glm::vec4(center, radius);
+
+	// The whole model is a single mesh
+	GpuMeshRange meshRange{};
+	meshRange.indexCount	= static_cast<uint32_t>(indices.size());
+	meshRange.firstIndex	= 0;
+	meshRange.vertexOffset	= 0;
+	meshRanges.push_back(meshRange);
+}
+
+void HelloTriangleApp::createSceneObjects()
+{
+	// Only per-object draws keep their objects in the uniform ring,
+	// instances and GPU-driven objects live in buffers sized for the scene
+	VkPhysicalDeviceProperties properties{};
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	uint32_t maxObjects = MAX_SCENE_OBJECTS;
+	if (gpuDrivenActive())
+	{
+		// One storage buffer range holds every object, a single indirect draw covers all of them
+		maxObjects = std::min({
+			MAX_GPU_DRIVEN_OBJECTS,
+			static_cast<uint32_t>(properties.limits.maxStorageBufferRange / sizeof(GpuObjectData)),
+			properties.limits.maxDrawIndirectCount
+		});
+	}
+	else if (instancedRenderingActive())
+	{
+		maxObjects = MAX_INSTANCES;
+	}
+
+	if (sceneObjectCount > maxObjects)
+	{
+		throw std::runtime_error("[ERROR] : Too many scene objects (at most " + std::to_string(maxObjects) + " on this render path)!");
+	}
+
+	// Lay out our objects on a square grid around the origin
+	uint32_t gridSize = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(sceneObjectCount))));
+	const float spacing = 2.5f;
+	float gridOffset = (gridSize - 1) * spacing * 0.5f;
+
+	sceneObjects.resize(sceneObjectCount);
+	objectUniformOffsets.resize(sceneObjectCount);
+	animatedObjects.clear();
+
+	for (uint32_t i = 0; i < sceneObjectCount; ++i)
+	{
+		sceneObjects[i].position = {
+			(i % gridSize) * spacing - gridOffset,
+			(i / gridSize) * spacing - gridOffset,
+			0.0f
+		};
+		sceneObjects[i].meshIndex = 0;
+		sceneObjects[i].animated = i % ANIMATED_OBJECT_STRIDE == 0;
+		if (sceneObjects[i].animated)
+		{
+			animatedObjects.push_back(i);
+		}
+	}
+
+	buildInstanceBatches();
+}
+
+void HelloTriangleApp::buildInstanceBatches()
+{
+	// Sort objects by mesh, so objects sharing a mesh
+	// occupy neighbouring slots of the instance buffer
+	// (stable, objects of a mesh keep their scene order)
+	instanceOrder.resize(sceneObjects.size());
+	for (uint32_t i = 0; i < instanceOrder.size(); ++i)
+	{
+		instanceOrder[i] = i;
+	}
+	std::stable_sort(instanceOrder.begin(), instanceOrder.end(),
+		[this](uint32_t a, uint32_t b) {
+			return sceneObjects[a].meshIndex < sceneObjects[b].meshIndex;
+		});
+
+	// Every run of the same mesh becomes one instanced draw
+	instanceBatches.clear();
+	for (uint32_t slot = 0; slot < instanceOrder.size(); ++slot)
+	{
+		uint32_t meshIndex = sceneObjects[instanceOrder[slot]].meshIndex;
+
+		if (instanceBatches.empty() || instanceBatches.back().meshIndex != meshIndex)
+		{
+			instanceBatches.push_back({ meshIndex, slot, 0 });
+		}
+		instanceBatches.back().instanceCount++;
+	}
+
+	// Batches are baked into cached command buffers
+	invalidateCommandBuffers();
 }
 
 void HelloTriangleApp::oldCreateVertexBuffer()
@@ -1395,6 +2484,12 @@ void HelloTriangleApp::createVertexBuffer()
 
 void HelloTriangleApp::createDepthResources()
 {
+	// The render graph creates (and aliases) its own depth image
+	if (renderGraphActive())
+	{
+		return;
+	}
+
 	// Format: we only need a reasonable accuracy (at least 24 bits)
 	// Usable formats
 	// VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT
@@ -1417,20 +2512,136 @@ void HelloTriangleApp::createDepthResources()
 		VK_IMAGE_ASPECT_DEPTH_BIT
 	);
 
-	transitionImageLayout(
-		depthImage,
-		depthFormat,
-		VK_IMAGE_LAYOUT_UNDEFINED,
-		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+	// No explicit layout transition : the render pass (or the barrier of recordDynamicMainPass)
+	// starts the depth attachment from VK_IMAGE_LAYOUT_UNDEFINED (it is cleared anyway),
+	// which also keeps a swap chain recreation from waiting for the queue to idle
+}
+
+void HelloTriangleApp::buildRenderGraph()
+{
+	if (!renderGraphActive())
+	{
+		return;
+	}
+
+	renderGraph.init(device, physicalDevice, dynamicRenderingActive());
+
+	// ------------------------------ RESOURCES -------------------------------
+
+	// Swap chain image : undefined content, usable once the acquire semaphore
+	// waited at COLOR_ATTACHMENT_OUTPUT, handed to the presentation engine at the end
+	RenderGraph::Access acquired{
+		VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_ACCESS_2_NONE,
+		VK_IMAGE_LAYOUT_UNDEFINED
+	};
+	RenderGraph::ResourceHandle backbuffer = renderGraph.importImage(
+		"swap chain",
+		swapChainImages,
+		swapChainImageViews,
+		swapChainImageFormat,
+		VK_IMAGE_ASPECT_COLOR_BIT,
+		acquired,
+		VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
 	);
+	renderGraph.markOutput(backbuffer);
+
+	// Depth only lives during the main pass, the graph owns (and may alias) it
+	VkFormat depthFormat = findDepthFormat();
+	RenderGraph::ImageDesc depthDesc{};
+	depthDesc.format	= depthFormat;
+	depthDesc.extent	= swapChainExtent;
+	depthDesc.usage		= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	depthDesc.aspect	= VK_IMAGE_ASPECT_DEPTH_BIT |
+						  (hasStencilComponent(depthFormat) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+	RenderGraph::ResourceHandle depth = renderGraph.createImage("depth", depthDesc);
+
+	// -------------------------------- PASSES --------------------------------
+
+	// GPU-driven path : the culling shader writes the indirect draws (and their count)
+	// The count is only used with drawIndirectCount, otherwise its clear pass gets culled
+	// With async compute the culling runs on the compute queue,
+	// a semaphore instead of the graph orders it before the main pass
+	bool cullInGraph = gpuDrivenActive() && !asyncComputeActive();
+	RenderGraph::ResourceHandle drawCommands = 0;
+	RenderGraph::ResourceHandle drawCount = 0;
+	if (cullInGraph)
+	{
+		drawCommands = renderGraph.importBuffer("draw commands");
+		drawCount = renderGraph.importBuffer("draw count");
+
+		RenderGraph::PassHandle clearPass = renderGraph.addPass(
+			"clear draw count",
+			RenderGraph::PassType::Transfer,
+			[this](VkCommandBuffer commandBuffer) { recordDrawCountClear(commandBuffer); }
+		);
+		renderGraph.write(clearPass, drawCount, {
+			VK_PIPELINE_STAGE_2_CLEAR_BIT,
+			VK_ACCESS_2_TRANSFER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED
+		});
+
+		RenderGraph::PassHandle cullPass = renderGraph.addPass(
+			"cull",
+			RenderGraph::PassType::Compute,
+			[this](VkCommandBuffer commandBuffer) { recordCullDispatch(commandBuffer); }
+		);
+		renderGraph.write(cullPass, drawCommands, {
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED
+		});
+		if (drawIndirectCountSupported)
+		{
+			// atomicAdd on the count : read-modify-write
+			renderGraph.write(cullPass, drawCount, {
+				VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+				VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+				VK_IMAGE_LAYOUT_UNDEFINED
+			});
+		}
+	}
+
+	mainPass = renderGraph.addPass(
+		"main",
+		RenderGraph::PassType::Graphics,
+		[this](VkCommandBuffer commandBuffer) { recordMainPass(commandBuffer); }
+	);
+
+	VkClearValue depthClear{};
+	depthClear.depthStencil = { 1.0f, 0 };
+	renderGraph.colorAttachment(mainPass, backbuffer, &clearColor);
+	renderGraph.depthAttachment(mainPass, depth, &depthClear);
+
+	if (cullInGraph)
+	{
+		RenderGraph::Access indirectRead{
+			VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+			VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED
+		};
+		renderGraph.read(mainPass, drawCommands, indirectRead);
+		if (drawIndirectCountSupported)
+		{
+			renderGraph.read(mainPass, drawCount, indirectRead);
+		}
+	}
+
+	renderGraph.compile(swapChainExtent);
+
+	std::cout << "[RENDER GRAPH]: culled passes: " << renderGraph.culledPassCount()
+			  << ", aliased bytes: " << renderGraph.aliasedBytes() << std::endl;
 }
 
 void HelloTriangleApp::createTextureImage()
 {
 	// Loading a texture
+	// Decoded from the mapped file : only the pixels get allocated, not a copy of the file
+	MappedFile textureFile("viking_room.png");
 	int texWidth, texHeight, texChannels;
-	stbi_uc* pixels = stbi_load(
-		"viking_room.png",
+	stbi_uc* pixels = stbi_load_from_memory(
+		reinterpret_cast<const stbi_uc*>(textureFile.data()),
+		static_cast<int>(textureFile.size()),
 		&texWidth,
 		&texHeight,
 		&texChannels,
@@ -1640,67 +2851,163 @@ void HelloTriangleApp::createIndexBuffer()
 
 void HelloTriangleApp::createUniformBuffers()
 {
-	VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+	// Instead of an UBO for each and every frame in flight,
+	// we create a single buffer with a region for each frame in flight
+	// Every object sub-allocates its data from the region of the current frame
+	// Dynamic offsets must be multiples of minUniformBufferOffsetAlignment
+	VkPhysicalDeviceProperties properties{};
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+
+	VkDeviceSize objectSize = UniformRing::alignUp(sizeof(UniformBufferObject), alignment);
+	VkDeviceSize frameSize = objectSize * MAX_SCENE_OBJECTS;
+	VkDeviceSize bufferSize = frameSize * framesInFlight;
+
+	createBuffer(
+		bufferSize,
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		uniformBuffer,
+		uniformBufferMemory,
+		true	/* culling parameters */
+	);
 
-	// We create an UBO for each and every frame in flight
-	uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-	uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-	uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+	// "Persistent mapping" works on all Vulkan implementations
+	vkMapMemory(device, uniformBufferMemory, 0, bufferSize, 0, &uniformBufferMapped);
+
+	uniformRing.init(uniformBufferMapped, frameSize, alignment);
+}
+
+void HelloTriangleApp::createInstanceBuffers()
+{
+	// Instance data is rewritten every frame, so (like the uniform ring)
+	// every frame in flight gets its own persistently mapped buffer
+	VkDeviceSize bufferSize = sizeof(InstanceData) * MAX_INSTANCES;
 
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+	for (size_t i = 0; i < framesInFlight; ++i)
 	{
 		createBuffer(
 			bufferSize,
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
 			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			uniformBuffers[i],
-			uniformBuffersMemory[i]
+			instanceBuffers[i],
+			instanceBuffersMemory[i]
 		);
 
-		// "Persistent mapping" works on all Vulkan implementations
-		vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
+		vkMapMemory(device, instanceBuffersMemory[i], 0, bufferSize, 0, &instanceBuffersMapped[i]);
 	}
 }
 
-void HelloTriangleApp::createDescriptorPool()
+void HelloTriangleApp::createGpuDrivenBuffers()
 {
-	// Descriptor sets need to be created through descriptor pools
-
-	// Define descriptor pool size and type
-	std::array<VkDescriptorPoolSize,2> poolSize{};
-	poolSize[0].type			= VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSize[0].descriptorCount	= static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-	poolSize[1].type			= VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSize[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-
-	// Define descriptor pool properties
-	// Possible error that even validation layer can'ts find (Vulkan 1.1)
-	// VK_ERROR_POOL_OUT_OF_MEMORY : pool is not large enough to allocate more
-	//								 BUT the driver may try to solve it under the hood
-	VkDescriptorPoolCreateInfo poolInfo{};
-	poolInfo.sType			= VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolInfo.poolSizeCount	= static_cast<uint32_t>(poolSize.size());
-	poolInfo.pPoolSizes		= poolSize.data();
-	// Also define maximum count of descriptor sets
-	poolInfo.maxSets		= static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-	// Also has a flag for whether individial descriptor sets can be freed or not
-	// VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT
-
-	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+	if (!gpuDrivenActive())
 	{
-		throw std::runtime_error("[ERROR] : Failed to create descriptor pool!");
+		return;
 	}
-}
 
-bool HelloTriangleApp::hasStencilComponent(VkFormat format)
-{
-	return 
-		format == VK_FORMAT_D32_SFLOAT_S8_UINT ||
-		format == VK_FORMAT_D24_UNORM_S8_UINT;
-}
+	// Mesh ranges never change after loading
+	VkDeviceSize meshRangeBufferSize = sizeof(GpuMeshRange) * meshRanges.size();
 
-VkFormat HelloTriangleApp::findSupportedFormat(
+	createBuffer(
+		meshRangeBufferSize,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		meshRangeBuffer,
+		meshRangeBufferMemory,
+		true
+	);
+
+	void* data;
+	vkMapMemory(device, meshRangeBufferMemory, 0, meshRangeBufferSize, 0, &data);
+	memcpy(data, meshRanges.data(), static_cast<size_t>(meshRangeBufferSize));
+	vkUnmapMemory(device, meshRangeBufferMemory);
+
+	// Sized for the scene (createSceneObjects() checked it fits one storage buffer range)
+	VkDeviceSize objectBufferSize = sizeof(GpuObjectData) * sceneObjectCount;
+	VkDeviceSize drawBufferSize = sizeof(VkDrawIndexedIndirectCommand) * sceneObjectCount;
+
+	// Everything the culling shader reads or writes is shared with the async compute queue
+	for (size_t i = 0; i < framesInFlight; ++i)
+	{
+		// Animated transforms are rewritten every frame, so it stays mapped (like the uniform ring)
+		createBuffer(
+			objectBufferSize,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			objectBuffers[i],
+			objectBuffersMemory[i],
+			true
+		);
+		vkMapMemory(device, objectBuffersMemory[i], 0, objectBufferSize, 0, &objectBuffersMapped[i]);
+
+		// Static data is written once here, updateUniformBuffer() only streams the animated models
+		GpuObjectData* objects = static_cast<GpuObjectData*>(objectBuffersMapped[i]);
+		jobSystem.parallelFor(sceneObjectCount, [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t object = begin; object < end; ++object)
+			{
+				objects[object].model			= sceneObjectModel(object, 0.0f);
+				objects[object].boundingSphere	= meshBoundingSphere;
+				objects[object].meshIndex		= sceneObjects[object].meshIndex;
+			}
+		}, OBJECTS_PER_JOB);
+
+		// Draw commands are produced and consumed on the GPU only
+		// VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT : source of indirect draw parameters
+		createBuffer(
+			drawBufferSize,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			drawCommandBuffers[i],
+			drawCommandBuffersMemory[i],
+			true
+		);
+
+		// The count is cleared with vkCmdFillBuffer (transfer) before culling
+		createBuffer(
+			sizeof(uint32_t),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			drawCountBuffers[i],
+			drawCountBuffersMemory[i],
+			true
+		);
+	}
+}
+
+void HelloTriangleApp::createDescriptorAllocators()
+{
+	// Descriptor sets need to be created through descriptor pools
+	// Instead of one pool sized for exactly our sets, we use allocators
+	// that chain (growing) pools whenever the current one is full
+
+	// Define how many descriptors of each type a pool holds per set
+	// (derived from the reflected set layouts, enough for the largest set of each type)
+	std::vector<DescriptorAllocator::PoolSizeRatio> ratios = layoutCache.poolRatios();
+
+	// Possible error that even validation layer can'ts find (Vulkan 1.1)
+	// VK_ERROR_POOL_OUT_OF_MEMORY : pool is not large enough to allocate more
+	//								 BUT the driver may try to solve it under the hood
+	// (the allocators handle it by moving on to a new pool)
+	persistentDescriptorAllocator.init(device, 16, ratios);
+	descriptorCache.init(device, &persistentDescriptorAllocator);
+}
+
+bool HelloTriangleApp::hasStencilComponent(VkFormat format)
+{
+	return 
+		format == VK_FORMAT_D32_SFLOAT_S8_UINT ||
+		format == VK_FORMAT_D24_UNORM_S8_UINT;
+}
+
+VkFormat HelloTriangleApp::findSupportedFormat(
 	const std::vector<VkFormat>& candidates, 
 	VkImageTiling tiling, 
 	VkFormatFeatureFlags features
@@ -1772,7 +3079,8 @@ void HelloTriangleApp::createBuffer(
 	VkBufferUsageFlags usage, 
 	VkMemoryPropertyFlags properties, 
 	VkBuffer& buffer, 
-	VkDeviceMemory& bufferMemory
+	VkDeviceMemory& bufferMemory,
+	bool sharedWithCompute
 )
 {
 	VkBufferCreateInfo bufferInfo{};
@@ -1783,6 +3091,14 @@ void HelloTriangleApp::createBuffer(
 		VK_SHARING_MODE_EXCLUSIVE;
 		//VK_SHARING_MODE_CONCURRENT; /* so we can use transfer queue */
 
+	// Used by the graphics and the async compute queue
+	if (sharedWithCompute && !computeSharingFamilies.empty())
+	{
+		bufferInfo.sharingMode				= VK_SHARING_MODE_CONCURRENT;
+		bufferInfo.queueFamilyIndexCount	= static_cast<uint32_t>(computeSharingFamilies.size());
+		bufferInfo.pQueueFamilyIndices		= computeSharingFamilies.data();
+	}
+
 	if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
 	{
 		throw std::runtime_error("[ERROR] : Failed to create buffer!");
@@ -1874,7 +3190,7 @@ void HelloTriangleApp::createImage(
 void HelloTriangleApp::createCommandBuffer()
 {
 	// Create multiple command buffers
-	commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	commandBuffers.resize(framesInFlight);
 	// Define command buffer properties for allocation
 	VkCommandBufferAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -1893,39 +3209,168 @@ void HelloTriangleApp::createCommandBuffer()
 	if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
 		throw std::runtime_error("[ERROR] : Failed to allocate command buffers!");
 	}
+
+	// Allocate one secondary command buffer from each recording thread's pool
+	for (size_t i = 0; i < framesInFlight; ++i)
+	{
+		threadCommandBuffers[i].resize(threadCommandPools[i].size());
+		for (size_t t = 0; t < threadCommandPools[i].size(); ++t)
+		{
+			VkCommandBufferAllocateInfo secondaryInfo{};
+			secondaryInfo.sType					= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			secondaryInfo.commandPool			= threadCommandPools[i][t];
+			secondaryInfo.level					= VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			secondaryInfo.commandBufferCount	= 1;
+
+			if (vkAllocateCommandBuffers(device, &secondaryInfo, &threadCommandBuffers[i][t]) != VK_SUCCESS) {
+				throw std::runtime_error("[ERROR] : Failed to allocate secondary command buffers!");
+			}
+		}
+	}
+
+	// One culling command buffer per frame in flight, submitted to the compute queue
+	if (asyncComputeActive())
+	{
+		computeCommandBuffers.resize(framesInFlight);
+
+		VkCommandBufferAllocateInfo computeInfo{};
+		computeInfo.sType				= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		computeInfo.commandPool			= computeCommandPool;
+		computeInfo.level				= VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		computeInfo.commandBufferCount	= static_cast<uint32_t>(computeCommandBuffers.size());
+
+		if (vkAllocateCommandBuffers(device, &computeInfo, computeCommandBuffers.data()) != VK_SUCCESS) {
+			throw std::runtime_error("[ERROR] : Failed to allocate compute command buffers!");
+		}
+	}
+}
+
+void HelloTriangleApp::createCachedCommandBuffers()
+{
+	// Free the previous set (after a swap chain recreation)
+	if (!cachedCommandBuffers.empty())
+	{
+		vkFreeCommandBuffers(
+			device,
+			commandPool,
+			static_cast<uint32_t>(cachedCommandBuffers.size()),
+			cachedCommandBuffers.data()
+		);
+		cachedCommandBuffers.clear();
+	}
+
+	if (!useCachedCommandBuffers)
+	{
+		cachedCommandBufferValid.clear();
+		return;
+	}
+
+	// A cached command buffer bakes in the framebuffer (swap chain image)
+	// and the descriptor set/uniform ring region (frame in flight)
+	cachedCommandBuffers.resize(swapChainImages.size() * framesInFlight);
+
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType					= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	// commandPool allows resetting its buffers individually
+	allocInfo.commandPool			= commandPool;
+	allocInfo.level					= VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount	= static_cast<uint32_t>(cachedCommandBuffers.size());
+
+	if (vkAllocateCommandBuffers(device, &allocInfo, cachedCommandBuffers.data()) != VK_SUCCESS) {
+		throw std::runtime_error("[ERROR] : Failed to allocate cached command buffers!");
+	}
+
+	invalidateCommandBuffers();
+}
+
+void HelloTriangleApp::invalidateCommandBuffers()
+{
+	// Buffers are recorded again lazily, the next time they are used
+	cachedCommandBufferValid.assign(cachedCommandBuffers.size(), false);
+}
+
+bool HelloTriangleApp::pushConstantTransformsActive() const
+{
+	return usePushConstantTransforms && !useCachedCommandBuffers;
+}
+
+bool HelloTriangleApp::gpuDrivenActive() const
+{
+	return useGpuDrivenRendering && gpuDrivenSupported;
+}
+
+bool HelloTriangleApp::instancedRenderingActive() const
+{
+	// The GPU-driven path already draws everything with one call
+	return useInstancedRendering && !gpuDrivenActive();
+}
+
+bool HelloTriangleApp::renderGraphActive() const
+{
+	return useRenderGraph;
+}
+
+bool HelloTriangleApp::asyncComputeActive() const
+{
+	// Culling is the only compute work there is
+	return useAsyncCompute && asyncComputeSupported && gpuDrivenActive();
+}
+
+bool HelloTriangleApp::graphicsPipelineLibraryActive() const
+{
+	return useGraphicsPipelineLibrary && graphicsPipelineLibrarySupported;
+}
+
+bool HelloTriangleApp::dynamicRenderingActive() const
+{
+	return useDynamicRendering;
 }
 
 void HelloTriangleApp::createSyncObjects()
 {
-	// Create multiple semaphores/fences
-	imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+	// Create multiple semaphores
+	// Acquire and present only work with binary semaphores
+	imageAvailableSemaphores.resize(framesInFlight);
+	renderFinishedSemaphores.resize(framesInFlight);
+	cullFinishedSemaphores.resize(asyncComputeActive() ? framesInFlight : 0);
 
 	// Define properties for the creation of semaphores
 	VkSemaphoreCreateInfo semaphoreInfo{};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	// Define propreties for the creation of fences
-	// First draw frame call is also waiting for fence signal
-	// So we need to create it in singaled state
-	VkFenceCreateInfo fenceInfo{};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;	/* create fence in signaled state */
-
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+	for (size_t i = 0; i < framesInFlight; ++i)
 	{
 		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
 			vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS)
 		{
 			throw std::runtime_error("[ERROR] : Failed to create semaphores!");
 		}
+	}
 
-		if (vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS)
+	// Compute -> graphics : binary, each signal is waited on by the graphics submit of the same frame
+	for (VkSemaphore& semaphore : cullFinishedSemaphores)
+	{
+		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS)
 		{
-			throw std::runtime_error("[ERROR] : Failed to create fences!");
+			throw std::runtime_error("[ERROR] : Failed to create semaphores!");
 		}
 	}
+
+	// Timeline semaphore : 64 bit counter instead of signaled/unsignaled
+	// Starts at 0, no frame finished yet (and none has to be waited for)
+	VkSemaphoreTypeCreateInfo timelineInfo{};
+	timelineInfo.sType			= VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	timelineInfo.semaphoreType	= VK_SEMAPHORE_TYPE_TIMELINE;
+	timelineInfo.initialValue	= 0;
+
+	VkSemaphoreCreateInfo timelineSemaphoreInfo{};
+	timelineSemaphoreInfo.sType	= VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	timelineSemaphoreInfo.pNext	= &timelineInfo;
+
+	if (vkCreateSemaphore(device, &timelineSemaphoreInfo, nullptr, &frameTimeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("[ERROR] : Failed to create frame timeline semaphore!");
+	}
 }
 
 void HelloTriangleApp::recordCommandBuffer(
@@ -1953,112 +3398,97 @@ void HelloTriangleApp::recordCommandBuffer(
 		throw std::runtime_error("[ERROR] : Failed to begin recording command buffer!");
 	}
 
-	// Define begin render pass properties
-	std::array<VkClearValue, 2> clearValues{};
-	clearValues[0].color		= clearColor.color;
-	clearValues[1].depthStencil = { 1.0f , 0 };
-
-	VkRenderPassBeginInfo renderPassInfo{};
-	renderPassInfo.sType				= VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassInfo.renderPass			= renderPass;
-	renderPassInfo.framebuffer			= swapChainFramebuffers[imageIndex];
-	// Define render area offset/extent
-	// Match size of attachments for best performance
-	renderPassInfo.renderArea.offset	= { 0,0 };
-	renderPassInfo.renderArea.extent	= swapChainExtent;
-	// Define clear values to use for VK_ATTACHMENT_LOAD_OP_CLEAR
-	renderPassInfo.clearValueCount		= static_cast<uint32_t>(clearValues.size());
-	renderPassInfo.pClearValues			= clearValues.data();
-
-	// Begin render pass and also start drawing
-
-	vkCmdBeginRenderPass(
-		commandBuffer,				/* command buffer to record to */
-		&renderPassInfo,			/* details of the render pass */
-		// How the draw commands are provided
-		// Possible two values for this:
-		// VK_SUBPASS_CONTENTS_INLINE : render pass commands are embedded in the 
-		//								primary command buffer, 
-		//								no secondary command buffer will be executed
-		// VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : render pass commands will be
-		//												   executed from 
-		//												   secondary command buffers
-		VK_SUBPASS_CONTENTS_INLINE
-	);
+	// Record the draws on multiple threads if it is worth it
+	// (secondary buffers are rerecorded every frame, not used for cached buffers)
+	// (the GPU-driven and instanced paths record a handful of draws, nothing to split)
+	bool parallel =
+		useParallelRecording &&
+		!useCachedCommandBuffers &&
+		!gpuDrivenActive() &&
+		!instancedRenderingActive() &&
+		threadCommandPools[currentFrame].size() > 1 &&
+		sceneObjectCount >= threadCommandPools[currentFrame].size();
+
+	// The per-draw path records from the sorted render queue
+	bool perDraw = !gpuDrivenActive() && !instancedRenderingActive();
+	if (perDraw)
 	{
-		vkCmdBindPipeline(
-			commandBuffer,
-			VK_PIPELINE_BIND_POINT_GRAPHICS, /* define pipeline object type */
-			graphicsPipeline
-		);
-
-		// Because we defined viewport/scissors to be dynamic
-		// We have to provide them here
-
-		// Define viewport for rendering
-		// Viewport defines transformations from image to framebuffer
-		// Almost always (0,0) to (width,height)
-		VkViewport viewport{};
-		// Set offset of viewport
-		viewport.x = 0.0f;
-		viewport.y = 0.0;
-		// Set size of viewport
-		// Remember : 
-		// swapchain width/height NOT EQUAL width/height of window
-		viewport.width = static_cast<float>(swapChainExtent.width);
-		viewport.height = static_cast<float>(swapChainExtent.height);
-		// Set depth value range
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-
-		vkCmdSetViewport(
-			commandBuffer,
-			0,	/* index of first viewport to be updated */
-			1,	/* number of viewports to be updated */
-			&viewport
-		);
+		buildRenderQueue();
+	}
+	renderQueueStats = {};
 
-		// Define scissor for rendering
-		// Scissor defines which regions/pixels will actually be stored 
-		// outside pixels will be discarded (filters them out)
-		VkRect2D scissor{};
-		scissor.offset = { 0,0 };
-		scissor.extent = swapChainExtent;
+	// Secondary command buffers only need the render pass and framebuffer,
+	// so they can be recorded before the render pass begins
+	secondaryCommandBufferCount = 0;
+	if (parallel)
+	{
+		secondaryCommandBufferCount = recordSecondaryCommandBuffers(imageIndex);
+	}
 
-		vkCmdSetScissor(
-			commandBuffer,
-			0,	/* index of first scissor to be updated */
-			1,	/* number of scissors to be updated */
-			&scissor
+	// The render graph records every pass with the barriers it placed between them
+	if (renderGraphActive())
+	{
+		renderGraph.setSubpassContents(
+			mainPass,
+			parallel ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE
 		);
+		renderGraph.execute(commandBuffer, imageIndex);
+	}
+	else if (dynamicRenderingActive())
+	{
+		if (gpuDrivenActive() && !asyncComputeActive())
+		{
+			recordCulling(commandBuffer);
+		}
 
-		VkBuffer vertexBuffers[] = { vertexBuffer };
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-
-		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-
-		vkCmdBindDescriptorSets(
-			commandBuffer,
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			pipelineLayout,
-			0,	/* index of the first descriptor set */
-			1,	/* count of the descriptor sets we want to use */
-			&descriptorSets[currentFrame],	/* array of descriptor sets itself */
-			0,		/* offset for dynamic descriptors */
-			nullptr
-		);
+		recordDynamicMainPass(commandBuffer, imageIndex, parallel);
+	}
+	else
+	{
+		// GPU-driven path : cull the objects and build the draw commands first
+		// (dispatches are not allowed inside a render pass)
+		// (unless they were submitted to the async compute queue)
+		if (gpuDrivenActive() && !asyncComputeActive())
+		{
+			recordCulling(commandBuffer);
+		}
 
-		vkCmdDrawIndexed(
-			commandBuffer,
-			static_cast<uint32_t>(indices.size()),
-			1,
-			0,
-			0,
-			0
+		// Define begin render pass properties
+		std::array<VkClearValue, 2> clearValues{};
+		clearValues[0].color		= clearColor.color;
+		clearValues[1].depthStencil = { 1.0f , 0 };
+
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType				= VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass			= renderPass;
+		renderPassInfo.framebuffer			= swapChainFramebuffers[imageIndex];
+		// Define render area offset/extent
+		// Match size of attachments for best performance
+		renderPassInfo.renderArea.offset	= { 0,0 };
+		renderPassInfo.renderArea.extent	= swapChainExtent;
+		// Define clear values to use for VK_ATTACHMENT_LOAD_OP_CLEAR
+		renderPassInfo.clearValueCount		= static_cast<uint32_t>(clearValues.size());
+		renderPassInfo.pClearValues			= clearValues.data();
+
+		// Begin render pass and also start drawing
+
+		vkCmdBeginRenderPass(
+			commandBuffer,				/* command buffer to record to */
+			&renderPassInfo,			/* details of the render pass */
+			// How the draw commands are provided
+			// Possible two values for this:
+			// VK_SUBPASS_CONTENTS_INLINE : render pass commands are embedded in the 
+			//								primary command buffer, 
+			//								no secondary command buffer will be executed
+			// VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : render pass commands will be
+			//												   executed from 
+			//												   secondary command buffers
+			// Secondary command buffers are recorded on worker threads in parallel
+			parallel ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE
 		);
+		recordMainPass(commandBuffer);
+		vkCmdEndRenderPass(commandBuffer);
 	}
-	vkCmdEndRenderPass(commandBuffer);
 
 	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
 	{
@@ -2066,119 +3496,767 @@ void HelloTriangleApp::recordCommandBuffer(
 	}
 }
 
-VkCommandBuffer HelloTriangleApp::beginSingleTimeCommands()
+void HelloTriangleApp::recordDynamicMainPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool secondary)
 {
-	// Memory transfers are executed using command buffers
-	VkCommandBufferAllocateInfo allocInfo{};
-	allocInfo.sType					= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level					= VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool			= commandPool;
-									//= transferCommandPool;
-	allocInfo.commandBufferCount	= 1;
-
-	VkCommandBuffer commandBuffer;
-	vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-	VkCommandBufferBeginInfo beginInfo{};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	// Without a render pass nothing transitions the attachments for us
+	// (initialLayout/finalLayout and the subpass dependency of createRenderPass)
+	VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT |
+		(hasStencilComponent(graphicsPipelineKey.depthFormat) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+
+	auto imageBarrier = [](VkImage image, VkImageAspectFlags aspect,
+		VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess,
+		VkPipelineStageFlags2 dstStages, VkAccessFlags2 dstAccess,
+		VkImageLayout oldLayout, VkImageLayout newLayout)
+	{
+		VkImageMemoryBarrier2 barrier{};
+		barrier.sType							= VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+		barrier.srcStageMask					= srcStages;
+		barrier.srcAccessMask					= srcAccess;
+		barrier.dstStageMask					= dstStages;
+		barrier.dstAccessMask					= dstAccess;
+		barrier.oldLayout						= oldLayout;
+		barrier.newLayout						= newLayout;
+		barrier.srcQueueFamilyIndex				= VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex				= VK_QUEUE_FAMILY_IGNORED;
+		barrier.image							= image;
+		barrier.subresourceRange.aspectMask		= aspect;
+		barrier.subresourceRange.baseMipLevel	= 0;
+		barrier.subresourceRange.levelCount		= 1;
+		barrier.subresourceRange.baseArrayLayer	= 0;
+		barrier.subresourceRange.layerCount		= 1;
+		return barrier;
+	};
 
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	// Old content is never needed (both are cleared) : transition from UNDEFINED
+	// Swap chain image : the acquire semaphore is waited on at COLOR_ATTACHMENT_OUTPUT
+	// Depth : the previous frame may still be writing the shared depth image
+	std::array<VkImageMemoryBarrier2, 2> beginBarriers = {
+		imageBarrier(swapChainImages[imageIndex], VK_IMAGE_ASPECT_COLOR_BIT,
+			VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_NONE,
+			VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL),
+		imageBarrier(depthImage, depthAspect,
+			VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+	};
 
-	return commandBuffer;
+	VkDependencyInfo beginDependency{};
+	beginDependency.sType					= VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	beginDependency.imageMemoryBarrierCount	= static_cast<uint32_t>(beginBarriers.size());
+	beginDependency.pImageMemoryBarriers	= beginBarriers.data();
+	vkCmdPipelineBarrier2(commandBuffer, &beginDependency);
+
+	// Attachments are described right here instead of in a render pass + framebuffer,
+	// so a resize has nothing to rebuild
+	VkRenderingAttachmentInfo colorAttachment{};
+	colorAttachment.sType		= VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	colorAttachment.imageView	= swapChainImageViews[imageIndex];
+	colorAttachment.imageLayout	= VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachment.loadOp		= VK_ATTACHMENT_LOAD_OP_CLEAR;
+	colorAttachment.storeOp		= VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachment.clearValue	= clearColor;
+
+	VkRenderingAttachmentInfo depthAttachment{};
+	depthAttachment.sType					= VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	depthAttachment.imageView				= depthImageView;
+	depthAttachment.imageLayout				= VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.loadOp					= VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp					= VK_ATTACHMENT_STORE_OP_DONT_CARE;	/* not needed after rendering */
+	depthAttachment.clearValue.depthStencil	= { 1.0f, 0 };
+
+	VkRenderingInfo renderingInfo{};
+	renderingInfo.sType					= VK_STRUCTURE_TYPE_RENDERING_INFO;
+	// Same meaning as VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+	renderingInfo.flags					= secondary ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
+	renderingInfo.renderArea.offset		= { 0, 0 };
+	renderingInfo.renderArea.extent		= swapChainExtent;
+	renderingInfo.layerCount			= 1;
+	renderingInfo.colorAttachmentCount	= 1;
+	renderingInfo.pColorAttachments		= &colorAttachment;
+	renderingInfo.pDepthAttachment		= &depthAttachment;
+
+	vkCmdBeginRendering(commandBuffer, &renderingInfo);
+	recordMainPass(commandBuffer);
+	vkCmdEndRendering(commandBuffer);
+
+	// Hand the image to the presentation engine
+	// (the render finished semaphore makes the present wait for the writes)
+	VkImageMemoryBarrier2 presentBarrier = imageBarrier(swapChainImages[imageIndex], VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE,
+		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+	VkDependencyInfo endDependency{};
+	endDependency.sType						= VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	endDependency.imageMemoryBarrierCount	= 1;
+	endDependency.pImageMemoryBarriers		= &presentBarrier;
+	vkCmdPipelineBarrier2(commandBuffer, &endDependency);
 }
 
-void HelloTriangleApp::copyBufferToImage(
-	VkBuffer buffer, 
-	VkImage image, 
-	uint32_t width, 
-	uint32_t height
-)
+void HelloTriangleApp::recordMainPass(VkCommandBuffer commandBuffer)
 {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-	VkBufferImageCopy region{};
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;		/* Specify size of rows, could include padding */
-	region.bufferImageHeight = 0;	/* Specify size of columns, could include padding */
+	if (secondaryCommandBufferCount > 0)
+	{
+		// Execute the secondary command buffers recorded by the worker threads
+		// (in order, so the draw order stays the same as the inline path)
+		vkCmdExecuteCommands(
+			commandBuffer,
+			secondaryCommandBufferCount,
+			threadCommandBuffers[currentFrame].data()
+		);
+	}
+	else if (gpuDrivenActive())
+	{
+		recordIndirectDraws(commandBuffer);
+	}
+	else if (instancedRenderingActive())
+	{
+		recordInstancedDraws(commandBuffer);
+	}
+	else
+	{
+		renderQueueStats = recordDraws(commandBuffer, 0, renderQueue.size());
+	}
+}
 
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
+void HelloTriangleApp::recordViewportAndScissor(VkCommandBuffer commandBuffer)
+{
+	// Because we defined viewport/scissors to be dynamic
+	// We have to provide them here
+
+	// Define viewport for rendering
+	// Viewport defines transformations from image to framebuffer
+	// Almost always (0,0) to (width,height)
+	VkViewport viewport{};
+	// Set offset of viewport
+	viewport.x = 0.0f;
+	viewport.y = 0.0;
+	// Set size of viewport
+	// Remember : 
+	// swapchain width/height NOT EQUAL width/height of window
+	viewport.width = static_cast<float>(swapChainExtent.width);
+	viewport.height = static_cast<float>(swapChainExtent.height);
+	// Set depth value range
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+
+	vkCmdSetViewport(
+		commandBuffer,
+		0,	/* index of first viewport to be updated */
+		1,	/* number of viewports to be updated */
+		&viewport
+	);
 
-	region.imageOffset = { 0, 0, 0 };
-	region.imageExtent = {
-		width,
-		height,
-		1
-	};
+	// Define scissor for rendering
+	// Scissor defines which regions/pixels will actually be stored 
+	// outside pixels will be discarded (filters them out)
+	VkRect2D scissor{};
+	scissor.offset = { 0,0 };
+	scissor.extent = swapChainExtent;
 
-	vkCmdCopyBufferToImage(
+	vkCmdSetScissor(
 		commandBuffer,
-		buffer,
-		image,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, /* current layout our image uses */
-		1,
-		&region
+		0,	/* index of first scissor to be updated */
+		1,	/* number of scissors to be updated */
+		&scissor
 	);
-
-	endSingleTimeCommands(commandBuffer);
 }
 
-void HelloTriangleApp::transitionImageLayout(
-	VkImage image, 
-	VkFormat format, 
-	VkImageLayout oldLayout, 
-	VkImageLayout newLayout
-)
+void HelloTriangleApp::recordDynamicPipelineState(VkCommandBuffer commandBuffer, const GraphicsPipelineKey& key)
 {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-	
-	// One of the most common ways to perform layout transitions
-	// is using an image memory barrier (pipeline barrier)
-	// - to ensure synchronization to resources
-	// - to transition image layouts (like here)
-	// - to transfer queue family ownership when VK_SHARING_MODE_EXCLUSIVE is used
-	VkImageMemoryBarrier barrier{};
-	barrier.sType		= VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	// We define the layout transition
-	barrier.oldLayout			= oldLayout;
-	barrier.newLayout			= newLayout;
-	// We define the queue family transition
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED; /* we ignore them for now */
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED; /* we ignore them for now */
-	barrier.image				= image;
-	// Here we define our image that is affected by the transitions
-	if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+	// Dynamic state isn't part of the pipeline, so binding another pipeline keeps it
+	// (as long as that pipeline has the same states dynamic, which all of ours do)
+	if (pipelineDynamicState.rasterization)
 	{
-		barrier.subresourceRange.aspectMask		= VK_IMAGE_ASPECT_DEPTH_BIT;
-
-		if (hasStencilComponent(format))
-		{
-			barrier.subresourceRange.aspectMask != VK_IMAGE_ASPECT_STENCIL_BIT;
-		}
+		vkCmdSetCullMode(commandBuffer, key.cullMode);
+		vkCmdSetFrontFace(commandBuffer, key.frontFace);
+		vkCmdSetPrimitiveTopology(commandBuffer, key.topology);
+		vkCmdSetDepthTestEnable(commandBuffer, key.depthTest ? VK_TRUE : VK_FALSE);
+		vkCmdSetDepthWriteEnable(commandBuffer, key.depthWrite ? VK_TRUE : VK_FALSE);
+		vkCmdSetDepthCompareOp(commandBuffer, key.depthCompareOp);
+		vkCmdSetDepthBiasEnable(commandBuffer, VK_FALSE);
+		vkCmdSetPrimitiveRestartEnable(commandBuffer, VK_FALSE);
+		vkCmdSetRasterizerDiscardEnable(commandBuffer, VK_FALSE);
 	}
-	else
+
+	if (pipelineDynamicState.colorBlend)
 	{
-		barrier.subresourceRange.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+		// Same equations buildGraphicsPipeline bakes in otherwise
+		VkBool32 blendEnable = key.blendMode == BlendMode::AlphaBlend ? VK_TRUE : VK_FALSE;
+
+		VkColorBlendEquationEXT equation{};
+		equation.srcColorBlendFactor	= blendEnable ? VK_BLEND_FACTOR_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+		equation.dstColorBlendFactor	= blendEnable ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ZERO;
+		equation.colorBlendOp			= VK_BLEND_OP_ADD;
+		equation.srcAlphaBlendFactor	= VK_BLEND_FACTOR_ONE;
+		equation.dstAlphaBlendFactor	= VK_BLEND_FACTOR_ZERO;
+		equation.alphaBlendOp			= VK_BLEND_OP_ADD;
+
+		VkColorComponentFlags writeMask =
+			VK_COLOR_COMPONENT_R_BIT |
+			VK_COLOR_COMPONENT_G_BIT |
+			VK_COLOR_COMPONENT_B_BIT |
+			VK_COLOR_COMPONENT_A_BIT;
+
+		// One color attachment (index 0)
+		cmdSetColorBlendEnable(commandBuffer, 0, 1, &blendEnable);
+		cmdSetColorBlendEquation(commandBuffer, 0, 1, &equation);
+		cmdSetColorWriteMask(commandBuffer, 0, 1, &writeMask);
 	}
-	barrier.subresourceRange.baseMipLevel	= 0;
-	barrier.subresourceRange.levelCount		= 1;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount		= 1;
-	// Define where we want to read or write with our image
-	barrier.srcAccessMask	= 0; // TODO
-	barrier.dstAccessMask	= 0; // TODO
+}
 
-	// Transition barrier mask rule setup
-	VkPipelineStageFlags sourceStage, destinationStage;
+void HelloTriangleApp::buildRenderQueue()
+{
+	// Every draw of the per-draw path goes through the render queue
+	// Sorting by key groups draws sharing the same state,
+	// so the recorder can skip the binds that would not change anything
+	renderQueue.clear();
+
+	for (uint32_t i = 0; i < sceneObjectCount; ++i)
 	{
-		if (	 oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
-				 newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+		const GpuMeshRange& mesh = meshRanges[sceneObjects[i].meshIndex];
+
+		// Opaque draws go front-to-back (less overdraw thanks to the depth test)
+		glm::vec4 viewPosition = cameraView * glm::vec4(sceneObjects[i].position, 1.0f);
+		float depth = std::clamp(-viewPosition.z / cameraFar, 0.0f, 1.0f);
+		uint32_t depthBucket = static_cast<uint32_t>(depth * 0xFFFF);
+
+		RenderQueue::DrawItem item{};
+		item.sortKey = RenderQueue::makeSortKey(
+			0,							/* pass : opaque */
+			0,							/* pipeline : graphicsPipeline */
+			0,							/* material : single texture */
+			sceneObjects[i].meshIndex,
+			depthBucket
+		);
+		item.pipeline		= graphicsPipeline;
+		item.pipelineLayout	= pipelineLayout;
+		item.descriptorSet	= descriptorSets[currentFrame];
+		item.dynamicOffset	= objectUniformOffsets[i];
+		item.vertexBuffer	= vertexBuffer;
+		item.indexBuffer	= indexBuffer;
+		item.indexCount		= mesh.indexCount;
+		item.firstIndex		= mesh.firstIndex;
+		item.vertexOffset	= mesh.vertexOffset;
+		item.objectIndex	= i;
+
+		renderQueue.push(item);
+	}
+
+	renderQueue.sort();
+}
+
+RenderQueue::Stats HelloTriangleApp::recordDraws(
+	VkCommandBuffer commandBuffer,	/* primary (inline) or secondary command buffer */
+	uint32_t firstDraw,				/* first draw of the sorted render queue */
+	uint32_t drawCount				/* number of draws to record */
+)
+{
+	// Dynamic state can be set before any pipeline is bound
+	recordViewportAndScissor(commandBuffer);
+	recordDynamicPipelineState(commandBuffer, graphicsPipelineKey);
+
+	// State is not inherited by secondary command buffers,
+	// the render queue binds everything the first draw uses
+	// and afterwards only what changes between two draws
+	return renderQueue.record(commandBuffer, firstDraw, drawCount,
+		[this](VkCommandBuffer drawCommandBuffer, const RenderQueue::DrawItem& item)
 		{
-			barrier.srcAccessMask	= 0;
-			barrier.dstAccessMask	= VK_ACCESS_TRANSFER_WRITE_BIT;
+			PushConstantData pushConstants{};
+			pushConstants.model = glm::identity<glm::mat4>();
+			pushConstants.materialIndex = 0;
+
+			if (pushConstantTransformsActive())
+			{
+				pushConstants.model = frameSnapshot->objectModels[item.objectIndex];
+			}
+
+			// Push constants are recorded straight into the command buffer
+			vkCmdPushConstants(
+				drawCommandBuffer,
+				item.pipelineLayout,
+				pushConstantStages, /* must match the range */
+				0,	/* offset inside the push constant range */
+				sizeof(PushConstantData),
+				&pushConstants
+			);
+		});
+}
+
+void HelloTriangleApp::recordCulling(VkCommandBuffer commandBuffer)
+{
+	recordDrawCountClear(commandBuffer);
+
+	// The clear has to land before the shader increments the counter
+	VkBufferMemoryBarrier clearBarrier{};
+	clearBarrier.sType					= VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	clearBarrier.srcAccessMask			= VK_ACCESS_TRANSFER_WRITE_BIT;
+	clearBarrier.dstAccessMask			= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	clearBarrier.srcQueueFamilyIndex	= VK_QUEUE_FAMILY_IGNORED;
+	clearBarrier.dstQueueFamilyIndex	= VK_QUEUE_FAMILY_IGNORED;
+	clearBarrier.buffer					= drawCountBuffers[currentFrame];
+	clearBarrier.offset					= 0;
+	clearBarrier.size					= VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,			/* wait for the clear */
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,	/* before culling */
+		0,
+		0, nullptr,
+		1, &clearBarrier,
+		0, nullptr
+	);
+
+	recordCullDispatch(commandBuffer);
+
+	// Draw commands and their count are written by the compute shader
+	// and read as indirect draw parameters (DRAW_INDIRECT stage)
+	std::array<VkBufferMemoryBarrier, 2> drawBarriers{};
+	for (VkBufferMemoryBarrier& barrier : drawBarriers)
+	{
+		barrier.sType				= VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask		= VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask		= VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		barrier.srcQueueFamilyIndex	= VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex	= VK_QUEUE_FAMILY_IGNORED;
+		barrier.offset				= 0;
+		barrier.size				= VK_WHOLE_SIZE;
+	}
+	drawBarriers[0].buffer = drawCommandBuffers[currentFrame];
+	drawBarriers[1].buffer = drawCountBuffers[currentFrame];
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		0,
+		0, nullptr,
+		static_cast<uint32_t>(drawBarriers.size()), drawBarriers.data(),
+		0, nullptr
+	);
+}
+
+void HelloTriangleApp::recordDrawCountClear(VkCommandBuffer commandBuffer)
+{
+	// Reset the draw count, the culling shader appends to it
+	vkCmdFillBuffer(commandBuffer, drawCountBuffers[currentFrame], 0, sizeof(uint32_t), 0);
+}
+
+void HelloTriangleApp::recordCullDispatch(VkCommandBuffer commandBuffer)
+{
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+
+	vkCmdBindDescriptorSets(
+		commandBuffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		cullPipelineLayout,
+		0,
+		1,
+		&cullDescriptorSets[currentFrame],
+		1,
+		&cullUniformOffset	/* culling parameters inside the uniform ring */
+	);
+
+	// One invocation per object (local_size_x in cull.comp)
+	const uint32_t workgroupSize = 64;
+	vkCmdDispatch(commandBuffer, (sceneObjectCount + workgroupSize - 1) / workgroupSize, 1, 1);
+}
+
+void HelloTriangleApp::submitCulling()
+{
+	// Not pending anymore : the graphics submit of this frame waited for it,
+	// and the timeline passed that submit
+	VkCommandBuffer commandBuffer = computeCommandBuffers[currentFrame];
+	vkResetCommandBuffer(commandBuffer, 0);
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+	{
+		throw std::runtime_error("[ERROR] : Failed to begin recording compute command buffer!");
+	}
+
+	recordDrawCountClear(commandBuffer);
+
+	// The clear has to land before the shader increments the counter
+	VkBufferMemoryBarrier2 clearBarrier{};
+	clearBarrier.sType					= VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+	clearBarrier.srcStageMask			= VK_PIPELINE_STAGE_2_CLEAR_BIT;
+	clearBarrier.srcAccessMask			= VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	clearBarrier.dstStageMask			= VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	clearBarrier.dstAccessMask			= VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	clearBarrier.srcQueueFamilyIndex	= VK_QUEUE_FAMILY_IGNORED;
+	clearBarrier.dstQueueFamilyIndex	= VK_QUEUE_FAMILY_IGNORED;
+	clearBarrier.buffer					= drawCountBuffers[currentFrame];
+	clearBarrier.offset					= 0;
+	clearBarrier.size					= VK_WHOLE_SIZE;
+
+	VkDependencyInfo dependencyInfo{};
+	dependencyInfo.sType					= VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependencyInfo.bufferMemoryBarrierCount	= 1;
+	dependencyInfo.pBufferMemoryBarriers	= &clearBarrier;
+	vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+
+	recordCullDispatch(commandBuffer);
+
+	// No barrier towards the indirect draws :
+	// the semaphore signal/wait pair makes the writes visible to the graphics queue
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("[ERROR] : Failed to record compute command buffer!");
+	}
+
+	VkCommandBufferSubmitInfo commandBufferInfo{};
+	commandBufferInfo.sType			= VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+	commandBufferInfo.commandBuffer	= commandBuffer;
+
+	VkSemaphoreSubmitInfo signalInfo{};
+	signalInfo.sType		= VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+	signalInfo.semaphore	= cullFinishedSemaphores[currentFrame];
+	signalInfo.stageMask	= VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+
+	VkSubmitInfo2 submitInfo{};
+	submitInfo.sType					= VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+	submitInfo.commandBufferInfoCount	= 1;
+	submitInfo.pCommandBufferInfos		= &commandBufferInfo;
+	submitInfo.signalSemaphoreInfoCount	= 1;
+	submitInfo.pSignalSemaphoreInfos	= &signalInfo;
+
+	// Nothing to wait for : the object data and culling parameters were written by the host
+	// (visible to the queue once submitted), so the compute queue starts right away,
+	// while the graphics queue may still be rasterizing the previous frames
+	if (vkQueueSubmit2(computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	{
+		throw std::runtime_error("[ERROR] : Failed to submit culling command buffer!");
+	}
+}
+
+void HelloTriangleApp::recordIndirectDraws(VkCommandBuffer commandBuffer)
+{
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, indirectPipeline);
+
+	recordViewportAndScissor(commandBuffer);
+	recordDynamicPipelineState(commandBuffer, indirectPipelineKey);
+
+	VkBuffer vertexBuffers[] = { vertexBuffer };
+	VkDeviceSize offsets[] = { 0 };
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+
+	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+	// Set 0 : camera and texture, set 1 : object transforms
+	std::array<VkDescriptorSet, 2> sets = {
+		descriptorSets[currentFrame],
+		objectDescriptorSets[currentFrame]
+	};
+	vkCmdBindDescriptorSets(
+		commandBuffer,
+		VK_PIPELINE_BIND_POINT_GRAPHICS,
+		indirectPipelineLayout,
+		0,
+		static_cast<uint32_t>(sets.size()),
+		sets.data(),
+		1,
+		&cameraUniformOffset
+	);
+
+	// Transforms come from the object buffer, push constants stay identity
+	PushConstantData pushConstants{};
+	pushConstants.model = glm::identity<glm::mat4>();
+	pushConstants.materialIndex = 0;
+	vkCmdPushConstants(
+		commandBuffer,
+		indirectPipelineLayout,
+		pushConstantStages,
+		0,
+		sizeof(PushConstantData),
+		&pushConstants
+	);
+
+	// A single call draws every object that survived culling,
+	// the draw parameters are read from GPU memory at execution time
+	if (drawIndirectCountSupported)
+	{
+		vkCmdDrawIndexedIndirectCount(
+			commandBuffer,
+			drawCommandBuffers[currentFrame], 0,	/* draw commands */
+			drawCountBuffers[currentFrame], 0,		/* number of draws, written by the culling shader */
+			sceneObjectCount,						/* upper bound of the draw count */
+			sizeof(VkDrawIndexedIndirectCommand)	/* stride between draw commands */
+		);
+	}
+	else
+	{
+		// Every object keeps its slot, culled objects draw zero instances
+		vkCmdDrawIndexedIndirect(
+			commandBuffer,
+			drawCommandBuffers[currentFrame], 0,
+			sceneObjectCount,
+			sizeof(VkDrawIndexedIndirectCommand)
+		);
+	}
+}
+
+void HelloTriangleApp::recordInstancedDraws(VkCommandBuffer commandBuffer)
+{
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, instancedPipeline);
+
+	recordViewportAndScissor(commandBuffer);
+	recordDynamicPipelineState(commandBuffer, instancedPipelineKey);
+
+	// Binding 0 : per-vertex data, binding 1 : per-instance data
+	VkBuffer vertexBuffers[] = { vertexBuffer, instanceBuffers[currentFrame] };
+	VkDeviceSize offsets[] = { 0, 0 };
+	vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+
+	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+	// Every instance shares the camera data
+	vkCmdBindDescriptorSets(
+		commandBuffer,
+		VK_PIPELINE_BIND_POINT_GRAPHICS,
+		pipelineLayout,
+		0,
+		1,
+		&descriptorSets[currentFrame],
+		1,
+		&cameraUniformOffset
+	);
+
+	// Transforms come from the instance buffer, push constants stay identity
+	PushConstantData pushConstants{};
+	pushConstants.model = glm::identity<glm::mat4>();
+	pushConstants.materialIndex = 0;
+	vkCmdPushConstants(
+		commandBuffer,
+		pipelineLayout,
+		pushConstantStages,
+		0,
+		sizeof(PushConstantData),
+		&pushConstants
+	);
+
+	// One draw call per mesh, no matter how many objects use it
+	for (const InstanceBatch& batch : instanceBatches)
+	{
+		const GpuMeshRange& mesh = meshRanges[batch.meshIndex];
+
+		vkCmdDrawIndexed(
+			commandBuffer,
+			mesh.indexCount,
+			batch.instanceCount,	/* number of instances to draw */
+			mesh.firstIndex,
+			mesh.vertexOffset,
+			batch.firstInstance		/* first entry read from the instance binding */
+		);
+	}
+}
+
+uint32_t HelloTriangleApp::recordSecondaryCommandBuffers(uint32_t imageIndex)
+{
+	// Each chunk records from its own command pool,
+	// command pools (and their buffers) must never be used by two threads at once
+	// (a chunk is a single job, so its pool is only used by the thread running it)
+	// Resetting the whole pool is cheaper than resetting each buffer
+	for (VkCommandPool pool : threadCommandPools[currentFrame])
+	{
+		vkResetCommandPool(device, pool, 0);
+	}
+
+	// Split our draw list into (almost) equal chunks, one for each pool
+	uint32_t threadCount = static_cast<uint32_t>(threadCommandPools[currentFrame].size());
+	uint32_t drawCount = renderQueue.size();
+	uint32_t chunkSize = (drawCount + threadCount - 1) / threadCount;
+	uint32_t chunkCount = (drawCount + chunkSize - 1) / chunkSize;
+
+	auto recordChunk = [this, imageIndex, chunkSize, drawCount](uint32_t chunk)
+	{
+		VkCommandBuffer commandBuffer = threadCommandBuffers[currentFrame][chunk];
+		uint32_t firstDraw = chunk * chunkSize;
+		uint32_t chunkDraws = std::min(chunkSize, drawCount - firstDraw);
+
+		// Secondary command buffers have to know which render pass,
+		// subpass (and optionally framebuffer) they will be executed in
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType		= VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		// (the framebuffer is optional, the graph passes own theirs)
+		// (both are VK_NULL_HANDLE with dynamic rendering)
+		inheritanceInfo.renderPass	= renderGraphActive() ? renderGraph.renderPass(mainPass) : renderPass;
+		inheritanceInfo.subpass		= 0;
+		inheritanceInfo.framebuffer	= swapChainFramebuffers.empty() ? VK_NULL_HANDLE : swapChainFramebuffers[imageIndex];
+
+		// Dynamic rendering : no render pass to inherit, the attachment formats instead
+		VkCommandBufferInheritanceRenderingInfo renderingInfo{};
+		renderingInfo.sType						= VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+		renderingInfo.colorAttachmentCount		= 1;
+		renderingInfo.pColorAttachmentFormats	= &graphicsPipelineKey.colorFormat;
+		renderingInfo.depthAttachmentFormat		= graphicsPipelineKey.depthFormat;
+		renderingInfo.rasterizationSamples		= VK_SAMPLE_COUNT_1_BIT;
+		if (dynamicRenderingActive())
+		{
+			inheritanceInfo.pNext = &renderingInfo;
+		}
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags =
+			VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+			VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT; /* entirely inside a render pass */
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[ERROR] : Failed to begin recording secondary command buffer!");
+		}
+
+		RenderQueue::Stats stats = recordDraws(commandBuffer, firstDraw, chunkDraws);
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[ERROR] : Failed to record secondary command buffer!");
+		}
+
+		return stats;
+	};
+
+	// One job per chunk, this thread records chunks too while it waits
+	// (wait() rethrows the first exception thrown by a chunk)
+	std::vector<RenderQueue::Stats> chunkStats(chunkCount);
+	JobCounter recorded;
+	for (uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+	{
+		jobSystem.run([&recordChunk, &chunkStats, chunk] { chunkStats[chunk] = recordChunk(chunk); }, &recorded);
+	}
+	jobSystem.wait(recorded);
+
+	for (const RenderQueue::Stats& stats : chunkStats)
+	{
+		renderQueueStats += stats;
+	}
+
+	return chunkCount;
+}
+
+VkCommandBuffer HelloTriangleApp::beginSingleTimeCommands()
+{
+	// Memory transfers are executed using command buffers
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType					= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level					= VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool			= commandPool;
+									//= transferCommandPool;
+	allocInfo.commandBufferCount	= 1;
+
+	VkCommandBuffer commandBuffer;
+	vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	return commandBuffer;
+}
+
+void HelloTriangleApp::copyBufferToImage(
+	VkBuffer buffer, 
+	VkImage image, 
+	uint32_t width, 
+	uint32_t height
+)
+{
+	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+	VkBufferImageCopy region{};
+	region.bufferOffset = 0;
+	region.bufferRowLength = 0;		/* Specify size of rows, could include padding */
+	region.bufferImageHeight = 0;	/* Specify size of columns, could include padding */
+
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = {
+		width,
+		height,
+		1
+	};
+
+	vkCmdCopyBufferToImage(
+		commandBuffer,
+		buffer,
+		image,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, /* current layout our image uses */
+		1,
+		&region
+	);
+
+	endSingleTimeCommands(commandBuffer);
+}
+
+void HelloTriangleApp::transitionImageLayout(
+	VkImage image, 
+	VkFormat format, 
+	VkImageLayout oldLayout, 
+	VkImageLayout newLayout
+)
+{
+	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+	
+	// One of the most common ways to perform layout transitions
+	// is using an image memory barrier (pipeline barrier)
+	// - to ensure synchronization to resources
+	// - to transition image layouts (like here)
+	// - to transfer queue family ownership when VK_SHARING_MODE_EXCLUSIVE is used
+	VkImageMemoryBarrier barrier{};
+	barrier.sType		= VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	// We define the layout transition
+	barrier.oldLayout			= oldLayout;
+	barrier.newLayout			= newLayout;
+	// We define the queue family transition
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED; /* we ignore them for now */
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED; /* we ignore them for now */
+	barrier.image				= image;
+	// Here we define our image that is affected by the transitions
+	if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+	{
+		barrier.subresourceRange.aspectMask		= VK_IMAGE_ASPECT_DEPTH_BIT;
+
+		if (hasStencilComponent(format))
+		{
+			barrier.subresourceRange.aspectMask != VK_IMAGE_ASPECT_STENCIL_BIT;
+		}
+	}
+	else
+	{
+		barrier.subresourceRange.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+	}
+	barrier.subresourceRange.baseMipLevel	= 0;
+	barrier.subresourceRange.levelCount		= 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount		= 1;
+	// Define where we want to read or write with our image
+	barrier.srcAccessMask	= 0; // TODO
+	barrier.dstAccessMask	= 0; // TODO
+
+	// Transition barrier mask rule setup
+	VkPipelineStageFlags sourceStage, destinationStage;
+	{
+		if (	 oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
+				 newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+		{
+			barrier.srcAccessMask	= 0;
+			barrier.dstAccessMask	= VK_ACCESS_TRANSFER_WRITE_BIT;
 
 			// Earliest access for pre-barrier operations
 			sourceStage			= VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
@@ -2249,7 +4327,7 @@ void HelloTriangleApp::endSingleTimeCommands(
 	// 1. Use a fence and wait for it here 
 	//	  (useful if we want to transfer multiple buffer simultaneously)
 	// 2. Wait for the queue to become idle
-	vkQueueWaitIdle(
+	queueWaitIdle(
 		graphicsQueue
 		//transferQueue
 	);
@@ -2304,9 +4382,39 @@ bool HelloTriangleApp::isDeviceSuitable(VkPhysicalDevice device)
 		swapChainAdequete = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 	}
 
+	// Check for the Vulkan version we request at instance creation
+	bool apiVersionSupported = deviceProperties.apiVersion >= VK_API_VERSION_1_3;
+
+	// Features the frame loop is built on, queried through a pNext chain
+	// timelineSemaphore : frame pacing with a single counter
+	// synchronization2 : render graph barriers and queue submits
+	// dynamicRendering : main pass without render pass and framebuffer objects
+	bool frameLoopFeaturesSupported = false;
+	if (apiVersionSupported)
+	{
+		VkPhysicalDeviceVulkan13Features supported13{};
+		supported13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+		VkPhysicalDeviceVulkan12Features supported12{};
+		supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		supported12.pNext = &supported13;
+
+		VkPhysicalDeviceFeatures2 features2{};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &supported12;
+		vkGetPhysicalDeviceFeatures2(device, &features2);
+
+		frameLoopFeaturesSupported =
+			supported12.timelineSemaphore &&
+			supported13.synchronization2 &&
+			supported13.dynamicRendering;
+	}
+
 	return	indices.isComplete() && 
 			extensionSupported && 
 			swapChainAdequete &&
+			apiVersionSupported &&
+			frameLoopFeaturesSupported &&
 			deviceFeatures.samplerAnisotropy;
 }
 
@@ -2364,11 +4472,31 @@ VkPresentModeKHR HelloTriangleApp::chooseSwapPresentMode(const std::vector<VkPre
 	//									  (better than vsync)
 	// ("Vertical blank": the moment the display is refreshed)
 
-	for (const auto& availablePresentMode : availablePresentModes)
+	// Preferred modes of each policy, best first
+	// Low latency	: immediate shows the newest frame at once (tearing is acceptable),
+	//				  mailbox at least never waits for a queued frame
+	// Power saving	: FIFO caps the frame rate to the refresh rate
+	// Throughput	: mailbox renders unthrottled without tearing,
+	//				  falls back to FIFO (tearing is only accepted when low latency is asked for)
+	std::vector<VkPresentModeKHR> preferredModes;
+	switch (presentPolicy)
+	{
+	case PresentPolicy::LowLatency:
+		preferredModes = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+		break;
+	case PresentPolicy::PowerSaving:
+		preferredModes = { VK_PRESENT_MODE_FIFO_KHR };
+		break;
+	case PresentPolicy::Throughput:
+		preferredModes = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR };
+		break;
+	}
+
+	for (VkPresentModeKHR preferredMode : preferredModes)
 	{
-		if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+		if (std::find(availablePresentModes.begin(), availablePresentModes.end(), preferredMode) != availablePresentModes.end())
 		{
-			return availablePresentMode;
+			return preferredMode;
 		}
 	}
 
@@ -2393,8 +4521,13 @@ VkExtent2D HelloTriangleApp::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& ca
 	if (capabilities.currentExtent.width == std::numeric_limits<uint32_t>::max())
 	{
 		// Get GLFW frame size in PIXELS
+		// (reported by the resize callback, this may run on the render thread)
 		int width, height;
-		glfwGetFramebufferSize(window, &width, &height);
+		{
+			std::lock_guard<std::mutex> lock(windowMutex);
+			width = framebufferWidth;
+			height = framebufferHeight;
+		}
 
 		// Create struct for actual extent
 		VkExtent2D actualExtent = {
@@ -2404,7 +4537,7 @@ VkExtent2D HelloTriangleApp::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& ca
 
 		// Clamp width/height between min and max values
 		actualExtent.width = std::clamp(actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
-		actualExtent.width = std::clamp(actualExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+		actualExtent.height = std::clamp(actualExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
 
 		return actualExtent;
 	}
@@ -2457,6 +4590,17 @@ QueueFamilyIndices HelloTriangleApp::findQueueFamilies(VkPhysicalDevice device)
 		i++;
 	}
 
+	// Dedicated compute family : compute without graphics
+	for (uint32_t family = 0; family < queueFamilyCount; ++family)
+	{
+		VkQueueFlags flags = queueFamilies[family].queueFlags;
+		if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT))
+		{
+			indices.computeFamily = family;
+			break;
+		}
+	}
+
 	return indices;
 }
 
@@ -2495,51 +4639,434 @@ SwapChainSupportDetails HelloTriangleApp::querySwapChainSupport(VkPhysicalDevice
 
 void HelloTriangleApp::mainLoop()
 {
-	while (!glfwWindowShouldClose(window))
+	// Thread layout
+	// main thread			: window events only, so dragging/resizing the window
+	//						  (which blocks event processing on some platforms) stalls nothing else
+	// simulation thread	: updates the scene SIMULATION_RATE times per second
+	// render thread		: draws the latest scene snapshot, records and submits
+	// The simulation of the next step overlaps the recording and GPU work of the current one
+	running = true;
+
+	// The render thread never starts without a snapshot
+	simulationStart = std::chrono::steady_clock::now();
+	simulateScene(sceneSnapshots.writeSlot());
+	sceneSnapshots.publish();
+
+	uint32_t idleWaitsBefore = idleWaits;
+
+	simulationThread = std::thread([this] { runThread([this] { simulationLoop(); }); });
+	renderThread = std::thread([this] { runThread([this] { renderLoop(); }); });
+
+	while (running && !glfwWindowShouldClose(window))
 	{
-		// GLFW looking for events to handle
-		glfwPollEvents();
-		drawFrame();
+		if (swapChainStressFrames > 0)
+		{
+			// The script acts on the window, only possible from the main thread
+			glfwWaitEventsTimeout(0.005);
+			stepSwapChainStress();
+			continue;
+		}
+
+		// GLFW sleeps until there are events to handle
+		// (worker threads post an empty event to stop it)
+		glfwWaitEvents();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(windowMutex);
+		running = false;
 	}
+	windowResized.notify_all();
+	simulationThread.join();
+	renderThread.join();
+
+	uint32_t idleWaitsWhileRunning = idleWaits - idleWaitsBefore;
+
 	// Wait for logical device to finish all operations
+	deviceWaitIdle();
+
+	if (threadError)
+	{
+		std::rethrow_exception(threadError);
+	}
+
+	if (swapChainStressFrames > 0)
+	{
+		checkSwapChainStress(idleWaitsWhileRunning);
+	}
+}
+
+void HelloTriangleApp::stepSwapChainStress()
+{
+	// Every window change goes through the same cycle :
+	// change -> settle (the swap chain follows) -> steady frames (no recreation allowed) -> next change
+	// The startup window counts as the first change
+	auto now = std::chrono::steady_clock::now();
+	if (stressStepTime == std::chrono::steady_clock::time_point{})
+	{
+		stressStepTime = now;
+	}
+
+	// Nothing is drawn while minimized (the render thread waits for a usable size),
+	// restore the window after a while instead of counting frames
+	// (the restore restarts the settling of the change)
+	if (glfwGetWindowAttrib(window, GLFW_ICONIFIED))
+	{
+		if (now - stressStepTime >= SWAP_CHAIN_STRESS_SETTLE_TIME)
+		{
+			glfwRestoreWindow(window);
+			stressStepFrame = framesSubmitted;
+			stressStepTime = now;
+		}
+		return;
+	}
+
+	uint64_t frames = framesSubmitted;
+	if (!stressSettled)
+	{
+		// Frames and time : fast present modes draw many frames before the resize event arrives
+		if (frames < stressStepFrame + SWAP_CHAIN_STRESS_SETTLE_FRAMES ||
+			now - stressStepTime < SWAP_CHAIN_STRESS_SETTLE_TIME)
+		{
+			return;
+		}
+		stressSettled = true;
+		stressSettledFrame = frames;
+		stressSettledRecreations = swapChainRecreations;
+		return;
+	}
+
+	if (frames < stressSettledFrame + SWAP_CHAIN_STRESS_STEADY_FRAMES)
+	{
+		return;
+	}
+
+	// Steady frames : nothing changed, the swap chain must have been kept
+	stressSteadyRecreations += swapChainRecreations - stressSettledRecreations;
+
+	stressSettled = false;
+	stressStepFrame = frames;
+	stressStepTime = now;
+
+	switch (stressSteps++ % SWAP_CHAIN_STRESS_STEPS)
+	{
+	case 0:
+		glfwSetWindowSize(window, static_cast<int>(WIDTH / 2), static_cast<int>(HEIGHT / 2));
+		++stressResizes;
+		break;
+	case 1:
+		glfwSetWindowSize(window, static_cast<int>(WIDTH), static_cast<int>(HEIGHT));
+		++stressResizes;
+		break;
+	default:
+		glfwIconifyWindow(window);
+		++stressMinimizes;
+		break;
+	}
+}
+
+void HelloTriangleApp::checkSwapChainStress(uint32_t idleWaitsWhileRunning)
+{
+	// Steady frames between the last change and the end of the run
+	if (stressSettled)
+	{
+		stressSteadyRecreations += swapChainRecreations - stressSettledRecreations;
+	}
+
+	std::cout << "[SWAP CHAIN CHECK]: frames: " << frameNumber << "/" << swapChainStressFrames
+			  << "\t window changes: " << stressSteps << " (" << stressResizes << " resizes, " << stressMinimizes << " minimizes)"
+			  << "\t recreations: " << swapChainRecreations << " (" << stressSteadyRecreations << " in steady frames)"
+			  << "\t idle waits: " << idleWaitsWhileRunning << std::endl;
+
+	// The render loop stops on the last frame, fewer means it stopped early (window closed)
+	if (frameNumber != swapChainStressFrames)
+	{
+		throw std::runtime_error("[ERROR] : Swap chain check stopped after " + std::to_string(frameNumber) + " frames!");
+	}
+	// Every resize changes the framebuffer size, the swap chain must follow
+	if (stressResizes == 0 || swapChainRecreations < stressResizes)
+	{
+		throw std::runtime_error("[ERROR] : Swap chain recreated " + std::to_string(swapChainRecreations) + " times for " + std::to_string(stressResizes) + " resizes!");
+	}
+	// ... and only then : at most once per resize and minimize, never while nothing changes
+	if (swapChainRecreations > stressResizes + stressMinimizes || stressSteadyRecreations > 0)
+	{
+		throw std::runtime_error("[ERROR] : Swap chain recreated " + std::to_string(swapChainRecreations) + " times for " + std::to_string(stressResizes + stressMinimizes) + " window changes (" + std::to_string(stressSteadyRecreations) + " in steady frames)!");
+	}
+	// Recreation must not stall the frames in flight
+	if (idleWaitsWhileRunning > 0)
+	{
+		throw std::runtime_error("[ERROR] : Device idled " + std::to_string(idleWaitsWhileRunning) + " times while rendering!");
+	}
+
+	std::cout << "[SWAP CHAIN CHECK]: passed" << std::endl;
+}
+
+void HelloTriangleApp::deviceWaitIdle()
+{
+	++idleWaits;
 	vkDeviceWaitIdle(device);
 }
 
-void HelloTriangleApp::updateUniformBuffer(uint32_t currentImage)
+void HelloTriangleApp::queueWaitIdle(VkQueue queue)
+{
+	++idleWaits;
+	vkQueueWaitIdle(queue);
+}
+
+void HelloTriangleApp::runThread(const std::function<void()>& loop)
+{
+	try
+	{
+		loop();
+	}
+	catch (...)
+	{
+		{
+			std::lock_guard<std::mutex> lock(windowMutex);
+			if (!threadError)
+			{
+				threadError = std::current_exception();
+			}
+			running = false;
+		}
+		windowResized.notify_all();
+		// Wake up the main thread (glfwWaitEvents)
+		glfwPostEmptyEvent();
+	}
+}
+
+void HelloTriangleApp::simulationLoop()
 {
-	// Calculate the time between rendering frames
-	static auto startTime = std::chrono::high_resolution_clock::now();
+	// Fixed rate steps, independent from how fast frames are rendered/presented
+	const auto step = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(1.0 / SIMULATION_RATE));
+	auto nextStep = std::chrono::steady_clock::now();
 
-	auto currentTime = std::chrono::high_resolution_clock::now();
-	float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+	while (running)
+	{
+		// Never blocks : the render thread reads from another slot
+		simulateScene(sceneSnapshots.writeSlot());
+		sceneSnapshots.publish();
 
-	UniformBufferObject ubo{};
+		nextStep += step;
+		std::this_thread::sleep_until(nextStep);
+	}
+}
+
+void HelloTriangleApp::renderLoop()
+{
+	while (running)
+	{
+		// Latest complete snapshot
+		// (the previous one is drawn again if no new step was published)
+		sceneSnapshots.acquire();
+		frameSnapshot = &sceneSnapshots.readSlot();
+		// Only the first frame drawing a snapshot shows its input for the first time
+		inputTimestamp = frameSnapshot->sequence != drawnSnapshotSequence
+			? frameSnapshot->inputTime
+			: PresentLatencyTracker::Clock::time_point{};
+		drawnSnapshotSequence = frameSnapshot->sequence;
+
+		drawFrame();
+		framesSubmitted = frameNumber;
+
+		// Scripted swap chain check : stop on its last frame
+		if (swapChainStressFrames > 0 && frameNumber >= swapChainStressFrames)
+		{
+			{
+				std::lock_guard<std::mutex> lock(windowMutex);
+				running = false;
+			}
+			windowResized.notify_all();
+			// Wake up the main thread (glfwWaitEvents)
+			glfwPostEmptyEvent();
+		}
+	}
+}
+
+glm::mat4 HelloTriangleApp::sceneObjectModel(uint32_t index, float time) const
+{
+	glm::mat4 model = glm::translate(glm::identity<glm::mat4>(), sceneObjects[index].position);
+	if (!sceneObjects[index].animated)
+	{
+		return model;
+	}
 
-	ubo.model = glm::rotate(
-		glm::identity<glm::mat4>(),		/* Base matrix */
+	return glm::rotate(
+		model,							/* Base matrix */
 		time * glm::radians(90.0f),		/* Rotation in radians */
 		glm::vec3(0.0f, 0.0f, 1.0f)		/* Vector we want to rotate our camera around */
 	);
-	ubo.view = glm::lookAt(
+}
+
+void HelloTriangleApp::simulateScene(SceneSnapshot& snapshot)
+{
+	auto currentTime = std::chrono::steady_clock::now();
+	float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - simulationStart).count();
+
+	snapshot.sequence = ++simulationStep;
+	// The step reflects every input event received so far,
+	// latency is measured from the first one no earlier step reflected
+	PresentLatencyTracker::Clock::time_point inputEvent = lastInputEvent;
+	snapshot.inputTime = inputEvent > simulatedInputEvent ? inputEvent : PresentLatencyTracker::Clock::time_point{};
+	simulatedInputEvent = inputEvent;
+
+	snapshot.view = glm::lookAt(
 		glm::vec3(2.0f, 2.0f, 2.0f),	/* Camera position */
 		glm::vec3(0.0f, 0.0f, 0.0f),	/* Camera focus point */
 		glm::vec3(0.0f, 0.0f, 1.0f)		/* Camera up vector */
 	);
+
+	// Slots are reused : static models are written the first time a slot is used,
+	// after that only the animated ones change
+	if (snapshot.objectModels.size() != sceneObjectCount)
+	{
+		snapshot.objectModels.resize(sceneObjectCount);
+		jobSystem.parallelFor(sceneObjectCount, [&snapshot, this, time](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; ++i)
+			{
+				snapshot.objectModels[i] = sceneObjectModel(i, time);
+			}
+		}, OBJECTS_PER_JOB);
+		return;
+	}
+
+	// Objects are independent : update ranges of them in parallel
+	jobSystem.parallelFor(static_cast<uint32_t>(animatedObjects.size()), [&snapshot, this, time](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			uint32_t object = animatedObjects[i];
+			snapshot.objectModels[object] = sceneObjectModel(object, time);
+		}
+	}, OBJECTS_PER_JOB);
+}
+
+static const char* presentModeName(VkPresentModeKHR presentMode)
+{
+	switch (presentMode)
+	{
+	case VK_PRESENT_MODE_IMMEDIATE_KHR:		return "IMMEDIATE";
+	case VK_PRESENT_MODE_MAILBOX_KHR:		return "MAILBOX";
+	case VK_PRESENT_MODE_FIFO_KHR:			return "FIFO";
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR:	return "FIFO_RELAXED";
+	default:								return "OTHER";
+	}
+}
+
+// Extract the 6 frustum planes (xyz : normal pointing inside, w : distance)
+// from a view-projection matrix, Vulkan clip space has a depth range of 0..1
+static void extractFrustumPlanes(const glm::mat4& viewProj, glm::vec4 planes[6])
+{
+	// GLM matrices are column-major : viewProj[column][row]
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+	}
+
+	planes[0] = rows[3] + rows[0];	/* left */
+	planes[1] = rows[3] - rows[0];	/* right */
+	planes[2] = rows[3] + rows[1];	/* bottom */
+	planes[3] = rows[3] - rows[1];	/* top */
+	planes[4] = rows[2];			/* near (z >= 0) */
+	planes[5] = rows[3] - rows[2];	/* far */
+
+	// Normalize, so the sphere test can compare against the radius
+	for (int i = 0; i < 6; ++i)
+	{
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
+void HelloTriangleApp::updateUniformBuffer(uint32_t currentImage)
+{
+	// Object transforms and camera come from the snapshot of this frame,
+	// only the GPU side data is written here
+	const std::vector<glm::mat4>& objectModels = frameSnapshot->objectModels;
+
+	UniformBufferObject ubo{};
+
+	ubo.view = frameSnapshot->view;
+	cameraView = ubo.view;
 	ubo.proj = glm::perspective(
 		glm::radians(45.0f),	/* Field of view on the Y axis */
 		// Aspect of our view, important because the window size can change
 		swapChainExtent.width / (float) swapChainExtent.height,
-		0.1f,	/* Near Z value */
-		10.0f	/* Far Z value */
+		0.1f,		/* Near Z value */
+		cameraFar	/* Far Z value */
 	);
 	// Because GLM was designed for OpenGL originally
 	// We need to invert Y coordinates in clip space
 	// If don't image is rendered upside-down
 	ubo.proj[1][1] *= -1;
 
-	// This method is not the most efficient
+	// Rewind the ring region of this frame, its fence already signaled
+	uniformRing.beginFrame(currentImage);
+
 	// Most efficient is "push constants"
-	memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+	// The model matrices are pushed at draw time,
+	// so every object shares the same uniform data (camera only)
+	// The GPU-driven and instanced paths read them from buffers, same idea
+	if (pushConstantTransformsActive() || gpuDrivenActive() || instancedRenderingActive())
+	{
+		ubo.model = glm::identity<glm::mat4>();
+
+		cameraUniformOffset = uniformRing.push(&ubo, sizeof(ubo));
+		std::fill(objectUniformOffsets.begin(), objectUniformOffsets.end(), cameraUniformOffset);
+	}
+	else
+	{
+		// Otherwise write the data of every object back-to-back into the ring
+		for (uint32_t i = 0; i < sceneObjectCount; ++i)
+		{
+			ubo.model = objectModels[i];
+
+			objectUniformOffsets[i] = uniformRing.push(&ubo, sizeof(ubo));
+		}
+	}
+
+	if (instancedRenderingActive())
+	{
+		// Write the instances in batch order
+		// The buffer of this frame is not read by the GPU anymore (fence signaled)
+		InstanceData* instances = static_cast<InstanceData*>(instanceBuffersMapped[currentImage]);
+		jobSystem.parallelFor(sceneObjectCount, [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t slot = begin; slot < end; ++slot)
+			{
+				instances[slot].model	= objectModels[instanceOrder[slot]];
+				instances[slot].tint	= glm::vec4(1.0f);
+			}
+		}, OBJECTS_PER_JOB);
+	}
+
+	if (!gpuDrivenActive())
+	{
+		return;
+	}
+
+	// Object data for the culling shader and the indirect vertex shader
+	// Static objects were uploaded with the buffers, only the animated models are streamed
+	// The buffer of this frame is not read by the GPU anymore (fence signaled)
+	GpuObjectData* objects = static_cast<GpuObjectData*>(objectBuffersMapped[currentImage]);
+	jobSystem.parallelFor(static_cast<uint32_t>(animatedObjects.size()), [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			uint32_t object = animatedObjects[i];
+			objects[object].model = objectModels[object];
+		}
+	}, OBJECTS_PER_JOB);
+
+	CullUniformData cullData{};
+	extractFrustumPlanes(ubo.proj * ubo.view, cullData.frustumPlanes);
+	cullData.objectCount = sceneObjectCount;
+	cullData.compactDraws = drawIndirectCountSupported ? 1 : 0;
+
+	cullUniformOffset = uniformRing.push(&cullData, sizeof(cullData));
 }
 
 void HelloTriangleApp::drawFrame()
@@ -2593,8 +5120,34 @@ void HelloTriangleApp::drawFrame()
 	// // CPU operation, can't run until the transfer has finished
 	// save_screenshot_to_disk();
 
-	// Wait for the previous frame to render
-	vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+	// Wait until the frame that last used this frame's resources has finished
+	// Frame N signals N + 1, so frame N - framesInFlight is done once the counter
+	// reaches N - framesInFlight + 1 (nothing to wait for during the first frames)
+	if (frameNumber >= framesInFlight)
+	{
+		uint64_t waitValue = frameNumber - framesInFlight + 1;
+
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType			= VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount	= 1;
+		waitInfo.pSemaphores	= &frameTimeline;
+		waitInfo.pValues		= &waitValue;
+
+		vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+	}
+
+	// Swap chains retired by a resize and pipelines replaced by a reload
+	// can go once their last frame finished
+	uint64_t completedValue = 0;
+	vkGetSemaphoreCounterValue(device, frameTimeline, &completedValue);
+	destroyRetiredSwapChains(completedValue);
+	pipelineRegistry.destroyRetired(completedValue);
+
+	// Collect the presents that reached the screen since the last frame
+	if (latencyTracker.usesPresentWait())
+	{
+		latencyTracker.poll();
+	}
 
 	uint32_t imageIndex;
 	VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
@@ -2613,55 +5166,102 @@ void HelloTriangleApp::drawFrame()
 	// Update uniform buffers
 	updateUniformBuffer(currentFrame);
 
-	// Reset fences
-	// Only reset fence if we are submitting work
-	vkResetFences(device, 1, &inFlightFences[currentFrame]);
+	// Culling goes first, on its own queue, so it overlaps the graphics work still in flight
+	// (after acquiring : an early return must not leave a signaled semaphore nobody waits for)
+	if (asyncComputeActive())
+	{
+		submitCulling();
+	}
+
+	// Nothing to reset : unlike fences, timeline values only grow
+	// (an early return above no longer leaves an unsignaled fence behind)
 
-	// Reset command buffer to starting state
-	vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-	
-	// Record our commands in the command buffer
-	recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+	// Pipelines requested since the last frame may be ready now
+	updatePipelines();
 
-	// Submit commands onto the GPU
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	
-	// Which semaphores we have to wait for before execution
-	// Subpass dependency solution #1	: change imageAvailableSemaphore 
-	//									  to VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT
-	VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame]};
-	// Which stages of the pipeline do we have to wait for
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	// submitInfo.pWaitSemaphores = &imageAvailableSemaphore;	// Also valid
-	submitInfo.pWaitDstStageMask = waitStages;
-
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
-
-	// Which semaphores we have to signal after exection
-	VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame]};
-	// Which semaphores to signal when finished
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = signalSemaphores;
-	// submitInfo.pSignalSemaphores = &renderFinishedSemaphore;	// Also valid
+	// Pick the command buffer to submit
+	VkCommandBuffer frameCommandBuffer = commandBuffers[currentFrame];
+
+	if (useCachedCommandBuffers)
+	{
+		// Static content: only uniform data changes between frames,
+		// which is read from memory at execution time
+		// So we only record when the cached buffer was invalidated
+		size_t cacheIndex = imageIndex * framesInFlight + currentFrame;
+		frameCommandBuffer = cachedCommandBuffers[cacheIndex];
+
+		if (!cachedCommandBufferValid[cacheIndex])
+		{
+			// Not pending anymore, the timeline passed its last submission
+			vkResetCommandBuffer(frameCommandBuffer, 0);
+			recordCommandBuffer(frameCommandBuffer, imageIndex);
+			cachedCommandBufferValid[cacheIndex] = true;
+		}
+	}
+	else
+	{
+		// Reset command buffer to starting state
+		vkResetCommandBuffer(frameCommandBuffer, 0);
+
+		// Record our commands in the command buffer
+		recordCommandBuffer(frameCommandBuffer, imageIndex);
+	}
+
+	// Submit commands onto the GPU (synchronization2 submit)
+	// Wait : the image is acquired, before writing color attachments
+	// Subpass dependency solution #1	: wait at VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT
+	// Wait : the draw commands were written by the async culling, before reading them
+	std::array<VkSemaphoreSubmitInfo, 2> waitInfos{};
+	waitInfos[0].sType		= VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+	waitInfos[0].semaphore	= imageAvailableSemaphores[currentFrame];
+	waitInfos[0].stageMask	= VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+	uint32_t waitCount = 1;
+	if (asyncComputeActive())
+	{
+		waitInfos[1].sType		= VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+		waitInfos[1].semaphore	= cullFinishedSemaphores[currentFrame];
+		waitInfos[1].stageMask	= VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+		waitCount = 2;
+	}
+
+	VkCommandBufferSubmitInfo commandBufferInfo{};
+	commandBufferInfo.sType			= VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+	commandBufferInfo.commandBuffer	= frameCommandBuffer;
+
+	// Signal : the image is presentable (binary),
+	// and this frame's resources can be reused (timeline value frameNumber + 1)
+	std::array<VkSemaphoreSubmitInfo, 2> signalInfos{};
+	signalInfos[0].sType		= VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+	signalInfos[0].semaphore	= renderFinishedSemaphores[currentFrame];
+	signalInfos[0].stageMask	= VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+	signalInfos[1].sType		= VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+	signalInfos[1].semaphore	= frameTimeline;
+	signalInfos[1].value		= frameNumber + 1;
+	signalInfos[1].stageMask	= VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+	VkSubmitInfo2 submitInfo{};
+	submitInfo.sType					= VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+	submitInfo.waitSemaphoreInfoCount	= waitCount;
+	submitInfo.pWaitSemaphoreInfos		= waitInfos.data();
+	submitInfo.commandBufferInfoCount	= 1;
+	submitInfo.pCommandBufferInfos		= &commandBufferInfo;
+	submitInfo.signalSemaphoreInfoCount	= static_cast<uint32_t>(signalInfos.size());
+	submitInfo.pSignalSemaphoreInfos	= signalInfos.data();
 
 	// Submit command buffer on the graphics queue
-	// We also use inFlightFence to signal 
-	// when we can reuse the command buffer
-	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS)
+	// No fence : the timeline value tells when we can reuse the command buffer
+	if (vkQueueSubmit2(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
 	{
 		throw std::runtime_error("[ERROR] : Failed to submit draw command buffer!");
 	}
+	++frameNumber;
 
 	// Present the swap chain image to the screen
 	VkPresentInfoKHR presentInfo{};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	// Specify which semaphores to wait on before presentation
 	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = signalSemaphores;
+	presentInfo.pWaitSemaphores = &renderFinishedSemaphores[currentFrame];
 
 	// Specify which swap chain to take our image from
 	VkSwapchainKHR swapChains[] = { swapChain };
@@ -2673,52 +5273,175 @@ void HelloTriangleApp::drawFrame()
 	VkResult res;
 	presentInfo.pResults = &res;
 
+	// Tag the present so present wait can tell when it is on screen
+	uint64_t presentId = latencyTracker.nextPresentId();
+	VkPresentIdKHR presentIdInfo{};
+	presentIdInfo.sType				= VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+	presentIdInfo.swapchainCount	= 1;
+	presentIdInfo.pPresentIds		= &presentId;
+	presentInfo.pNext = latencyTracker.usesPresentWait() ? &presentIdInfo : nullptr;
+
 	result = vkQueuePresentKHR(presentQueue, &presentInfo);
+	if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)
+	{
+		latencyTracker.onPresent(presentId, swapChain, inputTimestamp);
+	}
 	
-	// Handle invalid/suboptimal swap chain
-	if (result == VK_ERROR_OUT_OF_DATE_KHR || result != VK_SUBOPTIMAL_KHR)
+	// Handle invalid/suboptimal swap chain, or a resize reported by the window
+	// (a successful present in steady state never recreates it)
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized)
 	{
 		framebufferResized = false;
 		recreateSwapChain();
 	}
 	else if (result != VK_SUCCESS)
 	{
-		throw std::runtime_error("[ERROR] : Failed to acquire swap chain image!");
+		throw std::runtime_error("[ERROR] : Failed to present swap chain image!");
 	}
 
+	reportFrameStats();
+
 	// Advance frame counter
-	currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+	currentFrame = (currentFrame + 1) % framesInFlight;
+}
+
+void HelloTriangleApp::reportRenderPath()
+{
+	std::cout << "[RENDER PATH]: " << sceneObjectCount << " objects, "
+			  << (gpuDrivenActive() ? "gpu-driven" : instancedRenderingActive() ? "instanced" : "per-object draws")
+			  << (useParallelRecording ? ", parallel recording" : "")
+			  << (useCachedCommandBuffers ? ", cached command buffers" : "")
+			  << std::endl;
+}
+
+void HelloTriangleApp::reportFrameStats()
+{
+	// Print the render queue statistics of the last recorded frame once per second
+	static auto lastReport = std::chrono::steady_clock::now();
+
+	auto now = std::chrono::steady_clock::now();
+	if (now - lastReport < std::chrono::seconds(1))
+	{
+		return;
+	}
+	lastReport = now;
+
+	if (renderQueueStats.draws > 0)
+	{
+		std::cout << "[RENDER QUEUE]: draws: " << renderQueueStats.draws
+				  << "\t state changes: " << renderQueueStats.stateChanges
+				  << "\t avoided: " << renderQueueStats.stateChangesAvoided;
+		// Parallel recording depends on the frame (cached buffers, object count)
+		if (secondaryCommandBufferCount > 0)
+		{
+			std::cout << "\t recorded on " << secondaryCommandBufferCount << " threads";
+		}
+		std::cout << std::endl;
+	}
+
+	// Latency from input event to present, and how many frames are queued
+	// GPU queue depth : submitted frames the timeline hasn't reached yet
+	PresentLatencyTracker::Stats latency = latencyTracker.takeStats();
+	uint64_t completedValue = 0;
+	vkGetSemaphoreCounterValue(device, frameTimeline, &completedValue);
+
+	std::cout << "[PRESENT]: mode: " << presentModeName(swapChainPresentMode)
+			  << "\t latency (" << (latencyTracker.usesPresentWait() ? "present wait" : "cpu") << "): ";
+	if (latency.samples > 0)
+	{
+		std::cout << latency.averageMs << " ms avg, " << latency.maxMs << " ms max (" << latency.samples << " inputs)";
+	}
+	else
+	{
+		std::cout << "no input";
+	}
+	std::cout << "\t gpu queue depth: " << (frameNumber - completedValue);
+	if (latencyTracker.usesPresentWait())
+	{
+		std::cout << "\t present queue depth: " << latency.presentQueueDepth;
+	}
+	std::cout << std::endl;
 }
 
 void HelloTriangleApp::cleanupUniformBuffers()
 {
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+	// Freeing the memory also unmaps it
+	vkDestroyBuffer(device, uniformBuffer, nullptr);
+	vkFreeMemory(device, uniformBufferMemory, nullptr);
+}
+
+void HelloTriangleApp::cleanupInstanceBuffers()
+{
+	for (size_t i = 0; i < framesInFlight; ++i)
+	{
+		vkDestroyBuffer(device, instanceBuffers[i], nullptr);
+		vkFreeMemory(device, instanceBuffersMemory[i], nullptr);
+	}
+}
+
+void HelloTriangleApp::cleanupGpuDrivenBuffers()
+{
+	if (!gpuDrivenActive())
 	{
-		vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-		vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
+		return;
+	}
+
+	vkDestroyBuffer(device, meshRangeBuffer, nullptr);
+	vkFreeMemory(device, meshRangeBufferMemory, nullptr);
+
+	for (size_t i = 0; i < framesInFlight; ++i)
+	{
+		vkDestroyBuffer(device, objectBuffers[i], nullptr);
+		vkFreeMemory(device, objectBuffersMemory[i], nullptr);
+		vkDestroyBuffer(device, drawCommandBuffers[i], nullptr);
+		vkFreeMemory(device, drawCommandBuffersMemory[i], nullptr);
+		vkDestroyBuffer(device, drawCountBuffers[i], nullptr);
+		vkFreeMemory(device, drawCountBuffersMemory[i], nullptr);
 	}
 }
 
 void HelloTriangleApp::cleanupVulkan()
 {
-	// Destroy (grahpics) pipeline
-	vkDestroyPipeline(device, graphicsPipeline, nullptr);
+	// No more reloads
+	shaderWatcher.stop();
+
+	// Destroy (grahpics) pipelines, every variant is owned by the registry
+	pipelineRegistry.cleanup();
+	// Libraries they were linked from
+	pipelineLibraries.cleanup();
 
-	// Destroy pipeline layout
-	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+	if (gpuDrivenActive())
+	{
+		// A reload still compiling
+		if (cullPipelineReload.valid())
+		{
+			jobSystem.wait(cullPipelineReloading, true);
+			try
+			{
+				vkDestroyPipeline(device, cullPipelineReload.get(), nullptr);
+			}
+			catch (...)
+			{
+			}
+		}
+		vkDestroyPipeline(device, cullPipeline, nullptr);
+	}
 
 	// Destroy render pass
 	vkDestroyRenderPass(device, renderPass, nullptr);
 
 	// Destroy synchronization objects
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT;++i)
+	for (size_t i = 0; i < framesInFlight;++i)
 	{
 		// Semaphores
 		vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
 		vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-		// Fences
-		vkDestroyFence(device, inFlightFences[i], nullptr);
 	}
+	for (VkSemaphore semaphore : cullFinishedSemaphores)
+	{
+		vkDestroySemaphore(device, semaphore, nullptr);
+	}
+	vkDestroySemaphore(device, frameTimeline, nullptr);
 
 	cleanupSwapChain();
 
@@ -2733,13 +5456,16 @@ void HelloTriangleApp::cleanupVulkan()
 	vkFreeMemory(device, textureImageMemory, nullptr);
 
 	cleanupUniformBuffers();
+	cleanupInstanceBuffers();
+	cleanupGpuDrivenBuffers();
 
 	// Destroy descriptor pools
 	// and implicitly destroy descriptor sets
-	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+	descriptorCache.cleanup();
+	persistentDescriptorAllocator.cleanup();
 
-	// Destroy descriptor set layouts
-	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+	// Destroy pipeline and descriptor set layouts (all owned by the layout cache)
+	layoutCache.cleanup();
 
 	// Destroy buffers and deallocate their memory spaces
 	vkDestroyBuffer(device, vertexBuffer, nullptr);
@@ -2750,6 +5476,21 @@ void HelloTriangleApp::cleanupVulkan()
 
 	// Destroy command pool
 	vkDestroyCommandPool(device, commandPool, nullptr);
+	for (size_t i = 0; i < framesInFlight; ++i)
+	{
+		for (VkCommandPool pool : threadCommandPools[i])
+		{
+			vkDestroyCommandPool(device, pool, nullptr);
+		}
+	}
+	if (computeCommandPool != VK_NULL_HANDLE)
+	{
+		vkDestroyCommandPool(device, computeCommandPool, nullptr);
+	}
+
+	// Keep what the driver compiled this run for the next one
+	pipelineCache.save();
+	pipelineCache.cleanup();
 
 	// Destroy logical device.
 	vkDestroyDevice(device, nullptr);
@@ -2772,6 +5513,8 @@ void HelloTriangleApp::cleanup()
 {
 	cleanupVulkan();
 
+	jobSystem.shutdown();
+
 	// Destroy created window(s)
 	glfwDestroyWindow(window);
 
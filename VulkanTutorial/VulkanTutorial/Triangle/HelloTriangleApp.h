@@ -26,13 +26,73 @@
 #include <limits>
 #include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <unordered_map>
+#include <thread>
+#include <future>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <functional>
 
 #include "ShaderCompiler.h"
+#include "MappedFile.h"
 #include "Vertex.h"
+#include "UniformRing.h"
+#include "DescriptorAllocator.h"
+#include "RenderQueue.h"
+#include "RenderGraph.h"
+#include "PresentLatencyTracker.h"
+#include "TripleBuffer.h"
+#include "JobSystem.h"
+#include "PipelineCache.h"
+#include "PipelineRegistry.h"
+#include "PipelineLibraryCache.h"
+#include "ShaderWatcher.h"
+#include "ShaderReflection.h"
+#include "PipelineLayoutCache.h"
 
 // Maximum number of frames rendered simultaneously
-const int MAX_FRAMES_IN_FLIGHT = 2;
+// (upper bound of the frames in flight chosen at startup, sizes the per-frame arrays)
+const uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+// Maximum number of objects whose uniform data fits into one frame of the uniform ring
+const uint32_t MAX_SCENE_OBJECTS = 4096;
+// Maximum number of instances in the instance buffer of one frame
+// (instanced objects only share the camera data in the uniform ring)
+const uint32_t MAX_INSTANCES = 65536;
+// Maximum number of objects of the GPU-driven path
+// (object data and draw commands live in storage buffers sized for the scene)
+const uint32_t MAX_GPU_DRIVEN_OBJECTS = 1048576;
+// One object in ANIMATED_OBJECT_STRIDE spins, the others are static
+// (static object data is uploaded once, only the animated transforms are streamed)
+const uint32_t ANIMATED_OBJECT_STRIDE = 16;
+// Maximum number of threads recording secondary command buffers
+const uint32_t MAX_RECORDING_THREADS = 8;
+// Smallest range of objects updated by one job (smaller ranges cost more to schedule than to run)
+const uint32_t OBJECTS_PER_JOB = 256;
+
+// Pipeline cache file (in the working directory, like the textures and models)
+const std::string PIPELINE_CACHE_FILE = "pipeline_cache.bin";
+
+// Scene updates per second on the simulation thread
+const uint32_t SIMULATION_RATE = 240;
+
+// Scripted swap chain check : after each window change (resize, minimize and restore)
+// the swap chain gets some frames and time to follow it, then the steady frames must not recreate it
+const uint32_t SWAP_CHAIN_STRESS_SETTLE_FRAMES = 10;
+const std::chrono::milliseconds SWAP_CHAIN_STRESS_SETTLE_TIME{ 100 };
+const uint32_t SWAP_CHAIN_STRESS_STEADY_FRAMES = 30;
+// Window changes of one round : shrink, grow back, minimize (and restore)
+const uint32_t SWAP_CHAIN_STRESS_STEPS = 3;
+
+// What the swap chain (present mode and image count) is tuned for
+enum class PresentPolicy {
+	LowLatency,		/* shortest input-to-screen time, may tear (kiosk) */
+	PowerSaving,	/* vsync, never renders frames that won't be shown */
+	Throughput		/* as many frames as possible without tearing (mailbox, vsync without it) */
+};
 
 // Struct defining supported Queue Families.
 struct QueueFamilyIndices
@@ -40,6 +100,9 @@ struct QueueFamilyIndices
 	// Graphics command support.
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
+	// Compute without graphics (optional) : usually a separate hardware queue,
+	// its work runs next to the graphics queue instead of behind it
+	std::optional<uint32_t> computeFamily;
 
 	bool isComplete()
 	{
@@ -74,17 +137,107 @@ struct UniformBufferObject {
 // How to solve alignment issues?
 // 1. #define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES (breaks down with nested structs)
 // 2. alignas() macro	(explicite by effective)
+// NOTE : Dynamic uniform buffer offsets have their own alignment rule,
+//		  every offset must be a multiple of minUniformBufferOffsetAlignment
+//		  (see UniformRing)
+
+// Per-draw data, updated through push constants (vkCmdPushConstants)
+// Push constants live inside the command buffer itself,
+// so changing them needs no descriptor updates and no memory writes
+// Vulkan only guarantees 128 bytes of push constants (maxPushConstantsSize)
+struct PushConstantData {
+	glm::mat4 model;				/* 64 bytes */
+	uint32_t materialIndex;		/* 4 bytes */
+};
+
+// Object placed in our scene
+struct SceneObject {
+	glm::vec3 position;		/* world space position */
+	uint32_t meshIndex = 0;	/* mesh to draw (index into meshRanges) */
+	bool animated = false;	/* spins, its transform changes every simulation step */
+};
+
+// Objects drawing the same mesh, drawn with a single instanced draw call
+struct InstanceBatch {
+	uint32_t meshIndex;
+	uint32_t firstInstance;	/* first entry inside the instance buffer */
+	uint32_t instanceCount;
+};
+
+// ------------------------- GPU-DRIVEN DATA -------------------------
+// Storage buffers use the std430 layout:
+// arrays of scalars/vectors are tightly packed (no rounding up to 16 bytes),
+// structs are still rounded up to the alignment of their largest member
+
+// Per-object data read by the culling compute shader and the indirect vertex shader
+struct GpuObjectData {
+	glm::mat4 model;			/* 64 bytes */
+	glm::vec4 boundingSphere;	/* model space center (xyz) and radius (w) */
+	uint32_t meshIndex;			/* index into the mesh range buffer */
+	uint32_t padding[3];		/* round up to the alignment of mat4 (96 bytes) */
+};
+
+// Where a mesh lives inside the shared vertex/index buffers
+struct GpuMeshRange {
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t padding;
+};
+
+// Per-frame culling parameters, pushed into the uniform ring (std140)
+struct CullUniformData {
+	glm::vec4 frustumPlanes[6];	/* world space, xyz : normal, w : distance */
+	uint32_t objectCount;
+	uint32_t compactDraws;		/* 1 : append visible draws and count them, 0 : one slot per object */
+};
+
+// State of the scene after one simulation step
+// Written by the simulation thread, read-only once published to the render thread
+struct SceneSnapshot {
+	uint64_t sequence = 0;								/* simulation step */
+	std::chrono::steady_clock::time_point inputTime;	/* first input event this step reflects, epoch if none */
+	glm::mat4 view;
+	std::vector<glm::mat4> objectModels;				/* model matrix of each scene object */
+};
 
 
 class HelloTriangleApp
 {
 public:
+	// Number of frames the CPU may record ahead of the GPU (1 to MAX_FRAMES_IN_FLIGHT)
+	// More frames : better throughput, fewer frames : lower latency
+	// Must be called before run()
+	void setFramesInFlight(uint32_t count);
+	// Must be called before run()
+	void setPresentPolicy(PresentPolicy policy);
+	// Number of objects drawn (1 to MAX_SCENE_OBJECTS for per-object draws,
+	// MAX_INSTANCES when instanced, MAX_GPU_DRIVEN_OBJECTS when GPU-driven)
+	// Must be called before run()
+	void setSceneObjectCount(uint32_t count);
+	// Render paths, each one falls back to the next when disabled or unsupported :
+	// GPU-driven -> instanced -> per-object draws (parallel recording when enough objects)
+	// Cached command buffers replay frames recorded once while nothing changes
+	// Must be called before run()
+	void setGpuDrivenRendering(bool enabled);
+	void setInstancedRendering(bool enabled);
+	void setParallelRecording(bool enabled);
+	void setCachedCommandBuffers(bool enabled);
+	// Scripted swap chain check : resize, minimize and restore the window while drawing
+	// frames frames, then stop. run() throws if a frame is missing, the swap chain wasn't
+	// recreated for every resize, was recreated without a window change (or during steady frames)
+	// or the device was idled while frames were in flight
+	// Must be called before run()
+	void setSwapChainStressFrames(uint32_t frames);
+
 	void run()
 	{
 		#ifdef NDEBUG
 		std::cout << "[DEBUG]: Validation layers enabled." << std::endl;
 		#endif
 		initWindow();
+		// Before initVulkan : the recording command pools are sized from the workers
+		jobSystem.init();
 		initVulkan();
 		mainLoop();
 		cleanup();
@@ -111,38 +264,172 @@ private:
 	VkQueue graphicsQueue;
 	VkQueue presentQueue; /* Presentation queue implies support for swapchains */
 	VkQueue transferQueue; /* Buffer data transfer queue */
+	VkQueue computeQueue = VK_NULL_HANDLE; /* Async compute queue (dedicated compute family) */
 
 	VkSurfaceKHR surface;
-	VkSwapchainKHR swapChain;
+	VkSwapchainKHR swapChain = VK_NULL_HANDLE;
 	std::vector<VkImage> swapChainImages; /* Cleaned up once swapchain is destroyed */
 	std::vector<VkImageView> swapChainImageViews;
 	std::vector<VkFramebuffer> swapChainFramebuffers;
 	VkFormat swapChainImageFormat;
+	PresentPolicy presentPolicy = PresentPolicy::Throughput;
+	VkPresentModeKHR swapChainPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+	// VK_KHR_present_id + VK_KHR_present_wait : measure latency up to the actual present
+	bool presentWaitSupported = false;
+	PresentLatencyTracker latencyTracker;
+	// First input event shown by the frame being built (epoch : nothing new to show)
+	PresentLatencyTracker::Clock::time_point inputTimestamp;
+	// Latest input event (main thread callbacks), consumed by the next simulation step
+	std::atomic<PresentLatencyTracker::Clock::time_point> lastInputEvent{};
+	PresentLatencyTracker::Clock::time_point simulatedInputEvent;	/* latest event a step reflected */
+	uint64_t drawnSnapshotSequence = 0;		/* snapshot of the previous frame (render thread) */
 	VkExtent2D swapChainExtent;
 	VkRenderPass renderPass;
+	// Compiled pipelines kept on disk, warm runs skip most of the shader compilation
+	PipelineCache pipelineCache;
+	// Every graphics pipeline variant, compiled in parallel on the job system
+	PipelineRegistry pipelineRegistry;
+	// Rebuild the pipelines of edited shaders while running (swapped in between frames)
+	bool useShaderHotReload = true;
+	ShaderWatcher shaderWatcher;
+	// Variant drawn by each path, the pipelines below are the ones currently in use
+	// (they only change once a requested variant finished compiling)
+	// Features of the fragment shader (specialization constants), shared by every path
+	ShaderFeatures shaderFeatures;
+	GraphicsPipelineKey graphicsPipelineKey;
+	GraphicsPipelineKey instancedPipelineKey;
+	GraphicsPipelineKey indirectPipelineKey;
+	// Keys the cached command buffers were recorded with (their dynamic state)
+	std::array<GraphicsPipelineKey, 3> recordedPipelineKeys;
+	// Depth, cull, front face, topology (and blend) state set while recording instead of baked
+	// into the pipelines : keys only differing in them share a pipeline
+	bool useExtendedDynamicState = true;
+	bool extendedDynamicState3Supported = false;	/* VK_EXT_extended_dynamic_state3 (blending) */
+	PipelineDynamicState pipelineDynamicState;
+	PFN_vkCmdSetColorBlendEnableEXT cmdSetColorBlendEnable = nullptr;
+	PFN_vkCmdSetColorBlendEquationEXT cmdSetColorBlendEquation = nullptr;
+	PFN_vkCmdSetColorWriteMaskEXT cmdSetColorWriteMask = nullptr;
+	// Link variants from separately compiled parts (VK_EXT_graphics_pipeline_library) :
+	// fast unoptimized link on first use, optimized link swapped in from the background
+	bool useGraphicsPipelineLibrary = true;
+	bool graphicsPipelineLibrarySupported = false;	/* graphicsPipelineLibrary + fast linking */
+	PipelineLibraryCache pipelineLibraries;
+	// SPIR-V hash of each shader source as of the latest fast link,
+	// optimized links reuse it and older libraries of the shader get dropped
+	std::mutex shaderCodeHashMutex;
+	std::unordered_map<std::string, uint64_t> shaderCodeHashes;
+	bool librariesOutdated = false;		/* a reload may have replaced shader libraries */
+	// Set and pipeline layouts reflected from the shaders, shared when identical
+	PipelineLayoutCache layoutCache;
 	VkPipelineLayout pipelineLayout;
+	VkShaderStageFlags pushConstantStages = 0;	/* stages of the push constant range */
 	VkPipeline graphicsPipeline;
+	// Culling and draw command generation on the GPU (compute + indirect draws)
+	bool useGpuDrivenRendering = true;
+	bool gpuDrivenSupported = false;		/* multiDrawIndirect and drawIndirectFirstInstance */
+	bool drawIndirectCountSupported = false;	/* vkCmdDrawIndexedIndirectCount (Vulkan 1.2) */
+	VkPipelineLayout cullPipelineLayout;
+	VkPipeline cullPipeline;
+	// Hot reload of cull.comp, compiled by a background job and swapped in by updatePipelines
+	std::future<VkPipeline> cullPipelineReload;
+	JobCounter cullPipelineReloading;
+	bool cullPipelineReloadPending = false;		/* edited again while compiling */
+	VkPipelineLayout indirectPipelineLayout;
+	VkPipeline indirectPipeline;
+	// Run the culling on the dedicated compute queue,
+	// overlapping the raster work of the previous frame on the graphics queue
+	bool useAsyncCompute = true;
+	bool asyncComputeSupported = false;		/* the device has a compute-only queue family */
+	// Graphics and compute families, buffers used by both queues are shared between them
+	std::vector<uint32_t> computeSharingFamilies;
+	VkCommandPool computeCommandPool = VK_NULL_HANDLE;
+	std::vector<VkCommandBuffer> computeCommandBuffers;		/* one per frame in flight */
+	// Batch objects sharing a mesh into instanced draws (when not GPU-driven)
+	bool useInstancedRendering = true;
+	// Passes, barriers and transient attachments (depth) handled by a render graph
+	bool useRenderGraph = true;
+	// Begin rendering with the attachments themselves (vkCmdBeginRendering) :
+	// no render pass and framebuffer objects to rebuild on resize,
+	// pipelines are compiled against attachment formats
+	bool useDynamicRendering = true;
+	RenderGraph renderGraph;
+	RenderGraph::PassHandle mainPass = 0;
+	// Secondary command buffers executed by the main pass this frame (0 : inline draws)
+	uint32_t secondaryCommandBufferCount = 0;
+	VkPipeline instancedPipeline;
 	VkCommandPool commandPool;	/* Manange memory of command buffers */
 	// NOTE : Cleaned up once command pool is destroyed
 	std::vector<VkCommandBuffer> commandBuffers; 
+	// Record draws into secondary command buffers on multiple threads
+	bool useParallelRecording = true;
+	// One command pool (with one secondary command buffer) per frame in flight and thread
+	std::vector<VkCommandPool> threadCommandPools[MAX_FRAMES_IN_FLIGHT];
+	std::vector<VkCommandBuffer> threadCommandBuffers[MAX_FRAMES_IN_FLIGHT];
+	// Reuse pre-recorded command buffers as long as nothing but uniform data changes
+	bool useCachedCommandBuffers = false;
+	// One cached command buffer per swap chain image and frame in flight
+	// (index : imageIndex * framesInFlight + frame)
+	std::vector<VkCommandBuffer> cachedCommandBuffers;
+	std::vector<bool> cachedCommandBufferValid;
 	VkClearValue clearColor = { 
 		{
 			{ 0.125f, 0.25f, 0.5f, 1.0f }
 		} 
 	};
 	uint32_t currentFrame = 0;
+	uint32_t framesInFlight = 2;
 
 	// ---------------------- DESCRIPTOR DATA ----------------------
 
-	VkDescriptorPool descriptorPool;
+	// Long-lived sets, deduplicated by the descriptor cache
+	DescriptorAllocator persistentDescriptorAllocator;
+	DescriptorCache descriptorCache;
 
 	VkDescriptorSetLayout descriptorSetLayout;
 	std::vector<VkDescriptorSet> descriptorSets;
+	// GPU-driven path : culling inputs/outputs and object data for the vertex shader
+	VkDescriptorSetLayout cullDescriptorSetLayout;
+	VkDescriptorSetLayout objectDescriptorSetLayout;
+	VkDescriptorSet cullDescriptorSets[MAX_FRAMES_IN_FLIGHT];
+	VkDescriptorSet objectDescriptorSets[MAX_FRAMES_IN_FLIGHT];
 
 	// ------------------------- MESH DATA -------------------------
 
 	std::vector<Vertex> vertices;
 	std::vector<uint32_t> indices;
+	// Index range of every mesh inside the vertex/index buffers
+	std::vector<GpuMeshRange> meshRanges;
+	// Model space bounding sphere of the mesh (xyz : center, w : radius)
+	glm::vec4 meshBoundingSphere;
+
+	// ------------------------ SCENE DATA -------------------------
+
+	uint32_t sceneObjectCount = 1;
+	std::vector<SceneObject> sceneObjects;
+	std::vector<uint32_t> animatedObjects;		/* indices of the animated scene objects */
+	// Scene snapshots from the simulation thread, the render thread draws the latest one
+	TripleBuffer<SceneSnapshot> sceneSnapshots;
+	// Snapshot of the frame being built (render thread, stays valid until the next frame)
+	const SceneSnapshot* frameSnapshot = nullptr;
+	std::chrono::steady_clock::time_point simulationStart;
+	uint64_t simulationStep = 0;
+	// Dynamic offset of each objects uniform data in the current frame
+	std::vector<uint32_t> objectUniformOffsets;
+	// Send model matrices through push constants instead of the uniform ring
+	bool usePushConstantTransforms = true;
+	// Instance slot -> scene object, objects are grouped by mesh
+	std::vector<uint32_t> instanceOrder;
+	std::vector<InstanceBatch> instanceBatches;
+	// Draws of the per-draw path, sorted to minimize state changes
+	RenderQueue renderQueue;
+	// Binds recorded/avoided in the last recorded frame
+	RenderQueue::Stats renderQueueStats;
+	// View matrix and far plane of the camera (depth sorting)
+	glm::mat4 cameraView = glm::identity<glm::mat4>();
+	float cameraFar = 10.0f;
+	// Dynamic offsets of the shared camera data and the culling parameters
+	uint32_t cameraUniformOffset = 0;
+	uint32_t cullUniformOffset = 0;
 
 	// -------------------------- BUFFERS --------------------------
 
@@ -150,9 +437,27 @@ private:
 	VkDeviceMemory vertexBufferMemory;
 	VkBuffer indexBuffer;
 	VkDeviceMemory indexBufferMemory;
-	std::vector<VkBuffer> uniformBuffers;
-	std::vector<VkDeviceMemory> uniformBuffersMemory;
-	std::vector<void*> uniformBuffersMapped;
+	// One persistently mapped buffer, split into a region per frame in flight
+	VkBuffer uniformBuffer;
+	VkDeviceMemory uniformBufferMemory;
+	void* uniformBufferMapped;
+	UniformRing uniformRing;
+	// Per-instance vertex data, one persistently mapped buffer per frame in flight
+	VkBuffer instanceBuffers[MAX_FRAMES_IN_FLIGHT];
+	VkDeviceMemory instanceBuffersMemory[MAX_FRAMES_IN_FLIGHT];
+	void* instanceBuffersMapped[MAX_FRAMES_IN_FLIGHT];
+	// GPU-driven path buffers
+	VkBuffer meshRangeBuffer;
+	VkDeviceMemory meshRangeBufferMemory;
+	// Written by the CPU every frame (persistently mapped)
+	VkBuffer objectBuffers[MAX_FRAMES_IN_FLIGHT];
+	VkDeviceMemory objectBuffersMemory[MAX_FRAMES_IN_FLIGHT];
+	void* objectBuffersMapped[MAX_FRAMES_IN_FLIGHT];
+	// Written by the culling shader, read by the indirect draws
+	VkBuffer drawCommandBuffers[MAX_FRAMES_IN_FLIGHT];
+	VkDeviceMemory drawCommandBuffersMemory[MAX_FRAMES_IN_FLIGHT];
+	VkBuffer drawCountBuffers[MAX_FRAMES_IN_FLIGHT];
+	VkDeviceMemory drawCountBuffersMemory[MAX_FRAMES_IN_FLIGHT];
 
 	VkImage textureImage;
 	VkImageView textureImageView;
@@ -160,9 +465,10 @@ private:
 
 	VkSampler textureSampler;
 
-	VkImage depthImage;
-	VkImageView depthImageView;
-	VkDeviceMemory depthImageMemory;
+	// Only used without the render graph (the graph owns a transient depth image)
+	VkImage depthImage = VK_NULL_HANDLE;
+	VkImageView depthImageView = VK_NULL_HANDLE;
+	VkDeviceMemory depthImageMemory = VK_NULL_HANDLE;
 
 	// ------------------ SYNCHRONIZATION OBJECTS ------------------
 	
@@ -170,22 +476,98 @@ private:
 	std::vector<VkSemaphore> imageAvailableSemaphores;
 	// rendering of image finished, presentable
 	std::vector<VkSemaphore> renderFinishedSemaphores;
-	// one frame is rendered at the time
-	std::vector<VkFence> inFlightFences;
+	// culling of the frame finished on the compute queue, its draws can be read
+	std::vector<VkSemaphore> cullFinishedSemaphores;
+	// Timeline semaphore signaled with frameNumber + 1 when a frame finished on the GPU
+	// Replaces one fence per frame in flight : a single counter tells which frames are done
+	VkSemaphore frameTimeline;
+	uint64_t frameNumber = 0;		/* frames submitted so far */
+
+	// Set by the resize callback (main thread), handled by the render thread
+	std::atomic<bool> framebufferResized{ false };
 
-	bool framebufferResized = false;
+	// ------------------------- THREADING -------------------------
+
+	// Main thread : window events, simulation thread : scene updates,
+	// render thread : recording, submission and presentation
+	std::thread simulationThread;
+	std::thread renderThread;
+	// Short parallel tasks (recording, scene and object updates) run as jobs
+	// instead of creating threads every frame
+	JobSystem jobSystem;
+	std::atomic<bool> running{ false };
+	// First exception thrown by a worker thread, rethrown on the main thread
+	std::exception_ptr threadError;
+	// Framebuffer size in pixels, GLFW may only be queried from the main thread
+	std::mutex windowMutex;
+	std::condition_variable windowResized;
+	int framebufferWidth = 0;
+	int framebufferHeight = 0;
+
+	// Swap chain objects replaced by a recreation,
+	// destroyed once the GPU finished every frame that may still use them
+	struct RetiredSwapChain {
+		uint64_t retireValue;		/* frameTimeline value of the last frame submitted with them */
+		VkSwapchainKHR swapChain;
+		std::vector<VkImageView> imageViews;
+		std::vector<VkFramebuffer> framebuffers;
+		VkImage depthImage;
+		VkImageView depthImageView;
+		VkDeviceMemory depthImageMemory;
+		RenderGraph renderGraph;
+		std::vector<VkCommandBuffer> cachedCommandBuffers;
+	};
+	std::deque<RetiredSwapChain> retiredSwapChains;
+	std::atomic<uint32_t> swapChainRecreations{ 0 };	/* read by the swap chain check (main thread) */
+
+	// Scripted swap chain check (0 : off, see setSwapChainStressFrames)
+	// Script state belongs to the main thread
+	uint32_t swapChainStressFrames = 0;
+	std::atomic<uint64_t> framesSubmitted{ 0 };		/* frameNumber, readable from the main thread */
+	uint32_t stressSteps = 0;
+	uint32_t stressResizes = 0;		/* window size changes, each needs a new swap chain */
+	uint32_t stressMinimizes = 0;	/* minimize and restore cycles, at most one new swap chain each */
+	uint64_t stressStepFrame = 0;	/* frame and time of the last window change */
+	std::chrono::steady_clock::time_point stressStepTime;
+	// Once the last change settled : recreations so far, those of the steady frames after it add up
+	bool stressSettled = false;
+	uint64_t stressSettledFrame = 0;
+	uint32_t stressSettledRecreations = 0;
+	uint32_t stressSteadyRecreations = 0;
+	// vkDeviceWaitIdle / vkQueueWaitIdle calls, none may happen while frames are in flight
+	std::atomic<uint32_t> idleWaits{ 0 };
 
 	// ----------------------- APP FUNCTIONS -----------------------
 	
 	void initWindow();
 	void mainLoop();
+	// Run a thread loop, stop every thread if it throws
+	void runThread(const std::function<void()>& loop);
+	void simulationLoop();
+	void renderLoop();
+	void simulateScene(SceneSnapshot& snapshot);
+	// Next window change of the scripted swap chain check (main thread)
+	void stepSwapChainStress();
+	// Throws if the scripted swap chain check failed
+	void checkSwapChainStress(uint32_t idleWaitsWhileRunning);
+	// Counted idle waits (see idleWaits)
+	void deviceWaitIdle();
+	void queueWaitIdle(VkQueue queue);
 	void drawFrame();
+	// Which path draws the scene, printed once to check the command line switches took effect
+	void reportRenderPath();
+	void reportFrameStats();
 	void cleanup();
 	
 	// ---------------------- EVENT FUNCTIONS ----------------------
 	
 	// Callback to handle resize event
 	static void framebufferResizeCallback(GLFWwindow* window, int width, int height);
+	// Input callbacks, only timestamp the event (input to present latency)
+	static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+	static void cursorPositionCallback(GLFWwindow* window, double x, double y);
+	static void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
+	void recordInputEvent();
 	
 	// --------------------- VULKAN FUNCTIONS ----------------------
 	
@@ -201,21 +583,33 @@ private:
 		createRenderPass();
 		createDescriptorSetLayout();
 		createGraphicsPipeline();
+		createCullPipeline();
 		createCommandPool();
 		createDepthResources();
 		createFramebuffers();
+		buildRenderGraph();
+		// Debug check of the memory aliasing, the main graph never exercises it
+		if (enableValidationLayers)
+		{
+			RenderGraph::checkAliasing(device, physicalDevice);
+		}
 		createTextureImage();
 		createTextureImageView();
 		createTextureSampler();
 		loadModel();
+		createSceneObjects();
 		createVertexBuffer();
 		createIndexBuffer();
 		createUniformBuffers();
-		createDescriptorPool();
+		createInstanceBuffers();
+		createGpuDrivenBuffers();
+		createDescriptorAllocators();
 		createDescriptorSets();
 		// oldCreateVertexBuffer();
 		createCommandBuffer();
+		createCachedCommandBuffers();
 		createSyncObjects();
+		reportRenderPath();
 	}
 	void createInstance();
 	void pickPhysicalDevice();
@@ -225,40 +619,98 @@ private:
 	// Cleanup swap chain and all associated objects (framebuffers, imageviews)
 	void cleanupUniformBuffers();
 	void cleanupSwapChain();
+	// Hand the current swap chain objects over to retiredSwapChains (still usable as oldSwapchain)
+	void retireSwapChain();
+	// Destroy retired swap chains whose frames reached completedValue on the timeline
+	void destroyRetiredSwapChains(uint64_t completedValue);
 	void createImageViews();
 	void createDescriptorSetLayout();
+	// Reflected interface of the stages of one pipeline (uniform buffers made dynamic)
+	ShaderReflection reflectShaders(const std::vector<std::string>& sourceFiles);
 	void createDescriptorSets();
 	void createGraphicsPipeline();
+	// Compiles one variant, runs on job system workers
+	VkPipeline buildGraphicsPipeline(const GraphicsPipelineKey& key, VkPipelineCache cache,
+		VkGraphicsPipelineLibraryFlagsEXT libraryParts = 0, const std::vector<uint32_t>* libraryCode = nullptr);
+	// Variant linked from pipeline libraries (compiling the missing ones)
+	VkPipeline linkGraphicsPipeline(const GraphicsPipelineKey& key, VkPipelineCache cache, bool optimize);
+	// Reload edited shaders, switch to requested variants that finished compiling
+	void updatePipelines();
+	void createCullPipeline();
+	// Compile cull.comp into a pipeline using cullPipelineLayout (throws on errors)
+	VkPipeline buildCullPipeline(VkPipelineCache cache);
+	// Rebuild the culling pipeline in the background (once the running rebuild finished)
+	void reloadCullPipeline();
 	void createRenderPass();
 	void createFramebuffers();
 	void createDepthResources();
+	// Declare the passes of a frame and compile them (recreated with the swap chain)
+	void buildRenderGraph();
 	void createCommandPool();
 	void oldCreateVertexBuffer();
 	void loadModel();
+	void createSceneObjects();
+	// Group scene objects by mesh into instance batches
+	void buildInstanceBatches();
 	void createVertexBuffer();
 	void createTextureImage();
 	void createTextureImageView();
 	void createTextureSampler();
 	void createIndexBuffer();
 	void createUniformBuffers();
-	void createDescriptorPool();
+	void createInstanceBuffers();
+	void cleanupInstanceBuffers();
+	void createGpuDrivenBuffers();
+	void cleanupGpuDrivenBuffers();
+	void createDescriptorAllocators();
 	void createCommandBuffer();
+	void createCachedCommandBuffers();
+	// Force cached command buffers to be recorded again (scene change, resize, pipeline reload)
+	void invalidateCommandBuffers();
+	// Push constants are baked into cached command buffers, so they can't carry changing data
+	bool pushConstantTransformsActive() const;
+	bool gpuDrivenActive() const;
+	bool instancedRenderingActive() const;
+	bool renderGraphActive() const;
+	bool asyncComputeActive() const;
+	bool dynamicRenderingActive() const;
+	bool graphicsPipelineLibraryActive() const;
 	void createSyncObjects();
 	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	void recordViewportAndScissor(VkCommandBuffer commandBuffer);
+	// State of the key the pipeline left dynamic (extended dynamic state)
+	void recordDynamicPipelineState(VkCommandBuffer commandBuffer, const GraphicsPipelineKey& key);
+	void buildRenderQueue();
+	RenderQueue::Stats recordDraws(VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t drawCount);
+	// Everything recorded inside the main render pass
+	void recordMainPass(VkCommandBuffer commandBuffer);
+	// Main pass without render graph and render pass : transitions + vkCmdBeginRendering
+	void recordDynamicMainPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool secondary);
+	// Clear + dispatch with hand written barriers (the render graph records the pieces itself)
+	void recordCulling(VkCommandBuffer commandBuffer);
+	void recordDrawCountClear(VkCommandBuffer commandBuffer);
+	void recordCullDispatch(VkCommandBuffer commandBuffer);
+	// Record and submit the culling of this frame on the async compute queue
+	void submitCulling();
+	void recordIndirectDraws(VkCommandBuffer commandBuffer);
+	void recordInstancedDraws(VkCommandBuffer commandBuffer);
+	uint32_t recordSecondaryCommandBuffers(uint32_t imageIndex);
 	VkCommandBuffer beginSingleTimeCommands();
 	void endSingleTimeCommands(VkCommandBuffer commandBuffer);
 	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
 	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
 	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
-	VkShaderModule createShaderModule(const std::vector<char>& code);
+	VkShaderModule createShaderModule(const std::vector<uint32_t>& code);
 	QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
 	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 	bool hasStencilComponent(VkFormat format);
 	VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 	VkFormat findDepthFormat();
-	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+	// sharedWithCompute : also used on the async compute queue
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory, bool sharedWithCompute = false);
 	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
 	void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
+	glm::mat4 sceneObjectModel(uint32_t index, float time) const;
 	void updateUniformBuffer(uint32_t currentImage);
 	SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 	bool checkDeviceExtensionSupport(VkPhysicalDevice device);
@@ -0,0 +1,474 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+// windows.h would otherwise define min/max macros, breaking std::min/std::max
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+	// Index of the worker running on this thread, -1 for every other thread
+	thread_local int32_t currentWorker = -1;
+}
+
+bool JobCounter::done() const
+{
+	return pending.load(std::memory_order_acquire) == 0;
+}
+
+// ------------------------- WORK STEALING DEQUE --------------------------
+
+JobSystem::WorkStealingDeque::WorkStealingDeque()
+{
+	for (std::atomic<Job*>& slot : buffer)
+	{
+		slot.store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+bool JobSystem::WorkStealingDeque::push(Job* job)
+{
+	int64_t b = bottom.load(std::memory_order_relaxed);
+	int64_t t = top.load(std::memory_order_acquire);
+	if (b - t >= CAPACITY)
+	{
+		return false;
+	}
+
+	buffer[b & MASK].store(job, std::memory_order_relaxed);
+	// The job has to be visible before thieves see the new bottom
+	std::atomic_thread_fence(std::memory_order_release);
+	bottom.store(b + 1, std::memory_order_relaxed);
+	return true;
+}
+
+JobSystem::Job* JobSystem::WorkStealingDeque::pop()
+{
+	int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t t = top.load(std::memory_order_relaxed);
+
+	if (t > b)
+	{
+		// Empty
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = buffer[b & MASK].load(std::memory_order_relaxed);
+	if (t == b)
+	{
+		// Last job : race against thieves for it
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			job = nullptr;
+		}
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+JobSystem::Job* JobSystem::WorkStealingDeque::steal()
+{
+	int64_t t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t b = bottom.load(std::memory_order_acquire);
+
+	if (t >= b)
+	{
+		return nullptr;
+	}
+
+	Job* job = buffer[t & MASK].load(std::memory_order_relaxed);
+	// Another thief (or the owner) took it first
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+	{
+		return nullptr;
+	}
+	return job;
+}
+
+// ------------------------------ JOB SYSTEM ------------------------------
+
+void JobSystem::init(uint32_t threadCount, bool pinThreads)
+{
+	if (threadCount == 0)
+	{
+		uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+		threadCount = std::max(1u, cores - 1);
+	}
+
+	running = true;
+	// Keep one worker for frame jobs while pipelines compile
+	backgroundLimit = std::max(1u, threadCount - 1);
+
+	deques.resize(threadCount);
+	for (auto& deque : deques)
+	{
+		deque = std::make_unique<WorkStealingDeque>();
+	}
+
+	for (uint32_t i = 0; i < threadCount; ++i)
+	{
+		workers.emplace_back(&JobSystem::workerLoop, this, i, pinThreads);
+	}
+}
+
+void JobSystem::shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		running = false;
+	}
+	wakeCondition.notify_all();
+
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+	workers.clear();
+
+	// Jobs nobody ran anymore
+	for (auto& deque : deques)
+	{
+		while (Job* job = deque->steal())
+		{
+			delete job;
+		}
+	}
+	deques.clear();
+
+	for (Job* job : sharedQueue)
+	{
+		delete job;
+	}
+	sharedQueue.clear();
+
+	for (Job* job : backgroundQueue)
+	{
+		delete job;
+	}
+	backgroundQueue.clear();
+	queuedBackgroundJobs = 0;
+}
+
+JobSystem::~JobSystem()
+{
+	shutdown();
+}
+
+uint32_t JobSystem::workerCount() const
+{
+	return static_cast<uint32_t>(workers.size());
+}
+
+void JobSystem::pinCurrentThread(uint32_t core)
+{
+	uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+	core %= cores;
+
+#ifdef _WIN32
+	SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core);
+#elif defined(__linux__)
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	CPU_SET(core, &cpuSet);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+#else
+	(void)core;		/* not supported, the OS schedules the thread freely */
+#endif
+}
+
+void JobSystem::workerLoop(uint32_t workerIndex, bool pinThread)
+{
+	currentWorker = static_cast<int32_t>(workerIndex);
+	if (pinThread)
+	{
+		pinCurrentThread(workerIndex + 1);
+	}
+
+	while (running)
+	{
+		if (Job* job = findJob(true))
+		{
+			execute(job);
+			continue;
+		}
+
+		// Nothing to do : sleep until a job is queued
+		// (queuedJobs is checked under the lock, after announcing that we sleep,
+		// so a job queued in between is never missed)
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		++sleepingWorkers;
+		wakeCondition.wait(lock, [this] {
+			return queuedJobs.load() > 0 || backgroundAvailable() || !running;
+		});
+		--sleepingWorkers;
+	}
+}
+
+bool JobSystem::backgroundAvailable() const
+{
+	return queuedBackgroundJobs.load() > 0 && runningBackgroundJobs.load() < backgroundLimit;
+}
+
+JobSystem::Job* JobSystem::findBackgroundJob()
+{
+	// Workers reserve a slot first, threads helping in wait() don't count against the limit
+	bool reserved = currentWorker >= 0;
+	if (reserved && runningBackgroundJobs.fetch_add(1) >= backgroundLimit)
+	{
+		--runningBackgroundJobs;
+		return nullptr;
+	}
+
+	Job* job = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(sharedMutex);
+		if (!backgroundQueue.empty())
+		{
+			job = backgroundQueue.front();
+			backgroundQueue.pop_front();
+		}
+	}
+
+	if (!job)
+	{
+		if (reserved)
+		{
+			--runningBackgroundJobs;
+		}
+		return nullptr;
+	}
+
+	--queuedBackgroundJobs;
+	if (!reserved)
+	{
+		++runningBackgroundJobs;
+	}
+	return job;
+}
+
+JobSystem::Job* JobSystem::findJob(bool takeBackground)
+{
+	Job* job = nullptr;
+
+	if (currentWorker >= 0)
+	{
+		job = deques[currentWorker]->pop();
+	}
+
+	if (!job)
+	{
+		std::lock_guard<std::mutex> lock(sharedMutex);
+		if (!sharedQueue.empty())
+		{
+			job = sharedQueue.front();
+			sharedQueue.pop_front();
+		}
+	}
+
+	// Steal, starting after our own deque so thieves spread over the victims
+	uint32_t victimCount = static_cast<uint32_t>(deques.size());
+	uint32_t start = currentWorker >= 0 ? static_cast<uint32_t>(currentWorker) + 1 : 0;
+	for (uint32_t i = 0; !job && i < victimCount; ++i)
+	{
+		uint32_t victim = (start + i) % victimCount;
+		if (static_cast<int32_t>(victim) != currentWorker)
+		{
+			job = deques[victim]->steal();
+		}
+	}
+
+	if (job)
+	{
+		--queuedJobs;
+		return job;
+	}
+
+	// Only once nothing else is queued
+	return takeBackground ? findBackgroundJob() : nullptr;
+}
+
+void JobSystem::execute(Job* job)
+{
+	JobCounter* counter = job->counter;
+	bool background = job->background;
+
+	try
+	{
+		job->function();
+	}
+	catch (...)
+	{
+		if (!counter)
+		{
+			throw;
+		}
+
+		std::lock_guard<std::mutex> lock(counter->errorMutex);
+		if (!counter->error)
+		{
+			counter->error = std::current_exception();
+		}
+	}
+	delete job;
+
+	// A background slot is free again
+	if (background)
+	{
+		--runningBackgroundJobs;
+		if (queuedBackgroundJobs.load() > 0)
+		{
+			wakeWorker();
+		}
+	}
+
+	// Last access to the counter : the waiting thread may destroy it right after
+	if (counter)
+	{
+		counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+	}
+}
+
+void JobSystem::wakeWorker()
+{
+	if (sleepingWorkers.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wakeCondition.notify_one();
+	}
+}
+
+void JobSystem::run(JobFunction function, JobCounter* counter)
+{
+	if (counter)
+	{
+		counter->pending.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	Job* job = new Job{ std::move(function), counter, false };
+
+	// Without workers (or with a full deque) the job runs right away
+	if (workers.empty() ||
+		(currentWorker >= 0 && !deques[currentWorker]->push(job)))
+	{
+		execute(job);
+		return;
+	}
+
+	if (currentWorker < 0)
+	{
+		std::lock_guard<std::mutex> lock(sharedMutex);
+		sharedQueue.push_back(job);
+	}
+
+	++queuedJobs;
+	wakeWorker();
+}
+
+void JobSystem::runBackground(JobFunction function, JobCounter* counter)
+{
+	if (counter)
+	{
+		counter->pending.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	Job* job = new Job{ std::move(function), counter, true };
+
+	// Without workers nobody else would ever run it
+	if (workers.empty())
+	{
+		++runningBackgroundJobs;
+		execute(job);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(sharedMutex);
+		backgroundQueue.push_back(job);
+	}
+
+	++queuedBackgroundJobs;
+	wakeWorker();
+}
+
+void JobSystem::wait(JobCounter& counter, bool helpBackground)
+{
+	// Help while waiting : run any job (not only the ones of counter),
+	// a waiting thread never sits idle while there is work
+	// Background jobs are left to the workers unless counter waits on them :
+	// a frame waiting on its recording jobs must not run a pipeline compile inline
+	while (!counter.done())
+	{
+		if (Job* job = findJob(helpBackground))
+		{
+			execute(job);
+		}
+		else
+		{
+			// Remaining jobs of counter are running on other threads
+			std::this_thread::yield();
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(counter.errorMutex);
+	if (counter.error)
+	{
+		std::exception_ptr error = counter.error;
+		counter.error = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+void JobSystem::parallelFor(uint32_t count, const RangeFunction& body, uint32_t minGrain)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	// About four jobs per thread (workers + caller) : enough to balance uneven ranges,
+	// few enough to keep the per-job overhead low
+	uint32_t threads = workerCount() + 1;
+	uint32_t grain = std::max(std::max(minGrain, 1u), (count + threads * 4 - 1) / (threads * 4));
+
+	if (count <= grain || workers.empty())
+	{
+		body(0, count);
+		return;
+	}
+
+	JobCounter counter;
+	for (uint32_t begin = grain; begin < count; begin += grain)
+	{
+		uint32_t end = std::min(count, begin + grain);
+		run([&body, begin, end] { body(begin, end); }, &counter);
+	}
+
+	// The caller takes the first range itself, then helps with the rest
+	// (the queued jobs reference body and counter, so wait even if the first range throws)
+	std::exception_ptr error;
+	try
+	{
+		body(0, std::min(count, grain));
+	}
+	catch (...)
+	{
+		error = std::current_exception();
+	}
+	wait(counter);
+
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+}
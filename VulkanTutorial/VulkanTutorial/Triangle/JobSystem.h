@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// Number of jobs still running for a group of jobs.
+/// Incremented when a job is submitted with it, decremented when the job finished.
+/// Waiting on it expresses a dependency on every job of the group.
+/// </summary>
+class JobCounter
+{
+private:
+	std::atomic<uint32_t> pending{ 0 };
+	// First exception thrown by one of the jobs, rethrown by JobSystem::wait()
+	std::mutex errorMutex;
+	std::exception_ptr error;
+	friend class JobSystem;
+
+public:
+	bool done() const;
+};
+
+/// <summary>
+/// Work-stealing job scheduler without fibers.
+/// Every worker owns a Chase-Lev deque: it pushes/pops its own jobs at the bottom (LIFO, cache friendly)
+/// while idle workers steal from the top (FIFO, oldest and usually biggest jobs).
+/// Threads that are not workers (main, render, simulation) submit through a shared queue.
+/// wait() never blocks while there is work : the waiting thread runs jobs itself.
+/// Long jobs that nothing waits on every frame (pipeline compiles) go to a background queue :
+/// workers only take them when nothing else is queued, at most workerCount() - 1 at once,
+/// and wait() doesn't run them, so a frame waiting on its own jobs never runs a compile inline.
+/// </summary>
+class JobSystem
+{
+public:
+	using JobFunction = std::function<void()>;
+	// Processes the elements [begin, end)
+	using RangeFunction = std::function<void(uint32_t begin, uint32_t end)>;
+
+private:
+	struct Job {
+		JobFunction function;
+		JobCounter* counter;
+		bool background;
+	};
+
+	/// <summary>
+	/// Fixed capacity Chase-Lev deque (Le, Pop, Cohen, Zappa Nardelli, "Correct and
+	/// Efficient Work-Stealing for Weak Memory Models").
+	/// push/pop : owner thread only, steal : any thread.
+	/// </summary>
+	class WorkStealingDeque
+	{
+	private:
+		static constexpr int64_t CAPACITY = 4096;	/* power of two */
+		static constexpr int64_t MASK = CAPACITY - 1;
+
+		std::atomic<int64_t> top{ 0 };
+		std::atomic<int64_t> bottom{ 0 };
+		std::atomic<Job*> buffer[CAPACITY];
+
+	public:
+		WorkStealingDeque();
+		// False when full (the caller runs the job itself)
+		bool push(Job* job);
+		Job* pop();
+		Job* steal();
+	};
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<WorkStealingDeque>> deques;		/* one per worker */
+
+	// Jobs submitted by threads that aren't workers, and background jobs of every thread
+	std::mutex sharedMutex;
+	std::deque<Job*> sharedQueue;
+	std::deque<Job*> backgroundQueue;
+	std::atomic<int64_t> queuedBackgroundJobs{ 0 };
+	std::atomic<uint32_t> runningBackgroundJobs{ 0 };
+	uint32_t backgroundLimit = 1;	/* background jobs running on workers at once */
+
+	// Idle workers sleep until jobs are queued
+	std::mutex sleepMutex;
+	std::condition_variable wakeCondition;
+	std::atomic<uint32_t> sleepingWorkers{ 0 };
+	std::atomic<int64_t> queuedJobs{ 0 };
+	std::atomic<bool> running{ false };
+
+	void workerLoop(uint32_t workerIndex, bool pinThread);
+	// Own deque first, then the shared queue, then steal from the other workers,
+	// then (takeBackground) the background queue
+	Job* findJob(bool takeBackground);
+	Job* findBackgroundJob();
+	// A worker may start a background job (nothing else queued, limit not reached)
+	bool backgroundAvailable() const;
+	void execute(Job* job);
+	void wakeWorker();
+	static void pinCurrentThread(uint32_t core);
+
+public:
+	// threadCount : worker threads (0 : one per core, minus the calling thread)
+	// pinThreads : bind worker i to core i + 1 (core 0 is left to the calling thread)
+	void init(uint32_t threadCount = 0, bool pinThreads = false);
+	// Joins the workers, jobs that didn't start are dropped
+	void shutdown();
+	// Also shuts down (std::thread must not be destroyed while joinable)
+	~JobSystem();
+
+	uint32_t workerCount() const;
+
+	// Queue a job, counter (optional) is incremented now and decremented once it finished
+	// Jobs without a counter must not throw (nobody could catch it)
+	void run(JobFunction function, JobCounter* counter = nullptr);
+	// Same, low priority : only idle workers run it, wait() doesn't (unless helpBackground)
+	void runBackground(JobFunction function, JobCounter* counter = nullptr);
+	// Help running jobs until every job of counter finished,
+	// then rethrow the first exception one of them threw
+	// helpBackground : also run background jobs (counter waits on background work)
+	void wait(JobCounter& counter, bool helpBackground = false);
+
+	// Split [0, count) into ranges processed in parallel and wait for them
+	// The grain (elements per job) is picked from count and the number of workers,
+	// small counts run directly on the calling thread
+	void parallelFor(uint32_t count, const RangeFunction& body, uint32_t minGrain = 1);
+};
@@ -0,0 +1,158 @@
+#include "MappedFile.h"
+
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path)
+{
+	if (!open(path))
+	{
+		throw std::runtime_error("[ERROR] : Failed to open file " + path + "!");
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		close();
+		std::swap(view, other.view);
+		std::swap(length, other.length);
+#ifdef _WIN32
+		std::swap(mapping, other.mapping);
+#endif
+	}
+	return *this;
+}
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+
+#ifdef _WIN32
+	// Others may still read, replace or delete the file (the shader cache renames over entries),
+	// the sequential scan hint enables aggressive read-ahead
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize{};
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	// Empty files can't be mapped, an empty view is still a valid result
+	if (fileSize.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return true;
+	}
+
+	// The mapping keeps the file open, its handle isn't needed anymore
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (mapping == nullptr)
+	{
+		return false;
+	}
+
+	view = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (view == nullptr)
+	{
+		CloseHandle(mapping);
+		mapping = nullptr;
+		return false;
+	}
+	length = static_cast<size_t>(fileSize.QuadPart);
+
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0602
+	// Start reading the whole view in the background (Windows 8+)
+	WIN32_MEMORY_RANGE_ENTRY range{ const_cast<char*>(view), length };
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+#else
+	int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (file < 0)
+	{
+		return false;
+	}
+
+	struct stat status{};
+	if (fstat(file, &status) != 0)
+	{
+		::close(file);
+		return false;
+	}
+
+	// Empty files can't be mapped, an empty view is still a valid result
+	if (status.st_size == 0)
+	{
+		::close(file);
+		return true;
+	}
+
+	// The mapping keeps the file referenced, the descriptor isn't needed anymore
+	void* address = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if (address == MAP_FAILED)
+	{
+		return false;
+	}
+
+	view = static_cast<const char*>(address);
+	length = static_cast<size_t>(status.st_size);
+
+	// Loaders read front to back once : larger read-ahead, pages freed early,
+	// and start reading the whole file now instead of faulting page by page
+	madvise(address, length, MADV_SEQUENTIAL);
+	madvise(address, length, MADV_WILLNEED);
+#endif
+
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (view != nullptr)
+	{
+		UnmapViewOfFile(view);
+	}
+	if (mapping != nullptr)
+	{
+		CloseHandle(mapping);
+		mapping = nullptr;
+	}
+#else
+	if (view != nullptr)
+	{
+		munmap(const_cast<char*>(view), length);
+	}
+#endif
+
+	view = nullptr;
+	length = 0;
+}
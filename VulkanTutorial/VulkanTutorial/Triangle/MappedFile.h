@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+
+/// <summary>
+/// Read-only memory-mapped view of a whole file.
+/// Nothing is read up front nor copied into a heap buffer : the OS pages the file in
+/// (read-ahead hinted) as the view is read, and drops the pages again under memory pressure.
+/// The view starts on a page boundary, so it is aligned for 32 bit words (SPIR-V).
+/// Only map files nobody rewrites in place while mapped (assets, files replaced by rename) :
+/// on Linux reading a page of a file truncated meanwhile raises SIGBUS.
+/// </summary>
+class MappedFile
+{
+private:
+	const char* view = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	void* mapping = nullptr;	/* HANDLE of the file mapping object */
+#endif
+
+public:
+	MappedFile() = default;
+	// Throws if the file can't be opened or mapped
+	explicit MappedFile(const std::string& path);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	// Map path (unmapping the current view), false if it can't be opened or mapped
+	bool open(const std::string& path);
+	void close();
+
+	const char* data() const { return view; }
+	size_t size() const { return length; }
+	bool empty() const { return length == 0; }
+
+	// View as 32 bit words (page aligned), size() / 4 of them
+	const uint32_t* words() const { return reinterpret_cast<const uint32_t*>(view); }
+};
+
+/// <summary>
+/// Stream buffer reading straight from memory (a mapped file),
+/// for parsers that only take a std::istream.
+/// </summary>
+class MemoryStreamBuffer : public std::streambuf
+{
+public:
+	MemoryStreamBuffer(const char* data, size_t size)
+	{
+		// The get area is never written through
+		char* begin = const_cast<char*>(data);
+		setg(begin, begin, begin + size);
+	}
+};
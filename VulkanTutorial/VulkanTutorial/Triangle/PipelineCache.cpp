@@ -0,0 +1,199 @@
+#include "PipelineCache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+
+void PipelineCache::init(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& path)
+{
+	this->device = device;
+	this->path = path;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	// Missing on the first run, nothing to load
+	std::vector<char> data;
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+	if (file.is_open())
+	{
+		data.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(data.data(), data.size());
+		if (!file)
+		{
+			data.clear();
+		}
+	}
+
+	// A cache of another GPU/driver (or a damaged file) is dropped,
+	// drivers are supposed to reject it as well, but not all of them do it safely
+	std::string reason = "no cache file";
+	if (!data.empty() && !validate(data, reason))
+	{
+		data.clear();
+	}
+
+	VkPipelineCacheCreateInfo createInfo{};
+	createInfo.sType			= VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize	= data.size();
+	createInfo.pInitialData		= data.empty() ? nullptr : data.data();
+
+	if (vkCreatePipelineCache(device, &createInfo, nullptr, &cache) != VK_SUCCESS)
+	{
+		throw std::runtime_error("[ERROR] : Failed to create pipeline cache!");
+	}
+
+	if (data.empty())
+	{
+		std::cout << "[PIPELINE CACHE]: starting empty (" << reason << ")" << std::endl;
+	}
+	else
+	{
+		std::cout << "[PIPELINE CACHE]: loaded " << data.size() << " bytes from " << path << std::endl;
+	}
+}
+
+bool PipelineCache::validate(const std::vector<char>& data, std::string& reason) const
+{
+	// The data starts with a header identifying the GPU and driver that wrote it
+	VkPipelineCacheHeaderVersionOne header{};
+	if (data.size() < sizeof(header))
+	{
+		reason = "file too small";
+		return false;
+	}
+	std::memcpy(&header, data.data(), sizeof(header));
+
+	if (header.headerSize < sizeof(header) || header.headerSize > data.size())
+	{
+		reason = "bad header size";
+		return false;
+	}
+	if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+	{
+		reason = "unknown header version";
+		return false;
+	}
+	if (header.vendorID != properties.vendorID || header.deviceID != properties.deviceID)
+	{
+		reason = "written by another GPU";
+		return false;
+	}
+	// Changes with every driver update
+	if (std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+	{
+		reason = "written by another driver version";
+		return false;
+	}
+
+	return true;
+}
+
+VkPipelineCache PipelineCache::handle() const
+{
+	return cache;
+}
+
+std::vector<char> PipelineCache::readData()
+{
+	// Size first, then the data
+	size_t size = 0;
+	if (vkGetPipelineCacheData(device, cache, &size, nullptr) != VK_SUCCESS)
+	{
+		throw std::runtime_error("[ERROR] : Failed to get pipeline cache size!");
+	}
+
+	std::vector<char> data(size);
+	if (vkGetPipelineCacheData(device, cache, &size, data.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("[ERROR] : Failed to get pipeline cache data!");
+	}
+	data.resize(size);
+
+	return data;
+}
+
+VkPipelineCache PipelineCache::createWorkerCache()
+{
+	std::vector<char> data;
+	{
+		std::lock_guard<std::mutex> lock(mergeMutex);
+		data = readData();
+	}
+
+	VkPipelineCacheCreateInfo createInfo{};
+	createInfo.sType			= VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize	= data.size();
+	createInfo.pInitialData		= data.empty() ? nullptr : data.data();
+
+	VkPipelineCache workerCache;
+	if (vkCreatePipelineCache(device, &createInfo, nullptr, &workerCache) != VK_SUCCESS)
+	{
+		throw std::runtime_error("[ERROR] : Failed to create worker pipeline cache!");
+	}
+
+	return workerCache;
+}
+
+void PipelineCache::mergeWorkerCache(VkPipelineCache workerCache)
+{
+	{
+		std::lock_guard<std::mutex> lock(mergeMutex);
+		if (vkMergePipelineCaches(device, cache, 1, &workerCache) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[ERROR] : Failed to merge pipeline caches!");
+		}
+	}
+
+	vkDestroyPipelineCache(device, workerCache, nullptr);
+}
+
+void PipelineCache::save()
+{
+	if (cache == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	std::vector<char> data;
+	{
+		std::lock_guard<std::mutex> lock(mergeMutex);
+		data = readData();
+	}
+
+	// Write everything to a temporary file first,
+	// the rename then replaces the old cache in one step
+	std::string temporaryPath = path + ".tmp";
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		file.write(data.data(), data.size());
+		file.flush();
+		if (!file)
+		{
+			// Not fatal : the next run just compiles again
+			std::cerr << "[PIPELINE CACHE]: failed to write " << temporaryPath << std::endl;
+			return;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temporaryPath, path, error);
+	if (error)
+	{
+		std::cerr << "[PIPELINE CACHE]: failed to replace " << path << ": " << error.message() << std::endl;
+		std::filesystem::remove(temporaryPath, error);
+		return;
+	}
+
+	std::cout << "[PIPELINE CACHE]: saved " << data.size() << " bytes to " << path << std::endl;
+}
+
+void PipelineCache::cleanup()
+{
+	if (cache != VK_NULL_HANDLE)
+	{
+		vkDestroyPipelineCache(device, cache, nullptr);
+		cache = VK_NULL_HANDLE;
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// VkPipelineCache kept on disk between runs.
+/// The driver stores compiled shader code in it, so pipelines created on a warm run
+/// skip most of the compilation. The file is only used if its header
+/// (VkPipelineCacheHeaderVersionOne) matches the vendor, device and pipelineCacheUUID
+/// of the current GPU/driver, any other cache is discarded.
+/// Worker threads compile into their own caches, merged back when they finish.
+/// </summary>
+class PipelineCache
+{
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties properties{};
+	std::string path;
+	VkPipelineCache cache = VK_NULL_HANDLE;
+	// vkMergePipelineCaches needs the destination cache externally synchronized
+	std::mutex mergeMutex;
+
+	// False (and why) if data wasn't written by this GPU/driver
+	bool validate(const std::vector<char>& data, std::string& reason) const;
+	std::vector<char> readData();
+
+public:
+	// Load the cache from path, or start with an empty one
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& path);
+	VkPipelineCache handle() const;
+
+	// Private cache for one worker thread, starts with the content of the main cache
+	// (the main cache may only be merged into while no pipeline is created with it)
+	VkPipelineCache createWorkerCache();
+	// Merge what a worker compiled into the main cache and destroy the worker cache
+	void mergeWorkerCache(VkPipelineCache workerCache);
+
+	// Write the cache to a temporary file and rename it over path,
+	// a crash while saving never leaves a truncated cache behind
+	void save();
+	void cleanup();
+};
@@ -0,0 +1,175 @@
+#include "PipelineLayoutCache.h"
+
+#include <algorithm>
+#include <functional>
+#include <map>
+
+namespace
+{
+	template<typename T>
+	void hashCombine(size_t& seed, const T& value)
+	{
+		seed ^= std::hash<T>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	}
+
+	bool sameBindings(const std::vector<VkDescriptorSetLayoutBinding>& a, const std::vector<VkDescriptorSetLayoutBinding>& b)
+	{
+		if (a.size() != b.size())
+		{
+			return false;
+		}
+		for (size_t i = 0; i < a.size(); ++i)
+		{
+			if (a[i].binding != b[i].binding ||
+				a[i].descriptorType != b[i].descriptorType ||
+				a[i].descriptorCount != b[i].descriptorCount ||
+				a[i].stageFlags != b[i].stageFlags ||
+				a[i].pImmutableSamplers != b[i].pImmutableSamplers)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+void PipelineLayoutCache::init(VkDevice device)
+{
+	this->device = device;
+}
+
+size_t PipelineLayoutCache::hashSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+	size_t seed = 0;
+	for (const VkDescriptorSetLayoutBinding& binding : bindings)
+	{
+		hashCombine(seed, binding.binding);
+		hashCombine(seed, static_cast<uint32_t>(binding.descriptorType));
+		hashCombine(seed, binding.descriptorCount);
+		hashCombine(seed, binding.stageFlags);
+	}
+	return seed;
+}
+
+size_t PipelineLayoutCache::hashPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts, const VkPushConstantRange& pushConstants)
+{
+	size_t seed = 0;
+	for (VkDescriptorSetLayout setLayout : setLayouts)
+	{
+		hashCombine(seed, setLayout);
+	}
+	hashCombine(seed, pushConstants.stageFlags);
+	hashCombine(seed, pushConstants.offset);
+	hashCombine(seed, pushConstants.size);
+	return seed;
+}
+
+VkDescriptorSetLayout PipelineLayoutCache::getSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+	size_t key = hashSetLayout(bindings);
+	auto range = setLayouts.equal_range(key);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (sameBindings(it->second.bindings, bindings))
+		{
+			return it->second.layout;
+		}
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType		= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount	= static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings	= bindings.data();
+
+	VkDescriptorSetLayout layout;
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("[ERROR] : Failed to create descriptor set layout!");
+	}
+
+	setLayouts.emplace(key, CachedSetLayout{ bindings, layout });
+	return layout;
+}
+
+VkPipelineLayout PipelineLayoutCache::getPipelineLayout(const ShaderReflection& reflection)
+{
+	// Sets the shaders skip still need a (empty) layout
+	std::vector<VkDescriptorSetLayout> layouts;
+	for (uint32_t set = 0; set < reflection.setCount(); ++set)
+	{
+		layouts.push_back(getSetLayout(reflection.setBindings(set)));
+	}
+
+	const VkPushConstantRange& pushConstants = reflection.pushConstants;
+
+	size_t key = hashPipelineLayout(layouts, pushConstants);
+	auto range = pipelineLayouts.equal_range(key);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		const CachedPipelineLayout& cached = it->second;
+		if (cached.setLayouts == layouts &&
+			cached.pushConstants.stageFlags == pushConstants.stageFlags &&
+			cached.pushConstants.offset == pushConstants.offset &&
+			cached.pushConstants.size == pushConstants.size)
+		{
+			return cached.layout;
+		}
+	}
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType					= VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount			= static_cast<uint32_t>(layouts.size());
+	pipelineLayoutInfo.pSetLayouts				= layouts.data();
+	pipelineLayoutInfo.pushConstantRangeCount	= pushConstants.size != 0 ? 1 : 0;
+	pipelineLayoutInfo.pPushConstantRanges		= pushConstants.size != 0 ? &pushConstants : nullptr;
+
+	VkPipelineLayout layout;
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("[ERROR] : Failed to create pipeline layout!");
+	}
+
+	pipelineLayouts.emplace(key, CachedPipelineLayout{ layouts, pushConstants, layout });
+	return layout;
+}
+
+std::vector<DescriptorAllocator::PoolSizeRatio> PipelineLayoutCache::poolRatios() const
+{
+	// Largest count of each type in one set : a pool sized for N sets fits N of any of them
+	std::map<VkDescriptorType, uint32_t> maxCounts;
+	for (const auto& entry : setLayouts)
+	{
+		std::map<VkDescriptorType, uint32_t> counts;
+		for (const VkDescriptorSetLayoutBinding& binding : entry.second.bindings)
+		{
+			counts[binding.descriptorType] += binding.descriptorCount;
+		}
+		for (const auto& [type, count] : counts)
+		{
+			maxCounts[type] = std::max(maxCounts[type], count);
+		}
+	}
+
+	std::vector<DescriptorAllocator::PoolSizeRatio> ratios;
+	for (const auto& [type, count] : maxCounts)
+	{
+		ratios.push_back({ type, static_cast<float>(count) });
+	}
+	return ratios;
+}
+
+void PipelineLayoutCache::cleanup()
+{
+	// Pipeline layouts first, they were created from the set layouts
+	for (auto& entry : pipelineLayouts)
+	{
+		vkDestroyPipelineLayout(device, entry.second.layout, nullptr);
+	}
+	for (auto& entry : setLayouts)
+	{
+		vkDestroyDescriptorSetLayout(device, entry.second.layout, nullptr);
+	}
+
+	pipelineLayouts.clear();
+	setLayouts.clear();
+}
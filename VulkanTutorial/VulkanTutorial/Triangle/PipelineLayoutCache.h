@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "DescriptorAllocator.h"
+#include "ShaderReflection.h"
+
+/// <summary>
+/// Descriptor set layouts and pipeline layouts built from shader reflection,
+/// keyed by a hash of their content. Shaders declaring the same bindings get the same
+/// set layout handle, so pipelines sharing a set stay compatible for it
+/// and a bound set survives switching between them.
+/// </summary>
+class PipelineLayoutCache
+{
+private:
+	struct CachedSetLayout {
+		std::vector<VkDescriptorSetLayoutBinding> bindings;
+		VkDescriptorSetLayout layout;
+	};
+
+	struct CachedPipelineLayout {
+		std::vector<VkDescriptorSetLayout> setLayouts;
+		VkPushConstantRange pushConstants;
+		VkPipelineLayout layout;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	std::unordered_multimap<size_t, CachedSetLayout> setLayouts;
+	std::unordered_multimap<size_t, CachedPipelineLayout> pipelineLayouts;
+
+	static size_t hashSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+	static size_t hashPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts, const VkPushConstantRange& pushConstants);
+
+public:
+	void init(VkDevice device);
+
+	// Set layout with these bindings (sorted by binding)
+	VkDescriptorSetLayout getSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+	// Pipeline layout of the reflected stages : one set layout per set, their push constant range
+	VkPipelineLayout getPipelineLayout(const ShaderReflection& reflection);
+
+	// Descriptors of each type a set needs at most, for sizing descriptor pools
+	std::vector<DescriptorAllocator::PoolSizeRatio> poolRatios() const;
+
+	void cleanup();
+};
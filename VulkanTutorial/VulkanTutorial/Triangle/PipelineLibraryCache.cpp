@@ -0,0 +1,177 @@
+#include "PipelineLibraryCache.h"
+
+#include <chrono>
+#include <memory>
+
+void PipelineLibraryCache::init(VkDevice device)
+{
+	this->device = device;
+}
+
+GraphicsPipelineKey PipelineLibraryCache::partKey(PipelineLibraryPart part, const GraphicsPipelineKey& key)
+{
+	GraphicsPipelineKey partKey;
+
+	// Every part of one pipeline must be compiled against the same render pass (or formats)
+	partKey.renderPass	= key.renderPass;
+	partKey.subpass		= key.subpass;
+
+	switch (part)
+	{
+	case PipelineLibraryPart::VertexInput:
+		partKey.vertexLayout	= key.vertexLayout;
+		partKey.topology		= key.topology;
+		break;
+
+	case PipelineLibraryPart::PreRasterization:
+		partKey.vertexShader	= key.vertexShader;
+		// The vertex shader reads the attributes of the layout
+		partKey.vertexLayout	= key.vertexLayout;
+		partKey.cullMode		= key.cullMode;
+		partKey.frontFace		= key.frontFace;
+		partKey.layout			= key.layout;
+		break;
+
+	case PipelineLibraryPart::FragmentShader:
+		partKey.fragmentShader	= key.fragmentShader;
+		partKey.features		= key.features;
+		partKey.depthTest		= key.depthTest;
+		partKey.depthWrite		= key.depthWrite;
+		partKey.depthCompareOp	= key.depthCompareOp;
+		partKey.layout			= key.layout;
+		partKey.depthFormat		= key.depthFormat;
+		break;
+
+	case PipelineLibraryPart::FragmentOutput:
+		partKey.blendMode		= key.blendMode;
+		partKey.colorFormat		= key.colorFormat;
+		partKey.depthFormat		= key.depthFormat;
+		break;
+	}
+
+	return partKey;
+}
+
+size_t PipelineLibraryCache::hashEntry(PipelineLibraryPart part, const GraphicsPipelineKey& key, uint64_t codeHash)
+{
+	size_t seed = GraphicsPipelineKeyHash{}(key);
+	seed ^= static_cast<size_t>(part) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	seed ^= std::hash<uint64_t>{}(codeHash) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	return seed;
+}
+
+VkPipeline PipelineLibraryCache::getOrCreate(PipelineLibraryPart part, const GraphicsPipelineKey& partKey, uint64_t codeHash, const CreateFunction& create)
+{
+	size_t hash = hashEntry(part, partKey, codeHash);
+	auto matches = [&](const Entry& entry) {
+		return entry.part == part && entry.codeHash == codeHash && entry.key == partKey;
+	};
+
+	std::shared_ptr<std::promise<VkPipeline>> promise;
+	std::shared_future<VkPipeline> library;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto range = libraries.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (matches(it->second))
+			{
+				library = it->second.library;
+				break;
+			}
+		}
+
+		// Missing : this thread compiles it, later requests wait for the future
+		if (!library.valid())
+		{
+			promise = std::make_shared<std::promise<VkPipeline>>();
+			library = promise->get_future().share();
+			libraries.emplace(hash, Entry{ part, partKey, codeHash, library });
+		}
+	}
+
+	if (promise)
+	{
+		try
+		{
+			promise->set_value(create());
+		}
+		catch (...)
+		{
+			// Forget the failed library, the next request compiles it again
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				auto range = libraries.equal_range(hash);
+				for (auto it = range.first; it != range.second; ++it)
+				{
+					if (matches(it->second))
+					{
+						libraries.erase(it);
+						break;
+					}
+				}
+			}
+			promise->set_exception(std::current_exception());
+		}
+	}
+
+	return library.get();
+}
+
+std::vector<VkPipeline> PipelineLibraryCache::takeOutdated(const std::unordered_map<std::string, uint64_t>& currentCode)
+{
+	std::vector<VkPipeline> outdated;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto it = libraries.begin(); it != libraries.end();)
+	{
+		const Entry& entry = it->second;
+		const std::string* shader = nullptr;
+		if (entry.part == PipelineLibraryPart::PreRasterization)
+		{
+			shader = &entry.key.vertexShader;
+		}
+		else if (entry.part == PipelineLibraryPart::FragmentShader)
+		{
+			shader = &entry.key.fragmentShader;
+		}
+
+		auto current = shader ? currentCode.find(*shader) : currentCode.end();
+		if (current == currentCode.end() || current->second == entry.codeHash ||
+			entry.library.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			++it;
+			continue;
+		}
+
+		// Failed libraries were erased already, a ready entry holds a library
+		outdated.push_back(entry.library.get());
+		it = libraries.erase(it);
+	}
+
+	return outdated;
+}
+
+size_t PipelineLibraryCache::size()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return libraries.size();
+}
+
+void PipelineLibraryCache::cleanup()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto& entry : libraries)
+	{
+		// Failed libraries have nothing to destroy
+		try
+		{
+			vkDestroyPipeline(device, entry.second.library.get(), nullptr);
+		}
+		catch (...)
+		{
+		}
+	}
+	libraries.clear();
+}
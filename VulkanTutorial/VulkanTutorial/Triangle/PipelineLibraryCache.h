@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "PipelineRegistry.h"
+
+// The four parts of a graphics pipeline a library can hold (VK_EXT_graphics_pipeline_library)
+enum class PipelineLibraryPart : uint8_t {
+	VertexInput,		/* vertex bindings/attributes, input assembly */
+	PreRasterization,	/* vertex shader, viewport, rasterization */
+	FragmentShader,		/* fragment shader, depth test */
+	FragmentOutput		/* blending, attachment formats */
+};
+
+/// <summary>
+/// Pipeline libraries, one per part and distinct state of that part.
+/// Variants only differing in one part share the three others, so a new variant
+/// usually only compiles the part that changed before being linked.
+/// Safe to use from several threads : a library is compiled once,
+/// other threads needing it meanwhile wait for that compilation.
+/// </summary>
+class PipelineLibraryCache
+{
+public:
+	// Compiles the library (called on the thread that requested it first)
+	using CreateFunction = std::function<VkPipeline()>;
+
+private:
+	struct Entry {
+		PipelineLibraryPart part;
+		GraphicsPipelineKey key;
+		uint64_t codeHash;
+		std::shared_future<VkPipeline> library;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	std::mutex mutex;
+	std::unordered_multimap<size_t, Entry> libraries;
+
+	static size_t hashEntry(PipelineLibraryPart part, const GraphicsPipelineKey& key, uint64_t codeHash);
+
+public:
+	void init(VkDevice device);
+
+	// Fields of key the part depends on, the others reset to their defaults
+	static GraphicsPipelineKey partKey(PipelineLibraryPart part, const GraphicsPipelineKey& key);
+
+	// Library of the part for partKey, codeHash : SPIR-V of the shader of the part (0 without shader)
+	// so an edited shader gets a new library instead of the one compiled from its previous code
+	// Rethrows the error if the compilation failed (and the next call tries again)
+	VkPipeline getOrCreate(PipelineLibraryPart part, const GraphicsPipelineKey& partKey, uint64_t codeHash, const CreateFunction& create);
+
+	size_t size();
+
+	// Take the shader libraries compiled from other code than currentCode holds for their shader
+	// (SPIR-V hash per source file) out of the cache : a reload replaced that code
+	// Libraries still compiling are kept, the caller destroys the returned ones
+	std::vector<VkPipeline> takeOutdated(const std::unordered_map<std::string, uint64_t>& currentCode);
+
+	// Destroy every library (no pipeline may be linked anymore)
+	void cleanup();
+};
@@ -0,0 +1,434 @@
+#include "PipelineRegistry.h"
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+
+bool ShaderFeatures::operator==(const ShaderFeatures& other) const
+{
+	return texturing == other.texturing &&
+		vertexColor == other.vertexColor &&
+		alphaTest == other.alphaTest &&
+		lightCount == other.lightCount;
+}
+
+bool GraphicsPipelineKey::operator==(const GraphicsPipelineKey& other) const
+{
+	return vertexShader == other.vertexShader &&
+		fragmentShader == other.fragmentShader &&
+		features == other.features &&
+		vertexLayout == other.vertexLayout &&
+		blendMode == other.blendMode &&
+		depthTest == other.depthTest &&
+		depthWrite == other.depthWrite &&
+		depthCompareOp == other.depthCompareOp &&
+		cullMode == other.cullMode &&
+		frontFace == other.frontFace &&
+		topology == other.topology &&
+		layout == other.layout &&
+		renderPass == other.renderPass &&
+		subpass == other.subpass &&
+		colorFormat == other.colorFormat &&
+		depthFormat == other.depthFormat;
+}
+
+size_t GraphicsPipelineKeyHash::operator()(const GraphicsPipelineKey& key) const
+{
+	// boost::hash_combine
+	size_t seed = 0;
+	auto combine = [&seed](size_t value)
+	{
+		seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	};
+
+	combine(std::hash<std::string>{}(key.vertexShader));
+	combine(std::hash<std::string>{}(key.fragmentShader));
+	combine(static_cast<size_t>(key.features.texturing) |
+		(static_cast<size_t>(key.features.vertexColor) << 1) |
+		(static_cast<size_t>(key.features.alphaTest) << 2));
+	combine(static_cast<size_t>(key.features.lightCount));
+	combine(static_cast<size_t>(key.vertexLayout));
+	combine(static_cast<size_t>(key.blendMode));
+	combine(static_cast<size_t>(key.depthTest) | (static_cast<size_t>(key.depthWrite) << 1));
+	combine(static_cast<size_t>(key.depthCompareOp));
+	combine(static_cast<size_t>(key.cullMode));
+	combine(static_cast<size_t>(key.frontFace));
+	combine(static_cast<size_t>(key.topology));
+	// Non-dispatchable handles may be 64 bit integers on 32 bit platforms
+	combine(std::hash<uint64_t>{}((uint64_t)(key.layout)));
+	combine(std::hash<uint64_t>{}((uint64_t)(key.renderPass)));
+	combine(static_cast<size_t>(key.subpass));
+	combine(static_cast<size_t>(key.colorFormat));
+	combine(static_cast<size_t>(key.depthFormat));
+
+	return seed;
+}
+
+void PipelineRegistry::init(VkDevice device, PipelineCache& pipelineCache, JobSystem& jobSystem, BuildFunction build,
+	const PipelineDynamicState& dynamicState, BuildFunction fastBuild)
+{
+	this->device = device;
+	this->dynamicState = dynamicState;
+	this->pipelineCache = &pipelineCache;
+	this->jobSystem = &jobSystem;
+	this->build = std::move(build);
+	this->fastBuild = std::move(fastBuild);
+}
+
+GraphicsPipelineKey PipelineRegistry::variantKey(const GraphicsPipelineKey& key) const
+{
+	GraphicsPipelineKey variant = key;
+	const GraphicsPipelineKey defaults{};
+
+	if (dynamicState.rasterization)
+	{
+		variant.depthTest		= defaults.depthTest;
+		variant.depthWrite		= defaults.depthWrite;
+		variant.depthCompareOp	= defaults.depthCompareOp;
+		variant.cullMode		= defaults.cullMode;
+		variant.frontFace		= defaults.frontFace;
+		// The dynamic topology has to be of the same class (point, line, triangle, patch)
+		// as the one of the pipeline, one representative per class
+		switch (key.topology)
+		{
+		case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
+			variant.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+			break;
+		case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
+		case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+		case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+		case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
+			variant.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+			break;
+		case VK_PRIMITIVE_TOPOLOGY_PATCH_LIST:
+			variant.topology = VK_PRIMITIVE_TOPOLOGY_PATCH_LIST;
+			break;
+		default:
+			variant.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+			break;
+		}
+	}
+
+	if (dynamicState.colorBlend)
+	{
+		variant.blendMode = defaults.blendMode;
+	}
+
+	return variant;
+}
+
+std::shared_future<VkPipeline> PipelineRegistry::request(const GraphicsPipelineKey& requestedKey)
+{
+	GraphicsPipelineKey key = variantKey(requestedKey);
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Compiled or compiling : share the result
+	auto found = pipelines.find(key);
+	if (found != pipelines.end())
+	{
+		return found->second.pipeline;
+	}
+
+	return startBuild(key, VK_NULL_HANDLE);
+}
+
+std::shared_future<VkPipeline> PipelineRegistry::startBuild(const GraphicsPipelineKey& key, VkPipeline previous)
+{
+	auto promise = std::make_shared<std::promise<VkPipeline>>();
+	std::shared_future<VkPipeline> future = promise->get_future().share();
+	uint64_t generation = ++buildGeneration;
+	pipelines[key] = { future, generation };
+
+	// The job owns a copy of the key, the map may rehash meanwhile
+	// Background job : frames waiting on their own jobs never compile a pipeline inline
+	jobSystem->runBackground([this, key, promise, previous, generation]
+	{
+		// Worker caches need no locking while compiling,
+		// only the merge into the persistent cache is serialized
+		VkPipelineCache workerCache = VK_NULL_HANDLE;
+
+		auto fail = [&](std::exception_ptr error, const char* message)
+		{
+			if (workerCache != VK_NULL_HANDLE)
+			{
+				vkDestroyPipelineCache(device, workerCache, nullptr);
+			}
+
+			if (previous == VK_NULL_HANDLE)
+			{
+				// Whoever waits for the variant gets the error
+				promise->set_exception(error);
+			}
+			else
+			{
+				// A broken edit must not take the app down : report it, keep drawing with the previous pipeline
+				std::cerr << "[PIPELINES]: reloading " << key.vertexShader << " + " << key.fragmentShader
+						  << " failed, keeping the previous pipeline\n" << message << std::endl;
+				promise->set_value(previous);
+			}
+
+			// The sources changed again meanwhile : maybe fixed
+			std::lock_guard<std::mutex> lock(mutex);
+			rebuildIfDirty(key, generation, previous);
+		};
+
+		try
+		{
+			// Fast link first when possible : drawable right away, optimized later
+			workerCache = pipelineCache->createWorkerCache();
+			VkPipeline pipeline = fastBuild ? fastBuild(key, workerCache) : build(key, workerCache);
+			pipelineCache->mergeWorkerCache(workerCache);
+			workerCache = VK_NULL_HANDLE;
+			promise->set_value(pipeline);
+
+			std::lock_guard<std::mutex> lock(mutex);
+
+			// After set_value : once retireReplaced() collects the old pipeline,
+			// get() is guaranteed to return the new one
+			if (previous != VK_NULL_HANDLE)
+			{
+				replaced.push_back(previous);
+			}
+
+			// Edited while compiling : this pipeline may come from the old sources,
+			// no point optimizing it
+			if (!rebuildIfDirty(key, generation, pipeline) && fastBuild)
+			{
+				startOptimize(key, pipeline, generation);
+			}
+		}
+		catch (const std::exception& error)
+		{
+			fail(std::current_exception(), error.what());
+		}
+		catch (...)
+		{
+			fail(std::current_exception(), "unknown error");
+		}
+	}, &compiling);
+
+	return future;
+}
+
+void PipelineRegistry::startOptimize(const GraphicsPipelineKey& key, VkPipeline linked, uint64_t generation)
+{
+	jobSystem->runBackground([this, key, linked, generation]
+	{
+		VkPipelineCache workerCache = VK_NULL_HANDLE;
+		VkPipeline optimized = VK_NULL_HANDLE;
+		try
+		{
+			workerCache = pipelineCache->createWorkerCache();
+			optimized = build(key, workerCache);
+			pipelineCache->mergeWorkerCache(workerCache);
+			workerCache = VK_NULL_HANDLE;
+		}
+		catch (const std::exception& error)
+		{
+			// The fast-linked pipeline draws the same, only slower : keep it
+			if (optimized != VK_NULL_HANDLE)
+			{
+				vkDestroyPipeline(device, optimized, nullptr);
+			}
+			if (workerCache != VK_NULL_HANDLE)
+			{
+				vkDestroyPipelineCache(device, workerCache, nullptr);
+			}
+			std::cerr << "[PIPELINES]: optimizing " << key.vertexShader << " + " << key.fragmentShader
+					  << " failed, keeping the fast-linked pipeline\n" << error.what() << std::endl;
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// Rebuilt meanwhile (reload) : this pipeline comes from the previous shaders, nobody uses it
+		auto found = pipelines.find(key);
+		if (found == pipelines.end() || found->second.generation != generation)
+		{
+			vkDestroyPipeline(device, optimized, nullptr);
+			return;
+		}
+
+		// Same ordering as a reload : the new pipeline is visible before the old one gets retired
+		std::promise<VkPipeline> ready;
+		ready.set_value(optimized);
+		found->second.pipeline = ready.get_future().share();
+		replaced.push_back(linked);
+	}, &compiling);
+}
+
+bool PipelineRegistry::rebuildIfDirty(const GraphicsPipelineKey& key, uint64_t generation, VkPipeline current)
+{
+	// Only the latest build of the variant reloads (an older one was replaced already)
+	auto found = pipelines.find(key);
+	if (found == pipelines.end() || found->second.generation != generation || !found->second.dirty)
+	{
+		return false;
+	}
+
+	startBuild(key, current);
+	return true;
+}
+
+VkPipeline PipelineRegistry::get(const GraphicsPipelineKey& key, VkPipeline fallback)
+{
+	std::shared_future<VkPipeline> future = request(key);
+
+	if (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+	{
+		return fallback;
+	}
+	return future.get();
+}
+
+void PipelineRegistry::waitIdle()
+{
+	// Waiting on the compiles themselves : help running them
+	jobSystem->wait(compiling, true);
+}
+
+size_t PipelineRegistry::reload(const std::vector<std::string>& changedFiles)
+{
+	// Only stages are named in the keys, any other source is an include,
+	// then every variant is rebuilt (the shader cache skips the ones not using it)
+	bool allVariants = false;
+	std::vector<std::filesystem::path> changedStages;
+	for (const std::string& file : changedFiles)
+	{
+		std::filesystem::path path = std::filesystem::path(file).lexically_normal();
+		std::string extension = path.extension().string();
+		if (extension == ".vert" || extension == ".frag" || extension == ".comp")
+		{
+			changedStages.push_back(path);
+		}
+		else
+		{
+			allVariants = true;
+		}
+	}
+
+	auto usesChangedStage = [&changedStages](const GraphicsPipelineKey& key)
+	{
+		for (const std::filesystem::path& stage : changedStages)
+		{
+			if (std::filesystem::path(key.vertexShader).lexically_normal() == stage ||
+				std::filesystem::path(key.fragmentShader).lexically_normal() == stage)
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	size_t rebuilt = 0;
+	for (auto& [key, variant] : pipelines)
+	{
+		std::shared_future<VkPipeline> future = variant.pipeline;
+		if (!allVariants && !usesChangedStage(key))
+		{
+			continue;
+		}
+
+		// Still compiling : it may have read the old source already,
+		// the build job starts the reload once it finished (the change is consumed by now)
+		if (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			variant.dirty = true;
+			++rebuilt;
+			continue;
+		}
+
+		// A variant that never compiled has nothing to fall back to
+		VkPipeline previous = VK_NULL_HANDLE;
+		try
+		{
+			previous = future.get();
+		}
+		catch (...)
+		{
+		}
+
+		startBuild(key, previous);
+		++rebuilt;
+	}
+
+	return rebuilt;
+}
+
+bool PipelineRegistry::idle() const
+{
+	return compiling.done();
+}
+
+void PipelineRegistry::retire(VkPipeline pipeline)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	replaced.push_back(pipeline);
+}
+
+void PipelineRegistry::retireReplaced(uint64_t retireValue)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (VkPipeline pipeline : replaced)
+	{
+		retired.push_back({ retireValue, pipeline });
+	}
+	replaced.clear();
+}
+
+void PipelineRegistry::destroyRetired(uint64_t completedValue)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Retired in order, so the oldest ones complete first
+	while (!retired.empty() && retired.front().retireValue <= completedValue)
+	{
+		vkDestroyPipeline(device, retired.front().pipeline, nullptr);
+		retired.pop_front();
+	}
+}
+
+size_t PipelineRegistry::size()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return pipelines.size();
+}
+
+void PipelineRegistry::cleanup()
+{
+	if (!jobSystem)
+	{
+		return;
+	}
+	waitIdle();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto& [key, variant] : pipelines)
+	{
+		// Failed variants have no pipeline to destroy
+		try
+		{
+			vkDestroyPipeline(device, variant.pipeline.get(), nullptr);
+		}
+		catch (...)
+		{
+		}
+	}
+	pipelines.clear();
+
+	// Only called once the device is idle
+	for (VkPipeline pipeline : replaced)
+	{
+		vkDestroyPipeline(device, pipeline, nullptr);
+	}
+	replaced.clear();
+	for (const RetiredPipeline& pipeline : retired)
+	{
+		vkDestroyPipeline(device, pipeline.pipeline, nullptr);
+	}
+	retired.clear();
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "JobSystem.h"
+#include "PipelineCache.h"
+
+// Vertex bindings a pipeline reads
+enum class VertexLayout : uint8_t {
+	Mesh,			/* per-vertex binding only */
+	MeshInstanced	/* + per-instance binding (instance transforms) */
+};
+
+enum class BlendMode : uint8_t {
+	Opaque,
+	AlphaBlend
+};
+
+// Shader features baked into a variant through specialization constants (shader.frag),
+// one SPIR-V module serves every combination and the driver drops the unused branches
+struct ShaderFeatures
+{
+	bool texturing = true;		/* constant_id = 0 */
+	bool vertexColor = true;	/* constant_id = 1 */
+	bool alphaTest = false;		/* constant_id = 2 */
+	uint32_t lightCount = 0;	/* constant_id = 3, 0 : unlit */
+
+	bool operator==(const ShaderFeatures& other) const;
+};
+
+/// <summary>
+/// Everything that makes two graphics pipelines different.
+/// Equal keys always produce the same pipeline, so a key identifies a variant.
+/// </summary>
+struct GraphicsPipelineKey
+{
+	std::string vertexShader;		/* GLSL sources */
+	std::string fragmentShader;
+	ShaderFeatures features;
+	VertexLayout vertexLayout = VertexLayout::Mesh;
+	BlendMode blendMode = BlendMode::Opaque;
+	bool depthTest = true;
+	bool depthWrite = true;
+	VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	// Any render pass compatible with the ones the pipeline is used in
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	uint32_t subpass = 0;
+	// Dynamic rendering (no render pass) : formats of the attachments instead
+	VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+	VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+
+	bool operator==(const GraphicsPipelineKey& other) const;
+};
+
+struct GraphicsPipelineKeyHash
+{
+	size_t operator()(const GraphicsPipelineKey& key) const;
+};
+
+// Parts of a key set at record time instead of baked into the pipeline,
+// keys only differing in them share one pipeline
+struct PipelineDynamicState
+{
+	// Extended dynamic state 1 + 2 (core in Vulkan 1.3) :
+	// depth test/write/compare, cull mode, front face, topology (within its class)
+	bool rasterization = false;
+	// VK_EXT_extended_dynamic_state3 : blend enable, blend equation, color write mask
+	bool colorBlend = false;
+};
+
+/// <summary>
+/// Owns every graphics pipeline variant.
+/// Missing variants are compiled by background jobs (idle workers only), each with its own pipeline cache
+/// (merged into the persistent one afterwards). Requesting a variant that is
+/// already compiled or still compiling returns the same future, nothing is compiled twice.
+/// get() never blocks : until a variant is ready the caller keeps drawing with a fallback.
+/// reload() rebuilds variants whose shaders changed (once their current build finished
+/// if they are still compiling), the pipelines they replace are
+/// destroyed once the frames that may still use them finished on the GPU.
+/// With a fast build function (pipeline libraries), a variant is first fast-linked,
+/// the optimized pipeline is built in the background and replaces it the same way.
+/// </summary>
+class PipelineRegistry
+{
+public:
+	// Creates the pipeline of a key (called on worker threads)
+	using BuildFunction = std::function<VkPipeline(const GraphicsPipelineKey& key, VkPipelineCache cache)>;
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	PipelineDynamicState dynamicState;
+	PipelineCache* pipelineCache = nullptr;
+	JobSystem* jobSystem = nullptr;
+	BuildFunction build;
+	BuildFunction fastBuild;	/* empty : variants are only built once, optimized */
+
+	// Pipeline of a variant and the build it comes from,
+	// a background optimization only replaces the pipeline of its own build
+	struct Variant {
+		std::shared_future<VkPipeline> pipeline;
+		uint64_t generation;
+		bool dirty = false;		/* sources changed while compiling : build again once done */
+	};
+
+	std::mutex mutex;
+	std::unordered_map<GraphicsPipelineKey, Variant, GraphicsPipelineKeyHash> pipelines;
+	uint64_t buildGeneration = 0;
+	// Compile jobs still running
+	JobCounter compiling;
+
+	// Pipelines replaced by a reload, waiting for retireReplaced()
+	std::vector<VkPipeline> replaced;
+	struct RetiredPipeline {
+		uint64_t retireValue;		/* frameTimeline value of the last frame that may use it */
+		VkPipeline pipeline;
+	};
+	std::deque<RetiredPipeline> retired;
+
+	// Compile job of a variant (mutex held), previous : pipeline it replaces (reload) or VK_NULL_HANDLE
+	std::shared_future<VkPipeline> startBuild(const GraphicsPipelineKey& key, VkPipeline previous);
+	// Optimized build replacing the fast-linked pipeline of the build generation
+	void startOptimize(const GraphicsPipelineKey& key, VkPipeline linked, uint64_t generation);
+	// Build generation finished (mutex held) : start the reload it missed, if any
+	// current : pipeline of the variant now. Returns true if a new build started
+	bool rebuildIfDirty(const GraphicsPipelineKey& key, uint64_t generation, VkPipeline current);
+
+public:
+	// fastBuild (optional) : quick to create but slower pipeline, used until build finished
+	void init(VkDevice device, PipelineCache& pipelineCache, JobSystem& jobSystem, BuildFunction build,
+		const PipelineDynamicState& dynamicState = {}, BuildFunction fastBuild = nullptr);
+
+	// Key of the pipeline drawing key : dynamic parts reset to fixed values
+	GraphicsPipelineKey variantKey(const GraphicsPipelineKey& key) const;
+
+	// Start compiling the variant unless it was requested before
+	std::shared_future<VkPipeline> request(const GraphicsPipelineKey& key);
+	// The variant if it is compiled, otherwise fallback (and the variant gets requested)
+	// Rethrows the error if its compilation failed
+	VkPipeline get(const GraphicsPipelineKey& key, VkPipeline fallback);
+	// Help compiling until every requested variant is ready (optimized builds included)
+	void waitIdle();
+	// No variant is compiling
+	bool idle() const;
+
+	// Rebuild the variants using one of the changed files (any include : every variant)
+	// A variant still compiling is rebuilt once its build finished (it may have read the old sources)
+	// A variant that fails to compile keeps its previous pipeline
+	// Returns the number of variants being rebuilt
+	size_t reload(const std::vector<std::string>& changedFiles);
+	// Destroy pipeline once the frames that may still use it finished (as a replaced variant)
+	void retire(VkPipeline pipeline);
+	// Hand the pipelines replaced so far over to deferred deletion
+	// Call before get() : a replacement collected here is ready, get() swaps it in the same frame
+	void retireReplaced(uint64_t retireValue);
+	// Destroy retired pipelines whose frames reached completedValue on the timeline
+	void destroyRetired(uint64_t completedValue);
+
+	// Number of variants requested so far
+	size_t size();
+
+	// Wait for running compilations and destroy every pipeline (retired ones included)
+	void cleanup();
+};
@@ -0,0 +1,93 @@
+#include "PresentLatencyTracker.h"
+
+#include <algorithm>
+
+void PresentLatencyTracker::init(VkDevice device, bool presentWaitSupported)
+{
+	this->device = device;
+
+	// Extension function, not exported by the loader
+	waitForPresent = presentWaitSupported
+		? reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(device, "vkWaitForPresentKHR"))
+		: nullptr;
+}
+
+bool PresentLatencyTracker::usesPresentWait() const
+{
+	return waitForPresent != nullptr;
+}
+
+uint64_t PresentLatencyTracker::nextPresentId()
+{
+	// Ids have to increase with every present of a swap chain
+	return usesPresentWait() ? ++lastPresentId : 0;
+}
+
+void PresentLatencyTracker::onPresent(uint64_t presentId, VkSwapchainKHR swapChain, Clock::time_point inputTime)
+{
+	if (usesPresentWait())
+	{
+		// Every present is queued, even without input : the queue depth counts them all
+		pending.push_back({ swapChain, presentId, inputTime });
+		// Earlier presents may have reached the screen meanwhile
+		poll();
+	}
+	else if (inputTime != Clock::time_point{})
+	{
+		// Best effort : the image is queued, not necessarily on screen yet
+		addSample(inputTime, Clock::now());
+	}
+}
+
+void PresentLatencyTracker::poll()
+{
+	// Presents complete in order, stop at the first one still queued
+	// (timeout 0 : only query, VK_TIMEOUT while not displayed)
+	while (!pending.empty())
+	{
+		const PendingPresent& present = pending.front();
+		VkResult result = waitForPresent(device, present.swapChain, present.presentId, 0);
+		if (result == VK_TIMEOUT)
+		{
+			break;
+		}
+
+		// Errors (out of date, retired swap chain) : the image may never be shown, no sample
+		if (result == VK_SUCCESS && present.inputTime != Clock::time_point{})
+		{
+			addSample(present.inputTime, Clock::now());
+		}
+		pending.pop_front();
+	}
+}
+
+void PresentLatencyTracker::releaseSwapChain(VkSwapchainKHR swapChain)
+{
+	pending.erase(
+		std::remove_if(pending.begin(), pending.end(),
+			[swapChain](const PendingPresent& present) { return present.swapChain == swapChain; }),
+		pending.end());
+}
+
+void PresentLatencyTracker::addSample(Clock::time_point inputTime, Clock::time_point presentTime)
+{
+	double ms = std::chrono::duration<double, std::milli>(presentTime - inputTime).count();
+	totalMs += ms;
+	maxMs = std::max(maxMs, ms);
+	++samples;
+}
+
+PresentLatencyTracker::Stats PresentLatencyTracker::takeStats()
+{
+	Stats stats{};
+	stats.samples			= samples;
+	stats.averageMs			= samples > 0 ? totalMs / samples : 0.0;
+	stats.maxMs				= maxMs;
+	stats.presentQueueDepth	= static_cast<uint32_t>(pending.size());
+
+	samples = 0;
+	totalMs = 0.0;
+	maxMs = 0.0;
+
+	return stats;
+}
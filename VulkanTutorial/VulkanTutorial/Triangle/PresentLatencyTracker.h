@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+
+/// <summary>
+/// Measures the time from an input event to the moment the first frame reflecting it is presented.
+/// With VK_KHR_present_id/VK_KHR_present_wait every present gets an id and is polled
+/// (vkWaitForPresentKHR with a zero timeout, never blocks) by the thread presenting,
+/// right after each present, until the presentation engine displayed it.
+/// Without them the sample ends when vkQueuePresentKHR returns (CPU timestamps only).
+/// </summary>
+class PresentLatencyTracker
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	struct Stats {
+		uint32_t samples = 0;
+		double averageMs = 0.0;
+		double maxMs = 0.0;
+		uint32_t presentQueueDepth = 0;		/* presents not displayed yet (present wait only) */
+	};
+
+private:
+	struct PendingPresent {
+		VkSwapchainKHR swapChain;
+		uint64_t presentId;
+		Clock::time_point inputTime;		/* epoch : the frame reflects no new input */
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	PFN_vkWaitForPresentKHR waitForPresent = nullptr;
+	uint64_t lastPresentId = 0;
+	std::deque<PendingPresent> pending;
+
+	// Accumulated since the last takeStats()
+	uint32_t samples = 0;
+	double totalMs = 0.0;
+	double maxMs = 0.0;
+
+	void addSample(Clock::time_point inputTime, Clock::time_point presentTime);
+
+public:
+	// presentWaitSupported : both extensions (and their features) are enabled on the device
+	void init(VkDevice device, bool presentWaitSupported);
+	bool usesPresentWait() const;
+
+	// Id to chain into VkPresentIdKHR (0 : don't chain one)
+	uint64_t nextPresentId();
+	// Call right after vkQueuePresentKHR, on the thread presenting
+	// (vkWaitForPresentKHR needs the swap chain externally synchronized, like the present)
+	// inputTime : first input event shown by this frame, epoch if there was none since the last frame
+	void onPresent(uint64_t presentId, VkSwapchainKHR swapChain, Clock::time_point inputTime);
+	// Collect presents the engine finished displaying, never blocks
+	void poll();
+	// Forget the presents of a swap chain about to be destroyed
+	void releaseSwapChain(VkSwapchainKHR swapChain);
+
+	// Statistics since the previous call
+	Stats takeStats();
+};
@@ -0,0 +1,938 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <iostream>
+
+void RenderGraph::init(VkDevice device, VkPhysicalDevice physicalDevice, bool dynamicRendering)
+{
+	this->device = device;
+	this->physicalDevice = physicalDevice;
+	this->dynamicRendering = dynamicRendering;
+}
+
+// ------------------------------- RESOURCES --------------------------------
+
+RenderGraph::ResourceHandle RenderGraph::importImage(
+	const std::string& name,
+	const std::vector<VkImage>& images,
+	const std::vector<VkImageView>& views,
+	VkFormat format,
+	VkImageAspectFlags aspect,
+	const Access& initialState,
+	VkImageLayout finalLayout)
+{
+	Resource resource{};
+	resource.name			= name;
+	resource.imported		= true;
+	resource.isImage		= true;
+	resource.desc.format	= format;
+	resource.desc.aspect	= aspect;
+	resource.images			= images;
+	resource.views			= views;
+	resource.initialState	= initialState;
+	resource.finalLayout	= finalLayout;
+
+	resources.push_back(resource);
+	return static_cast<ResourceHandle>(resources.size() - 1);
+}
+
+RenderGraph::ResourceHandle RenderGraph::importBuffer(const std::string& name)
+{
+	Resource resource{};
+	resource.name		= name;
+	resource.imported	= true;
+	resource.isImage	= false;
+
+	resources.push_back(resource);
+	return static_cast<ResourceHandle>(resources.size() - 1);
+}
+
+RenderGraph::ResourceHandle RenderGraph::createImage(const std::string& name, const ImageDesc& desc)
+{
+	Resource resource{};
+	resource.name		= name;
+	resource.imported	= false;
+	resource.isImage	= true;
+	resource.desc		= desc;
+
+	resources.push_back(resource);
+	return static_cast<ResourceHandle>(resources.size() - 1);
+}
+
+void RenderGraph::markOutput(ResourceHandle resource)
+{
+	resources[resource].output = true;
+}
+
+// --------------------------------- PASSES ---------------------------------
+
+RenderGraph::PassHandle RenderGraph::addPass(const std::string& name, PassType type, ExecuteCallback execute)
+{
+	Pass pass{};
+	pass.name		= name;
+	pass.type		= type;
+	pass.execute	= std::move(execute);
+
+	passes.push_back(std::move(pass));
+	return static_cast<PassHandle>(passes.size() - 1);
+}
+
+void RenderGraph::addAccess(PassHandle pass, ResourceHandle resource, const Access& access, bool write)
+{
+	// One access per resource and pass, combine flags for read-modify-write
+	for (const PassAccess& existing : passes[pass].accesses)
+	{
+		if (existing.resource == resource)
+		{
+			throw std::runtime_error("[ERROR] : Resource " + resources[resource].name + " is used twice by pass " + passes[pass].name + "!");
+		}
+	}
+
+	passes[pass].accesses.push_back({ resource, access, write });
+}
+
+void RenderGraph::read(PassHandle pass, ResourceHandle resource, const Access& access)
+{
+	addAccess(pass, resource, access, false);
+}
+
+void RenderGraph::write(PassHandle pass, ResourceHandle resource, const Access& access)
+{
+	addAccess(pass, resource, access, true);
+}
+
+void RenderGraph::colorAttachment(PassHandle pass, ResourceHandle resource, const VkClearValue* clearValue)
+{
+	Attachment attachment{};
+	attachment.resource	= resource;
+	attachment.clear	= clearValue != nullptr;
+	if (clearValue)
+	{
+		attachment.clearValue = *clearValue;
+	}
+	passes[pass].colorAttachments.push_back(attachment);
+
+	// Loading reads the previous content of the attachment
+	Access access{};
+	access.stages	= VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+	access.access	= VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+					  (attachment.clear ? VK_ACCESS_2_NONE : VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT);
+	access.layout	= VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	addAccess(pass, resource, access, true);
+}
+
+void RenderGraph::depthAttachment(PassHandle pass, ResourceHandle resource, const VkClearValue* clearValue)
+{
+	if (!passes[pass].depthAttachment.empty())
+	{
+		throw std::runtime_error("[ERROR] : Pass " + passes[pass].name + " already has a depth attachment!");
+	}
+
+	Attachment attachment{};
+	attachment.resource	= resource;
+	attachment.clear	= clearValue != nullptr;
+	if (clearValue)
+	{
+		attachment.clearValue = *clearValue;
+	}
+	passes[pass].depthAttachment.push_back(attachment);
+
+	// Depth test reads, depth write writes (early and late fragment tests)
+	Access access{};
+	access.stages	= VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+	access.access	= VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	access.layout	= VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	addAccess(pass, resource, access, true);
+}
+
+void RenderGraph::setSubpassContents(PassHandle pass, VkSubpassContents contents)
+{
+	passes[pass].contents = contents;
+}
+
+VkRenderPass RenderGraph::renderPass(PassHandle pass) const
+{
+	return passes[pass].renderPass;
+}
+
+// -------------------------------- COMPILING -------------------------------
+
+void RenderGraph::compile(VkExtent2D renderExtent)
+{
+	extent = renderExtent;
+
+	// Imported images with several images (swap chain) give us several variants
+	variantCount = 1;
+	for (const Resource& resource : resources)
+	{
+		variantCount = std::max(variantCount, static_cast<uint32_t>(resource.images.size()));
+	}
+
+	cullPasses();
+	computeLifetimes();
+	allocateTransientImages();
+	computeBarriers();
+	createRenderPasses();
+}
+
+void RenderGraph::cullPasses()
+{
+	// Walk the passes backwards, starting from the outputs
+	// A pass is only needed if it writes something that is needed later
+	std::vector<bool> needed(resources.size(), false);
+	for (size_t i = 0; i < resources.size(); ++i)
+	{
+		needed[i] = resources[i].output;
+	}
+
+	for (size_t p = passes.size(); p-- > 0;)
+	{
+		Pass& pass = passes[p];
+
+		pass.culled = true;
+		for (const PassAccess& access : pass.accesses)
+		{
+			if (access.write && needed[access.resource])
+			{
+				pass.culled = false;
+				break;
+			}
+		}
+
+		if (pass.culled)
+		{
+			continue;
+		}
+
+		// Everything the pass touches has to be produced by earlier passes
+		for (const PassAccess& access : pass.accesses)
+		{
+			needed[access.resource] = true;
+		}
+	}
+}
+
+void RenderGraph::computeLifetimes()
+{
+	for (Resource& resource : resources)
+	{
+		resource.firstPass = UINT32_MAX;
+		resource.lastPass = 0;
+	}
+
+	for (uint32_t p = 0; p < passes.size(); ++p)
+	{
+		if (passes[p].culled)
+		{
+			continue;
+		}
+
+		for (const PassAccess& access : passes[p].accesses)
+		{
+			Resource& resource = resources[access.resource];
+			resource.firstPass = std::min(resource.firstPass, p);
+			resource.lastPass = std::max(resource.lastPass, p);
+		}
+	}
+}
+
+uint32_t RenderGraph::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+{
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+	{
+		if ((typeFilter & (1 << i)) &&
+			(memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			return i;
+		}
+	}
+
+	throw std::runtime_error("[ERROR] : Failed to find suitable memory type for transient image!");
+}
+
+void RenderGraph::allocateTransientImages()
+{
+	// Transient images only go into device local memory,
+	// blocks are matched on the memory types left after this filter
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	uint32_t deviceLocalTypes = 0;
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+	{
+		if (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+		{
+			deviceLocalTypes |= 1u << i;
+		}
+	}
+
+	// Create the transient images that survived culling
+	std::vector<ResourceHandle> transients;
+	std::vector<VkMemoryRequirements> requirements(resources.size());
+
+	for (ResourceHandle r = 0; r < resources.size(); ++r)
+	{
+		Resource& resource = resources[r];
+		if (resource.imported || !resource.isImage || resource.firstPass == UINT32_MAX)
+		{
+			continue;
+		}
+
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType			= VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType		= VK_IMAGE_TYPE_2D;
+		imageInfo.extent.width	= resource.desc.extent.width;
+		imageInfo.extent.height	= resource.desc.extent.height;
+		imageInfo.extent.depth	= 1;
+		imageInfo.mipLevels		= 1;
+		imageInfo.arrayLayers	= 1;
+		imageInfo.format		= resource.desc.format;
+		imageInfo.tiling		= VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout	= VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage			= resource.desc.usage;
+		imageInfo.sharingMode	= VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.samples		= VK_SAMPLE_COUNT_1_BIT;
+
+		VkImage image;
+		if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[ERROR] : Failed to create transient image " + resource.name + "!");
+		}
+		resource.images = { image };
+
+		vkGetImageMemoryRequirements(device, image, &requirements[r]);
+		requirements[r].memoryTypeBits &= deviceLocalTypes;
+		if (requirements[r].memoryTypeBits == 0)
+		{
+			throw std::runtime_error("[ERROR] : No device local memory type for transient image " + resource.name + "!");
+		}
+		resource.size = requirements[r].size;
+		transients.push_back(r);
+	}
+
+	// Place the biggest images first, every image goes into the first block
+	// whose occupants are never alive at the same time as it is
+	// (memory of a finished image is reused by a later one)
+	std::sort(transients.begin(), transients.end(),
+		[this](ResourceHandle a, ResourceHandle b) {
+			return resources[a].size > resources[b].size;
+		});
+
+	for (ResourceHandle r : transients)
+	{
+		Resource& resource = resources[r];
+
+		for (size_t b = 0; b < memoryBlocks.size() && resource.memoryBlock < 0; ++b)
+		{
+			MemoryBlock& block = memoryBlocks[b];
+			if ((block.memoryTypeBits & requirements[r].memoryTypeBits) == 0)
+			{
+				continue;
+			}
+
+			bool overlaps = false;
+			for (ResourceHandle other : block.resources)
+			{
+				overlaps = overlaps ||
+					(resource.firstPass <= resources[other].lastPass &&
+					 resources[other].firstPass <= resource.lastPass);
+			}
+
+			if (!overlaps)
+			{
+				resource.memoryBlock = static_cast<int32_t>(b);
+			}
+		}
+
+		if (resource.memoryBlock < 0)
+		{
+			memoryBlocks.emplace_back();
+			resource.memoryBlock = static_cast<int32_t>(memoryBlocks.size() - 1);
+		}
+
+		MemoryBlock& block = memoryBlocks[resource.memoryBlock];
+		block.size = std::max(block.size, requirements[r].size);
+		block.memoryTypeBits &= requirements[r].memoryTypeBits;
+		block.resources.push_back(r);
+	}
+
+	// Allocate each block once and bind all of its images at offset 0
+	// (offset 0 satisfies the alignment of every image)
+	for (MemoryBlock& block : memoryBlocks)
+	{
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType				= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize	= block.size;
+		allocInfo.memoryTypeIndex	= findMemoryType(block.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		if (vkAllocateMemory(device, &allocInfo, nullptr, &block.memory) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[ERROR] : Failed to allocate transient image memory!");
+		}
+
+		for (ResourceHandle r : block.resources)
+		{
+			Resource& resource = resources[r];
+			vkBindImageMemory(device, resource.images[0], block.memory, 0);
+
+			VkImageViewCreateInfo viewInfo{};
+			viewInfo.sType								= VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image								= resource.images[0];
+			viewInfo.viewType							= VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format								= resource.desc.format;
+			viewInfo.subresourceRange.aspectMask		= resource.desc.aspect;
+			viewInfo.subresourceRange.baseMipLevel		= 0;
+			viewInfo.subresourceRange.levelCount		= 1;
+			viewInfo.subresourceRange.baseArrayLayer	= 0;
+			viewInfo.subresourceRange.layerCount		= 1;
+
+			VkImageView view;
+			if (vkCreateImageView(device, &viewInfo, nullptr, &view) != VK_SUCCESS)
+			{
+				throw std::runtime_error("[ERROR] : Failed to create transient image view " + resource.name + "!");
+			}
+			resource.views = { view };
+		}
+	}
+}
+
+
+void RenderGraph::computeBarriers()
+{
+	// Synchronization state of every memory block at the end of the frame
+	// An aliased image (or the same image next frame) must wait for the last user of the memory
+	std::vector<ResourceState> blockStates(memoryBlocks.size());
+	std::vector<ResourceState> states;
+
+	// First walk : find the end-of-frame state of the blocks
+	// Second walk : place the barriers, starting from that state
+	for (int walk = 0; walk < 2; ++walk)
+	{
+		states.assign(resources.size(), ResourceState{});
+		std::vector<bool> touched(resources.size(), false);
+
+		for (size_t r = 0; r < resources.size(); ++r)
+		{
+			if (resources[r].imported)
+			{
+				// Imported resources start in their declared state (e.g. waited on by a semaphore)
+				states[r].layout		= resources[r].initialState.layout;
+				states[r].writeStages	= resources[r].initialState.stages;
+				states[r].writeAccess	= resources[r].initialState.access;
+			}
+		}
+
+		for (Pass& pass : passes)
+		{
+			pass.barriers = BarrierBatch{};
+			if (pass.culled)
+			{
+				continue;
+			}
+
+			for (const PassAccess& passAccess : pass.accesses)
+			{
+				const Resource& resource = resources[passAccess.resource];
+				ResourceState& state = states[passAccess.resource];
+				const Access& access = passAccess.access;
+
+				// Content of transient images is undefined on first use,
+				// but their memory still has to wait for its previous user
+				if (!resource.imported && !touched[passAccess.resource])
+				{
+					const ResourceState& blockState = blockStates[resource.memoryBlock];
+					state = ResourceState{};
+					state.writeStages = blockState.writeStages | blockState.readStages;
+					state.writeAccess = blockState.writeAccess;
+				}
+				touched[passAccess.resource] = true;
+
+				VkImageLayout oldLayout = state.layout;
+				bool layoutChange = resource.isImage && oldLayout != access.layout;
+				bool needsBarrier = false;
+				VkPipelineStageFlags2 srcStages = VK_PIPELINE_STAGE_2_NONE;
+				VkAccessFlags2 srcAccess = VK_ACCESS_2_NONE;
+
+				if (passAccess.write || layoutChange)
+				{
+					// Write-after-write : wait for the last write and make it available
+					// Write-after-read : wait for every read since then (execution dependency only)
+					// Layout transitions are writes too
+					srcStages = state.writeStages | state.readStages;
+					srcAccess = state.writeAccess;
+					needsBarrier = srcStages != VK_PIPELINE_STAGE_2_NONE || layoutChange;
+
+					if (passAccess.write)
+					{
+						state.writeStages = access.stages;
+						state.writeAccess = access.access;
+						state.readStages = VK_PIPELINE_STAGE_2_NONE;
+						state.readAccess = VK_ACCESS_2_NONE;
+					}
+					else
+					{
+						// The transition is visible to this read, later reads have to wait for it
+						state.writeStages = access.stages;
+						state.writeAccess = VK_ACCESS_2_NONE;
+						state.readStages = access.stages;
+						state.readAccess = access.access;
+					}
+					state.layout = access.layout;
+				}
+				else
+				{
+					// Read-after-write : only if no earlier barrier
+					// already made the write visible to this stage/access
+					bool covered =
+						(access.stages & ~state.readStages) == 0 &&
+						(access.access & ~state.readAccess) == 0;
+
+					if (state.writeStages != VK_PIPELINE_STAGE_2_NONE && !covered)
+					{
+						srcStages = state.writeStages;
+						srcAccess = state.writeAccess;
+						needsBarrier = true;
+					}
+
+					state.readStages |= access.stages;
+					state.readAccess |= access.access;
+				}
+
+				if (!resource.imported)
+				{
+					blockStates[resource.memoryBlock] = state;
+				}
+
+				if (!needsBarrier)
+				{
+					continue;
+				}
+
+				if (resource.isImage)
+				{
+					pass.barriers.images.push_back({
+						passAccess.resource,
+						srcStages, srcAccess,
+						access.stages, access.access,
+						oldLayout, access.layout });
+				}
+				else
+				{
+					// Every buffer dependency of the pass goes into one global memory barrier
+					pass.barriers.memorySrcStages |= srcStages;
+					pass.barriers.memorySrcAccess |= srcAccess;
+					pass.barriers.memoryDstStages |= access.stages;
+					pass.barriers.memoryDstAccess |= access.access;
+				}
+			}
+		}
+	}
+
+	// Hand the imported images over in the layout the outside expects (e.g. present)
+	// The following semaphore signal takes care of the execution dependency
+	finalBarriers = BarrierBatch{};
+	for (ResourceHandle r = 0; r < resources.size(); ++r)
+	{
+		const Resource& resource = resources[r];
+		const ResourceState& state = states[r];
+		if (!resource.imported || !resource.isImage ||
+			resource.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED ||
+			resource.finalLayout == state.layout)
+		{
+			continue;
+		}
+
+		finalBarriers.images.push_back({
+			r,
+			state.writeStages | state.readStages, state.writeAccess,
+			VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE,
+			state.layout, resource.finalLayout });
+	}
+}
+
+bool RenderGraph::rendersToAttachments(const Pass& pass) const
+{
+	return !pass.culled && pass.type == PassType::Graphics &&
+		(!pass.colorAttachments.empty() || !pass.depthAttachment.empty());
+}
+
+bool RenderGraph::storeAttachment(const Attachment& attachment, uint32_t pass) const
+{
+	const Resource& resource = resources[attachment.resource];
+	return resource.imported || resource.output || resource.lastPass > pass;
+}
+
+void RenderGraph::createRenderPasses()
+{
+	// Attachments are passed to vkCmdBeginRendering when executing
+	if (dynamicRendering)
+	{
+		return;
+	}
+
+	for (uint32_t p = 0; p < passes.size(); ++p)
+	{
+		Pass& pass = passes[p];
+		if (!rendersToAttachments(pass))
+		{
+			continue;
+		}
+
+		// Layouts don't change inside the render pass, the graph barriers did the transitions
+		auto describe = [&](const Attachment& attachment, VkImageLayout layout) {
+			const Resource& resource = resources[attachment.resource];
+
+			VkAttachmentDescription description{};
+			description.format			= resource.desc.format;
+			description.samples			= VK_SAMPLE_COUNT_1_BIT;
+			description.loadOp			= attachment.clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+			description.storeOp			= storeAttachment(attachment, p) ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			description.stencilLoadOp	= VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			description.stencilStoreOp	= VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			description.initialLayout	= layout;
+			description.finalLayout		= layout;
+			return description;
+		};
+
+		std::vector<VkAttachmentDescription> attachments;
+		std::vector<VkAttachmentReference> colorReferences;
+		VkAttachmentReference depthReference{};
+
+		for (const Attachment& attachment : pass.colorAttachments)
+		{
+			colorReferences.push_back({ static_cast<uint32_t>(attachments.size()), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
+			attachments.push_back(describe(attachment, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL));
+		}
+		for (const Attachment& attachment : pass.depthAttachment)
+		{
+			depthReference = { static_cast<uint32_t>(attachments.size()), VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+			attachments.push_back(describe(attachment, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL));
+		}
+
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint		= VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount	= static_cast<uint32_t>(colorReferences.size());
+		subpass.pColorAttachments		= colorReferences.data();
+		subpass.pDepthStencilAttachment	= pass.depthAttachment.empty() ? nullptr : &depthReference;
+
+		VkRenderPassCreateInfo renderPassInfo{};
+		renderPassInfo.sType			= VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassInfo.attachmentCount	= static_cast<uint32_t>(attachments.size());
+		renderPassInfo.pAttachments		= attachments.data();
+		renderPassInfo.subpassCount		= 1;
+		renderPassInfo.pSubpasses		= &subpass;
+
+		if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &pass.renderPass) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[ERROR] : Failed to create render pass for pass " + pass.name + "!");
+		}
+
+		// One framebuffer per variant (swap chain image)
+		pass.framebuffers.resize(variantCount);
+		for (uint32_t v = 0; v < variantCount; ++v)
+		{
+			std::vector<VkImageView> views;
+			for (const Attachment& attachment : pass.colorAttachments)
+			{
+				const Resource& resource = resources[attachment.resource];
+				views.push_back(resource.views[v % resource.views.size()]);
+			}
+			for (const Attachment& attachment : pass.depthAttachment)
+			{
+				const Resource& resource = resources[attachment.resource];
+				views.push_back(resource.views[v % resource.views.size()]);
+			}
+
+			VkFramebufferCreateInfo framebufferInfo{};
+			framebufferInfo.sType			= VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			framebufferInfo.renderPass		= pass.renderPass;
+			framebufferInfo.attachmentCount	= static_cast<uint32_t>(views.size());
+			framebufferInfo.pAttachments	= views.data();
+			framebufferInfo.width			= extent.width;
+			framebufferInfo.height			= extent.height;
+			framebufferInfo.layers			= 1;
+
+			if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &pass.framebuffers[v]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("[ERROR] : Failed to create framebuffer for pass " + pass.name + "!");
+			}
+		}
+	}
+}
+
+// -------------------------------- EXECUTION -------------------------------
+
+void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch, uint32_t variant) const
+{
+	bool memoryBarrier = batch.memorySrcStages != VK_PIPELINE_STAGE_2_NONE ||
+						 batch.memoryDstStages != VK_PIPELINE_STAGE_2_NONE;
+	if (batch.images.empty() && !memoryBarrier)
+	{
+		return;
+	}
+
+	std::vector<VkImageMemoryBarrier2> imageBarriers;
+	imageBarriers.reserve(batch.images.size());
+	for (const ImageBarrier& barrier : batch.images)
+	{
+		const Resource& resource = resources[barrier.resource];
+
+		VkImageMemoryBarrier2 imageBarrier{};
+		imageBarrier.sType								= VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+		imageBarrier.srcStageMask						= barrier.srcStages;
+		imageBarrier.srcAccessMask						= barrier.srcAccess;
+		imageBarrier.dstStageMask						= barrier.dstStages;
+		imageBarrier.dstAccessMask						= barrier.dstAccess;
+		imageBarrier.oldLayout							= barrier.oldLayout;
+		imageBarrier.newLayout							= barrier.newLayout;
+		imageBarrier.srcQueueFamilyIndex				= VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.dstQueueFamilyIndex				= VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.image								= resource.images[variant % resource.images.size()];
+		imageBarrier.subresourceRange.aspectMask		= resource.desc.aspect;
+		imageBarrier.subresourceRange.baseMipLevel		= 0;
+		imageBarrier.subresourceRange.levelCount		= 1;
+		imageBarrier.subresourceRange.baseArrayLayer	= 0;
+		imageBarrier.subresourceRange.layerCount		= 1;
+		imageBarriers.push_back(imageBarrier);
+	}
+
+	VkMemoryBarrier2 globalBarrier{};
+	globalBarrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+	globalBarrier.srcStageMask	= batch.memorySrcStages;
+	globalBarrier.srcAccessMask	= batch.memorySrcAccess;
+	globalBarrier.dstStageMask	= batch.memoryDstStages;
+	globalBarrier.dstAccessMask	= batch.memoryDstAccess;
+
+	VkDependencyInfo dependencyInfo{};
+	dependencyInfo.sType					= VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependencyInfo.memoryBarrierCount		= memoryBarrier ? 1 : 0;
+	dependencyInfo.pMemoryBarriers			= &globalBarrier;
+	dependencyInfo.imageMemoryBarrierCount	= static_cast<uint32_t>(imageBarriers.size());
+	dependencyInfo.pImageMemoryBarriers		= imageBarriers.data();
+
+	vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+}
+
+void RenderGraph::beginRendering(VkCommandBuffer commandBuffer, uint32_t p, uint32_t variant) const
+{
+	const Pass& pass = passes[p];
+
+	// Same load/store operations a render pass would use,
+	// the layouts are the ones the graph barriers transitioned to
+	auto describe = [&](const Attachment& attachment, VkImageLayout layout) {
+		const Resource& resource = resources[attachment.resource];
+
+		VkRenderingAttachmentInfo info{};
+		info.sType			= VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+		info.imageView		= resource.views[variant % resource.views.size()];
+		info.imageLayout	= layout;
+		info.loadOp			= attachment.clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+		info.storeOp		= storeAttachment(attachment, p) ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		info.clearValue		= attachment.clearValue;
+		return info;
+	};
+
+	std::vector<VkRenderingAttachmentInfo> colorAttachments;
+	for (const Attachment& attachment : pass.colorAttachments)
+	{
+		colorAttachments.push_back(describe(attachment, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL));
+	}
+	VkRenderingAttachmentInfo depthAttachment{};
+	for (const Attachment& attachment : pass.depthAttachment)
+	{
+		depthAttachment = describe(attachment, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	}
+
+	VkRenderingInfo renderingInfo{};
+	renderingInfo.sType					= VK_STRUCTURE_TYPE_RENDERING_INFO;
+	// Draws recorded into secondary command buffers (the equivalent of the subpass contents)
+	renderingInfo.flags					= pass.contents == VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS ?
+											VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
+	renderingInfo.renderArea.offset		= { 0, 0 };
+	renderingInfo.renderArea.extent		= extent;
+	renderingInfo.layerCount			= 1;
+	renderingInfo.colorAttachmentCount	= static_cast<uint32_t>(colorAttachments.size());
+	renderingInfo.pColorAttachments		= colorAttachments.data();
+	// Stencil isn't used, pipelines are created without a stencil format
+	renderingInfo.pDepthAttachment		= pass.depthAttachment.empty() ? nullptr : &depthAttachment;
+
+	vkCmdBeginRendering(commandBuffer, &renderingInfo);
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer, uint32_t variant) const
+{
+	for (uint32_t p = 0; p < passes.size(); ++p)
+	{
+		const Pass& pass = passes[p];
+		if (pass.culled)
+		{
+			continue;
+		}
+
+		recordBarriers(commandBuffer, pass.barriers, variant);
+
+		if (dynamicRendering && rendersToAttachments(pass))
+		{
+			beginRendering(commandBuffer, p, variant);
+			pass.execute(commandBuffer);
+			vkCmdEndRendering(commandBuffer);
+			continue;
+		}
+
+		if (pass.renderPass == VK_NULL_HANDLE)
+		{
+			pass.execute(commandBuffer);
+			continue;
+		}
+
+		std::vector<VkClearValue> clearValues;
+		for (const Attachment& attachment : pass.colorAttachments)
+		{
+			clearValues.push_back(attachment.clearValue);
+		}
+		for (const Attachment& attachment : pass.depthAttachment)
+		{
+			clearValues.push_back(attachment.clearValue);
+		}
+
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType				= VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass			= pass.renderPass;
+		renderPassInfo.framebuffer			= pass.framebuffers[variant % pass.framebuffers.size()];
+		renderPassInfo.renderArea.offset	= { 0, 0 };
+		renderPassInfo.renderArea.extent	= extent;
+		renderPassInfo.clearValueCount		= static_cast<uint32_t>(clearValues.size());
+		renderPassInfo.pClearValues			= clearValues.data();
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, pass.contents);
+		pass.execute(commandBuffer);
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	recordBarriers(commandBuffer, finalBarriers, variant);
+}
+
+uint32_t RenderGraph::culledPassCount() const
+{
+	uint32_t count = 0;
+	for (const Pass& pass : passes)
+	{
+		count += pass.culled ? 1 : 0;
+	}
+	return count;
+}
+
+VkDeviceSize RenderGraph::aliasedBytes() const
+{
+	VkDeviceSize imageBytes = 0;
+	for (const Resource& resource : resources)
+	{
+		imageBytes += resource.memoryBlock >= 0 ? resource.size : 0;
+	}
+
+	VkDeviceSize blockBytes = 0;
+	for (const MemoryBlock& block : memoryBlocks)
+	{
+		blockBytes += block.size;
+	}
+
+	return imageBytes - blockBytes;
+}
+
+void RenderGraph::checkAliasing(VkDevice device, VkPhysicalDevice physicalDevice)
+{
+	// Two transient images, the second one only used after the last use of the first :
+	// both have to end up in the same memory block
+	// Compute passes only, nothing is recorded or submitted
+	RenderGraph graph;
+	graph.init(device, physicalDevice);
+
+	ImageDesc desc{};
+	desc.format	= VK_FORMAT_R8G8B8A8_UNORM;		/* storage support is mandatory */
+	desc.extent	= { 64, 64 };
+	desc.usage	= VK_IMAGE_USAGE_STORAGE_BIT;
+	desc.aspect	= VK_IMAGE_ASPECT_COLOR_BIT;
+
+	ResourceHandle images[2] = {
+		graph.createImage("aliasing check first", desc),
+		graph.createImage("aliasing check second", desc)
+	};
+	// Both consumers write it, so no pass gets culled
+	ResourceHandle output = graph.importBuffer("aliasing check output");
+	graph.markOutput(output);
+
+	Access imageWrite{ VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL };
+	Access imageRead{ VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_GENERAL };
+	Access bufferWrite{ VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED };
+
+	for (ResourceHandle image : images)
+	{
+		PassHandle producer = graph.addPass(graph.resources[image].name + " write", PassType::Compute, nullptr);
+		graph.write(producer, image, imageWrite);
+
+		PassHandle consumer = graph.addPass(graph.resources[image].name + " read", PassType::Compute, nullptr);
+		graph.read(consumer, image, imageRead);
+		graph.write(consumer, output, bufferWrite);
+	}
+
+	graph.compile(desc.extent);
+
+	VkDeviceSize aliasedBytes = graph.aliasedBytes();
+	bool aliased =
+		graph.resources[images[0]].memoryBlock == graph.resources[images[1]].memoryBlock &&
+		aliasedBytes > 0;
+	graph.cleanup();
+
+	if (!aliased)
+	{
+		throw std::runtime_error("[ERROR] : Render graph did not alias transient images with disjoint lifetimes!");
+	}
+
+	std::cout << "[RENDER GRAPH]: aliasing check passed (" << aliasedBytes << " bytes shared)" << std::endl;
+}
+
+void RenderGraph::cleanup()
+{
+	for (Pass& pass : passes)
+	{
+		for (VkFramebuffer framebuffer : pass.framebuffers)
+		{
+			vkDestroyFramebuffer(device, framebuffer, nullptr);
+		}
+		if (pass.renderPass != VK_NULL_HANDLE)
+		{
+			vkDestroyRenderPass(device, pass.renderPass, nullptr);
+		}
+	}
+
+	// Imported images belong to someone else
+	for (Resource& resource : resources)
+	{
+		if (resource.imported)
+		{
+			continue;
+		}
+		for (VkImageView view : resource.views)
+		{
+			vkDestroyImageView(device, view, nullptr);
+		}
+		for (VkImage image : resource.images)
+		{
+			vkDestroyImage(device, image, nullptr);
+		}
+	}
+
+	for (MemoryBlock& block : memoryBlocks)
+	{
+		vkFreeMemory(device, block.memory, nullptr);
+	}
+
+	resources.clear();
+	passes.clear();
+	memoryBlocks.clear();
+	finalBarriers = BarrierBatch{};
+	variantCount = 1;
+}
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Frame graph of passes declaring which resources they read and write.
+/// compile() culls passes that don't contribute to an output,
+/// places the (batched) synchronization2 barriers between passes,
+/// builds render passes/framebuffers (or begins dynamic rendering
+/// with the attachments directly) and lets transient images
+/// with non-overlapping lifetimes share the same memory.
+/// execute() then records every pass with its barriers.
+/// </summary>
+class RenderGraph
+{
+public:
+	using ResourceHandle = uint32_t;
+	using PassHandle = uint32_t;
+	using ExecuteCallback = std::function<void(VkCommandBuffer)>;
+
+	enum class PassType { Graphics, Compute, Transfer };
+
+	// How a pass uses a resource
+	struct Access {
+		VkPipelineStageFlags2 stages;
+		VkAccessFlags2 access;
+		VkImageLayout layout;		/* images only */
+	};
+
+	// Description of an image owned (and aliased) by the graph
+	struct ImageDesc {
+		VkFormat format;
+		VkExtent2D extent;
+		VkImageUsageFlags usage;
+		VkImageAspectFlags aspect;
+	};
+
+private:
+	// Synchronization state of a resource while walking the passes
+	struct ResourceState {
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags2 writeStages = VK_PIPELINE_STAGE_2_NONE;	/* last write (or layout transition) */
+		VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+		VkPipelineStageFlags2 readStages = VK_PIPELINE_STAGE_2_NONE;	/* reads since the last write */
+		VkAccessFlags2 readAccess = VK_ACCESS_2_NONE;
+	};
+
+	struct Resource {
+		std::string name;
+		bool imported = false;
+		bool isImage = false;
+		bool output = false;		/* used outside the graph (e.g. presented) */
+		// Images : one image/view per variant for imported images (swap chain)
+		ImageDesc desc{};
+		std::vector<VkImage> images;
+		std::vector<VkImageView> views;
+		Access initialState{};		/* imported : state at the start of the graph */
+		VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		// Transient images
+		int32_t memoryBlock = -1;
+		VkDeviceSize size = 0;
+		uint32_t firstPass = UINT32_MAX;
+		uint32_t lastPass = 0;
+	};
+
+	struct PassAccess {
+		ResourceHandle resource;
+		Access access;
+		bool write;
+	};
+
+	struct Attachment {
+		ResourceHandle resource;
+		bool clear;
+		VkClearValue clearValue;
+	};
+
+	struct ImageBarrier {
+		ResourceHandle resource;
+		VkPipelineStageFlags2 srcStages;
+		VkAccessFlags2 srcAccess;
+		VkPipelineStageFlags2 dstStages;
+		VkAccessFlags2 dstAccess;
+		VkImageLayout oldLayout;
+		VkImageLayout newLayout;
+	};
+
+	// All barriers recorded before a pass, issued with a single vkCmdPipelineBarrier2
+	struct BarrierBatch {
+		std::vector<ImageBarrier> images;
+		// Buffers are synchronized with one global memory barrier
+		VkPipelineStageFlags2 memorySrcStages = VK_PIPELINE_STAGE_2_NONE;
+		VkAccessFlags2 memorySrcAccess = VK_ACCESS_2_NONE;
+		VkPipelineStageFlags2 memoryDstStages = VK_PIPELINE_STAGE_2_NONE;
+		VkAccessFlags2 memoryDstAccess = VK_ACCESS_2_NONE;
+	};
+
+	struct Pass {
+		std::string name;
+		PassType type;
+		ExecuteCallback execute;
+		std::vector<PassAccess> accesses;
+		std::vector<Attachment> colorAttachments;
+		std::vector<Attachment> depthAttachment;	/* zero or one */
+		VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE;
+		bool culled = false;
+		BarrierBatch barriers;
+		VkRenderPass renderPass = VK_NULL_HANDLE;		/* not with dynamic rendering */
+		std::vector<VkFramebuffer> framebuffers;	/* one per variant */
+	};
+
+	struct MemoryBlock {
+		VkDeviceSize size = 0;
+		uint32_t memoryTypeBits = UINT32_MAX;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		std::vector<ResourceHandle> resources;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkExtent2D extent{};
+	uint32_t variantCount = 1;
+	// vkCmdBeginRendering instead of render pass and framebuffer objects
+	bool dynamicRendering = false;
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<MemoryBlock> memoryBlocks;
+	BarrierBatch finalBarriers;
+
+	void addAccess(PassHandle pass, ResourceHandle resource, const Access& access, bool write);
+	void cullPasses();
+	void computeLifetimes();
+	void allocateTransientImages();
+	void computeBarriers();
+	void createRenderPasses();
+	bool rendersToAttachments(const Pass& pass) const;
+	// Content is only stored if someone uses it after the pass
+	bool storeAttachment(const Attachment& attachment, uint32_t pass) const;
+	void beginRendering(VkCommandBuffer commandBuffer, uint32_t pass, uint32_t variant) const;
+	void recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch, uint32_t variant) const;
+	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+public:
+	// dynamicRendering : graphics passes begin rendering with their attachments (VK_KHR_dynamic_rendering),
+	// no render pass/framebuffer objects are created, renderPass() returns VK_NULL_HANDLE
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, bool dynamicRendering = false);
+
+	// ------------------------------ RESOURCES -------------------------------
+
+	// Images owned outside the graph, one image/view per variant (e.g. swap chain images)
+	ResourceHandle importImage(
+		const std::string& name,
+		const std::vector<VkImage>& images,
+		const std::vector<VkImageView>& views,
+		VkFormat format,
+		VkImageAspectFlags aspect,
+		const Access& initialState,
+		VkImageLayout finalLayout);
+	// Buffers owned outside the graph, only used to order passes
+	ResourceHandle importBuffer(const std::string& name);
+	// Image created by the graph, only lives during the passes using it
+	ResourceHandle createImage(const std::string& name, const ImageDesc& desc);
+	// Keep the passes writing this resource (and everything they depend on)
+	void markOutput(ResourceHandle resource);
+
+	// -------------------------------- PASSES --------------------------------
+
+	PassHandle addPass(const std::string& name, PassType type, ExecuteCallback execute);
+	void read(PassHandle pass, ResourceHandle resource, const Access& access);
+	// Also used for read-modify-write accesses
+	void write(PassHandle pass, ResourceHandle resource, const Access& access);
+	// clearValue : cleared when set, loaded otherwise
+	void colorAttachment(PassHandle pass, ResourceHandle resource, const VkClearValue* clearValue);
+	void depthAttachment(PassHandle pass, ResourceHandle resource, const VkClearValue* clearValue);
+	// Inline commands or secondary command buffers (graphics passes), can change every frame
+	void setSubpassContents(PassHandle pass, VkSubpassContents contents);
+
+	// ------------------------------- EXECUTION ------------------------------
+
+	void compile(VkExtent2D renderExtent);
+	// variant : which image of the imported resources to use (e.g. swap chain image index)
+	void execute(VkCommandBuffer commandBuffer, uint32_t variant) const;
+	VkRenderPass renderPass(PassHandle pass) const;
+
+	uint32_t culledPassCount() const;
+	// Memory the transient images would need without aliasing, minus what they use
+	VkDeviceSize aliasedBytes() const;
+
+	// Compiles a small graph with two transient images of disjoint lifetimes,
+	// throws if they don't share memory (the app graph only has one transient, depth)
+	static void checkAliasing(VkDevice device, VkPhysicalDevice physicalDevice);
+
+	// Destroy everything the graph created and forget all passes/resources
+	void cleanup();
+};
@@ -0,0 +1,179 @@
+#include "RenderQueue.h"
+
+RenderQueue::Stats& RenderQueue::Stats::operator+=(const Stats& other)
+{
+	draws += other.draws;
+	stateChanges += other.stateChanges;
+	stateChangesAvoided += other.stateChangesAvoided;
+	return *this;
+}
+
+uint64_t RenderQueue::makeSortKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, uint32_t depthBucket)
+{
+	// Most expensive state changes go into the highest bits,
+	// so they change the least often in the sorted order
+	return
+		(static_cast<uint64_t>(pass & 0xF) << 60) |
+		(static_cast<uint64_t>(pipeline & 0xFFF) << 48) |
+		(static_cast<uint64_t>(material & 0xFFFF) << 32) |
+		(static_cast<uint64_t>(mesh & 0xFFFF) << 16) |
+		(static_cast<uint64_t>(depthBucket & 0xFFFF));
+}
+
+void RenderQueue::clear()
+{
+	items.clear();
+	sortedIndices.clear();
+}
+
+void RenderQueue::push(const DrawItem& item)
+{
+	items.push_back(item);
+}
+
+uint32_t RenderQueue::size() const
+{
+	return static_cast<uint32_t>(items.size());
+}
+
+void RenderQueue::sort()
+{
+	uint32_t count = static_cast<uint32_t>(items.size());
+	sortedIndices.resize(count);
+	scratch.resize(count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		sortedIndices[i] = i;
+	}
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	// LSD radix sort, one byte of the key per pass
+	// Linear in the number of draws and stable between passes
+	for (uint32_t shift = 0; shift < 64; shift += 8)
+	{
+		uint32_t histogram[256] = {};
+		for (uint32_t index : sortedIndices)
+		{
+			histogram[(items[index].sortKey >> shift) & 0xFF]++;
+		}
+
+		// Every key has the same digit, this pass would not change the order
+		if (histogram[(items[sortedIndices[0]].sortKey >> shift) & 0xFF] == count)
+		{
+			continue;
+		}
+
+		// Turn counts into the first output slot of each digit
+		uint32_t offset = 0;
+		for (uint32_t& bucket : histogram)
+		{
+			uint32_t bucketCount = bucket;
+			bucket = offset;
+			offset += bucketCount;
+		}
+
+		for (uint32_t index : sortedIndices)
+		{
+			scratch[histogram[(items[index].sortKey >> shift) & 0xFF]++] = index;
+		}
+		sortedIndices.swap(scratch);
+	}
+}
+
+RenderQueue::Stats RenderQueue::record(
+	VkCommandBuffer commandBuffer,
+	uint32_t first,
+	uint32_t count,
+	const DrawCallback& beforeDraw
+) const
+{
+	Stats stats{};
+
+	// Nothing is bound at the start of a command buffer
+	// (state is not inherited by secondary command buffers either)
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	VkPipelineLayout boundLayout = VK_NULL_HANDLE;
+	VkDescriptorSet boundSet = VK_NULL_HANDLE;
+	uint32_t boundOffset = 0;
+	VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+	VkBuffer boundIndexBuffer = VK_NULL_HANDLE;
+
+	for (uint32_t i = first; i < first + count; ++i)
+	{
+		const DrawItem& item = items[sortedIndices[i]];
+
+		if (item.pipeline != boundPipeline)
+		{
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, item.pipeline);
+			boundPipeline = item.pipeline;
+			stats.stateChanges++;
+		}
+		else
+		{
+			stats.stateChangesAvoided++;
+		}
+
+		// Sets stay bound across pipelines with a compatible layout,
+		// a different layout needs them to be bound again
+		if (item.pipelineLayout != boundLayout ||
+			item.descriptorSet != boundSet ||
+			item.dynamicOffset != boundOffset)
+		{
+			vkCmdBindDescriptorSets(
+				commandBuffer,
+				VK_PIPELINE_BIND_POINT_GRAPHICS,
+				item.pipelineLayout,
+				0,
+				1,
+				&item.descriptorSet,
+				1,
+				&item.dynamicOffset
+			);
+			boundLayout = item.pipelineLayout;
+			boundSet = item.descriptorSet;
+			boundOffset = item.dynamicOffset;
+			stats.stateChanges++;
+		}
+		else
+		{
+			stats.stateChangesAvoided++;
+		}
+
+		if (item.vertexBuffer != boundVertexBuffer)
+		{
+			VkDeviceSize offset = 0;
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &item.vertexBuffer, &offset);
+			boundVertexBuffer = item.vertexBuffer;
+			stats.stateChanges++;
+		}
+		else
+		{
+			stats.stateChangesAvoided++;
+		}
+
+		if (item.indexBuffer != boundIndexBuffer)
+		{
+			vkCmdBindIndexBuffer(commandBuffer, item.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+			boundIndexBuffer = item.indexBuffer;
+			stats.stateChanges++;
+		}
+		else
+		{
+			stats.stateChangesAvoided++;
+		}
+
+		if (beforeDraw)
+		{
+			beforeDraw(commandBuffer, item);
+		}
+
+		vkCmdDrawIndexed(commandBuffer, item.indexCount, 1, item.firstIndex, item.vertexOffset, 0);
+		stats.draws++;
+	}
+
+	return stats;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/// <summary>
+/// List of draws sorted by a packed 64-bit key.
+/// Draws sharing a pipeline, material or mesh end up next to each other,
+/// so recording them only binds the state that actually changes.
+/// Key layout (most significant first):
+/// pass (4 bits) | pipeline (12) | material (16) | mesh (16) | depth bucket (16)
+/// </summary>
+class RenderQueue
+{
+public:
+	struct DrawItem {
+		uint64_t sortKey;
+		VkPipeline pipeline;
+		VkPipelineLayout pipelineLayout;
+		VkDescriptorSet descriptorSet;
+		uint32_t dynamicOffset;		/* offset of the (single) dynamic descriptor */
+		VkBuffer vertexBuffer;
+		VkBuffer indexBuffer;
+		uint32_t indexCount;
+		uint32_t firstIndex;
+		int32_t vertexOffset;
+		uint32_t objectIndex;		/* scene object the draw belongs to */
+	};
+
+	// Bind calls of one recording
+	struct Stats {
+		uint32_t draws = 0;
+		uint32_t stateChanges = 0;			/* bind calls recorded */
+		uint32_t stateChangesAvoided = 0;	/* bind calls skipped, state was already bound */
+
+		Stats& operator+=(const Stats& other);
+	};
+
+	// Called right before each draw (push constants, etc.)
+	using DrawCallback = std::function<void(VkCommandBuffer, const DrawItem&)>;
+
+private:
+	std::vector<DrawItem> items;
+	std::vector<uint32_t> sortedIndices;	/* draw order, indices into items */
+	std::vector<uint32_t> scratch;			/* radix sort ping-pong buffer */
+
+public:
+	static uint64_t makeSortKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, uint32_t depthBucket);
+
+	void clear();
+	void push(const DrawItem& item);
+	// Radix sort the draws by their keys (stable)
+	void sort();
+	uint32_t size() const;
+	// Record sorted draws [first, first + count), skipping redundant binds
+	// Only reads the queue, so disjoint ranges can be recorded on different threads
+	Stats record(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count, const DrawCallback& beforeDraw) const;
+};
@@ -1,28 +1,325 @@
 #include "ShaderCompiler.h"
 
-std::vector<char> ShaderCompiler::readFile(const std::string& filename)
+#include <vulkan/vulkan.h>
+#include <shaderc/shaderc.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <system_error>
+#include <thread>
+
+namespace
+{
+	// Compiled shaders, next to the sources (working directory)
+	const char* SHADER_CACHE_DIRECTORY = "shader_cache";
+	// Bump when the layout of cache entries changes
+	const uint32_t SHADER_CACHE_MAGIC = 0x43565053;		/* "SPVC" */
+	const uint32_t SHADER_CACHE_VERSION = 2;
+
+	// Sources and includes are read into a copy, not mapped : an editor saving over the file
+	// in place (hot reload) would pull the pages from under a mapping
+	std::string readText(const std::filesystem::path& path, bool& found)
+	{
+		std::ifstream file(path, std::ios::binary);
+		found = file.is_open();
+		std::stringstream content;
+		content << file.rdbuf();
+		return content.str();
+	}
+
+	/// <summary>
+	/// Resolves #include "file" relative to the including file
+	/// and records every file it handed out (for the cache entry).
+	/// </summary>
+	class Includer : public shaderc::CompileOptions::IncluderInterface
+	{
+	public:
+		struct Included {
+			std::string path;
+			std::string content;
+		};
+
+	private:
+		// Keeps name/content alive until shaderc releases the result
+		struct Result {
+			std::string name;
+			std::string content;
+			shaderc_include_result result;
+		};
+
+		std::vector<Included>* included;
+
+	public:
+		explicit Includer(std::vector<Included>* included) : included(included) {}
+
+		shaderc_include_result* GetInclude(
+			const char* requestedSource,
+			shaderc_include_type type,
+			const char* requestingSource,
+			size_t /*includeDepth*/) override
+		{
+			// #include "file" : next to the including file, #include <file> : working directory
+			std::filesystem::path path = requestedSource;
+			if (type == shaderc_include_type_relative)
+			{
+				path = std::filesystem::path(requestingSource).parent_path() / requestedSource;
+			}
+			path = path.lexically_normal();
+
+			Result* data = new Result();
+			bool found = false;
+			data->content = readText(path, found);
+			if (found)
+			{
+				data->name = path.generic_string();
+				included->push_back({ data->name, data->content });
+			}
+			else
+			{
+				// Empty name : the content is the error message
+				data->content = "cannot open include file " + path.generic_string();
+			}
+
+			data->result.source_name		= data->name.c_str();
+			data->result.source_name_length	= data->name.size();
+			data->result.content			= data->content.c_str();
+			data->result.content_length		= data->content.size();
+			data->result.user_data			= data;
+			return &data->result;
+		}
+
+		void ReleaseInclude(shaderc_include_result* result) override
+		{
+			delete static_cast<Result*>(result->user_data);
+		}
+	};
+}
+
+MappedFile ShaderCompiler::readFile(const std::string& filename)
+{
+	return MappedFile(filename);
+}
+
+uint64_t ShaderCompiler::hash(const void* data, size_t size, uint64_t seed)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint64_t value = seed;
+	for (size_t i = 0; i < size; ++i)
+	{
+		value ^= bytes[i];
+		value *= 0x100000001b3ull;	/* FNV prime */
+	}
+	return value;
+}
+
+std::vector<uint32_t> ShaderCompiler::compile(const std::string& sourceFile, const std::vector<ShaderDefine>& defines)
 {
-	std::ifstream file(filename, 
-		std::ios::ate |		/* reading at the end of the file */
-		std::ios::binary	/* use binary mode, avoid text transformations */
-	);
-	
-	// Check if file opening was successful
-	if (!file.is_open())
+	// Pipeline stage from the file extension (same convention as glslc)
+	std::string extension = std::filesystem::path(sourceFile).extension().string();
+	shaderc_shader_kind kind;
+	if (extension == ".vert")		kind = shaderc_glsl_vertex_shader;
+	else if (extension == ".frag")	kind = shaderc_glsl_fragment_shader;
+	else if (extension == ".comp")	kind = shaderc_glsl_compute_shader;
+	else
+	{
+		throw std::runtime_error("[ERROR] : Unknown shader stage of " + sourceFile + "!");
+	}
+
+	bool found = false;
+	std::string source = readText(sourceFile, found);
+	if (!found)
 	{
-		throw std::runtime_error("[ERROR] : Failed to open file!");
+		throw std::runtime_error("[ERROR] : Failed to open shader " + sourceFile + "!");
 	}
 
-	// Determine size of file, to allocate buffer for it
-	// (thanks to std::ios::ate)
-	size_t fileSize = (size_t)(file.tellg());
-	std::vector<char> buffer(fileSize);
+	// Cache key : everything that changes the output, except the includes
+	// (their content is only known after preprocessing, the entry checks them)
+	// The SPIR-V version and the SDK headers stand for the compiler version,
+	// shaderc ships with the SDK
+	uint32_t spirvVersion = 0;
+	uint32_t spirvRevision = 0;
+	shaderc_get_spv_version(&spirvVersion, &spirvRevision);
+	uint32_t compilerVersion[] = { SHADER_CACHE_VERSION, spirvVersion, spirvRevision, VK_HEADER_VERSION, static_cast<uint32_t>(kind) };
 
-	// Read binary file content
-	file.seekg(0);
-	file.read(buffer.data(), fileSize);
+	uint64_t key = hash(compilerVersion, sizeof(compilerVersion));
+	key = hash(sourceFile.data(), sourceFile.size(), key);
+	key = hash(source.data(), source.size(), key);
+	for (const ShaderDefine& define : defines)
+	{
+		// Separators, so "AB"+"C" and "A"+"BC" differ
+		key = hash(define.name.c_str(), define.name.size() + 1, key);
+		key = hash(define.value.c_str(), define.value.size() + 1, key);
+	}
+
+	std::vector<uint32_t> spirv;
+	if (loadCached(key, spirv))
+	{
+		return spirv;
+	}
+
+	// Cache miss : compile
+	std::vector<Includer::Included> included;
+
+	shaderc::CompileOptions options;
+	options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_3);
+	options.SetOptimizationLevel(shaderc_optimization_level_performance);
+	options.SetIncluder(std::make_unique<Includer>(&included));
+	for (const ShaderDefine& define : defines)
+	{
+		options.AddMacroDefinition(define.name, define.value);
+	}
+
+	// shaderc::Compiler isn't shared : compile() runs on several job system workers at once
+	shaderc::Compiler compiler;
+	shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(
+		source.data(), source.size(), kind, sourceFile.c_str(), "main", options);
+
+	if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+	{
+		throw std::runtime_error("[ERROR] : Failed to compile shader " + sourceFile + ":\n" + result.GetErrorMessage());
+	}
 
-	file.close();
+	spirv.assign(result.cbegin(), result.cend());
 
-	return buffer;
-}
\ No newline at end of file
+	std::vector<IncludedFile> includes;
+	for (const Includer::Included& file : included)
+	{
+		includes.push_back({ file.path, hash(file.content.data(), file.content.size()) });
+	}
+	storeCached(key, includes, spirv);
+
+	std::cout << "[SHADER]: compiled " << sourceFile << " (" << includes.size() << " includes)" << std::endl;
+
+	return spirv;
+}
+
+std::filesystem::path ShaderCompiler::cachePath(uint64_t key)
+{
+	std::stringstream name;
+	name << std::hex << key << ".spv";
+	return std::filesystem::path(SHADER_CACHE_DIRECTORY) / name.str();
+}
+
+// Cache entry layout :
+// uint32 magic, uint32 version, uint32 include count,
+// per include : uint32 path length, path, uint64 content hash
+// zero padding up to a multiple of 4 bytes, then the SPIR-V code until the end of the file
+bool ShaderCompiler::loadCached(uint64_t key, std::vector<uint32_t>& spirv)
+{
+	// Entries are only ever replaced by a rename, never rewritten in place : safe to map
+	MappedFile entry;
+	if (!entry.open(cachePath(key).string()))
+	{
+		return false;
+	}
+
+	size_t offset = 0;
+	auto read = [&entry, &offset](void* destination, size_t size)
+	{
+		if (offset + size > entry.size())
+		{
+			return false;
+		}
+		std::memcpy(destination, entry.data() + offset, size);
+		offset += size;
+		return true;
+	};
+
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	uint32_t includeCount = 0;
+	if (!read(&magic, sizeof(magic)) || magic != SHADER_CACHE_MAGIC ||
+		!read(&version, sizeof(version)) || version != SHADER_CACHE_VERSION ||
+		!read(&includeCount, sizeof(includeCount)))
+	{
+		return false;
+	}
+
+	// Stale as soon as one include changed (or disappeared)
+	for (uint32_t i = 0; i < includeCount; ++i)
+	{
+		uint32_t pathLength = 0;
+		if (!read(&pathLength, sizeof(pathLength)) || offset + pathLength > entry.size())
+		{
+			return false;
+		}
+		std::string path(entry.data() + offset, pathLength);
+		offset += pathLength;
+
+		uint64_t contentHash = 0;
+		if (!read(&contentHash, sizeof(contentHash)))
+		{
+			return false;
+		}
+
+		bool includeFound = false;
+		std::string content = readText(path, includeFound);
+		if (!includeFound || hash(content.data(), content.size()) != contentHash)
+		{
+			return false;
+		}
+	}
+
+	// SPIR-V is a stream of 32 bit words, the padding keeps them aligned in the (page aligned) view
+	offset = (offset + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1);
+	if (offset >= entry.size() || (entry.size() - offset) % sizeof(uint32_t) != 0)
+	{
+		return false;
+	}
+
+	const uint32_t* code = entry.words() + offset / sizeof(uint32_t);
+	spirv.assign(code, entry.words() + entry.size() / sizeof(uint32_t));
+	return true;
+}
+
+void ShaderCompiler::storeCached(uint64_t key, const std::vector<IncludedFile>& includes, const std::vector<uint32_t>& spirv)
+{
+	std::error_code error;
+	std::filesystem::create_directories(SHADER_CACHE_DIRECTORY, error);
+
+	std::string entry;
+	auto write = [&entry](const void* data, size_t size)
+	{
+		entry.append(static_cast<const char*>(data), size);
+	};
+
+	uint32_t includeCount = static_cast<uint32_t>(includes.size());
+	write(&SHADER_CACHE_MAGIC, sizeof(SHADER_CACHE_MAGIC));
+	write(&SHADER_CACHE_VERSION, sizeof(SHADER_CACHE_VERSION));
+	write(&includeCount, sizeof(includeCount));
+	for (const IncludedFile& include : includes)
+	{
+		uint32_t pathLength = static_cast<uint32_t>(include.path.size());
+		write(&pathLength, sizeof(pathLength));
+		write(include.path.data(), include.path.size());
+		write(&include.contentHash, sizeof(include.contentHash));
+	}
+	entry.resize((entry.size() + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1), '\0');
+	write(spirv.data(), spirv.size() * sizeof(uint32_t));
+
+	// Temporary file (unique per thread) renamed over the entry :
+	// readers never see a partially written entry
+	std::filesystem::path path = cachePath(key);
+	std::stringstream temporaryName;
+	temporaryName << path.string() << "." << std::this_thread::get_id() << ".tmp";
+	std::string temporaryPath = temporaryName.str();
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		file.write(entry.data(), entry.size());
+		file.flush();
+		if (!file)
+		{
+			// Not fatal : compiled again next time
+			std::cerr << "[SHADER]: failed to write cache entry " << temporaryPath << std::endl;
+			return;
+		}
+	}
+
+	std::filesystem::rename(temporaryPath, path, error);
+	if (error)
+	{
+		std::filesystem::remove(temporaryPath, error);
+	}
+}
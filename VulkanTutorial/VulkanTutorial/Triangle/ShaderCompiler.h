@@ -3,12 +3,45 @@
 #include <fstream>
 #include <vector>
 #include <filesystem>
+#include <string>
+#include <cstdint>
 
+#include "MappedFile.h"
+
+// Preprocessor macro passed to the GLSL compiler (#define name value)
+struct ShaderDefine
+{
+	std::string name;
+	std::string value;
+};
+
+/// <summary>
+/// Compiles GLSL to SPIR-V at runtime (shaderc).
+/// #include "file" is resolved relative to the including file.
+/// Results are cached on disk, keyed by a hash of the source, defines and compiler version,
+/// each cache entry also records the includes it used (with the hash of their content),
+/// so editing an included file recompiles every shader using it and nothing else.
+/// </summary>
 class ShaderCompiler
 {
 private:
+	struct IncludedFile {
+		std::string path;
+		uint64_t contentHash;
+	};
+
+	static std::filesystem::path cachePath(uint64_t key);
+	// Cached SPIR-V if the entry exists and none of its includes changed
+	static bool loadCached(uint64_t key, std::vector<uint32_t>& spirv);
+	static void storeCached(uint64_t key, const std::vector<IncludedFile>& includes, const std::vector<uint32_t>& spirv);
 
 public:
-	static std::vector<char> readFile(const std::string& filename);
-};
+	// Read-only view of the whole file (memory-mapped, nothing copied), throws if it can't be opened
+	static MappedFile readFile(const std::string& filename);
 
+	// GLSL source file (stage from the extension : .vert, .frag, .comp) to SPIR-V words
+	static std::vector<uint32_t> compile(const std::string& sourceFile, const std::vector<ShaderDefine>& defines = {});
+
+	// 64 bit FNV-1a
+	static uint64_t hash(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ull);
+};
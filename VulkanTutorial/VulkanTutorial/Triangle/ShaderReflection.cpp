@@ -0,0 +1,512 @@
+#include "ShaderReflection.h"
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+
+namespace
+{
+	// The few parts of the SPIR-V specification the reflection needs
+	// (https://registry.khronos.org/SPIR-V/specs/unified1/SPIRV.html)
+	const uint32_t SPIRV_MAGIC = 0x07230203;
+	const size_t SPIRV_HEADER_WORDS = 5;
+
+	enum Op : uint32_t {
+		OpEntryPoint		= 15,
+		OpTypeBool			= 20,
+		OpTypeInt			= 21,
+		OpTypeFloat			= 22,
+		OpTypeVector		= 23,
+		OpTypeMatrix		= 24,
+		OpTypeImage			= 25,
+		OpTypeSampler		= 26,
+		OpTypeSampledImage	= 27,
+		OpTypeArray			= 28,
+		OpTypeRuntimeArray	= 29,
+		OpTypeStruct		= 30,
+		OpTypePointer		= 32,
+		OpConstant			= 43,
+		OpSpecConstantTrue	= 48,
+		OpSpecConstantFalse	= 49,
+		OpSpecConstant		= 50,
+		OpVariable			= 59,
+		OpDecorate			= 71,
+		OpMemberDecorate	= 72,
+		OpTypeAccelerationStructureKHR = 5341
+	};
+
+	enum Decoration : uint32_t {
+		DecorationSpecId		= 1,
+		DecorationBlock			= 2,
+		DecorationBufferBlock	= 3,
+		DecorationArrayStride	= 6,
+		DecorationMatrixStride	= 7,
+		DecorationBuiltIn		= 11,
+		DecorationLocation		= 30,
+		DecorationBinding		= 33,
+		DecorationDescriptorSet	= 34,
+		DecorationOffset		= 35
+	};
+
+	enum StorageClass : uint32_t {
+		StorageClassUniformConstant	= 0,
+		StorageClassInput			= 1,
+		StorageClassUniform			= 2,
+		StorageClassPushConstant	= 9,
+		StorageClassStorageBuffer	= 12
+	};
+
+	enum Dim : uint32_t {
+		DimBuffer		= 5,
+		DimSubpassData	= 6
+	};
+
+	VkShaderStageFlagBits stageOf(uint32_t executionModel)
+	{
+		switch (executionModel)
+		{
+		case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+		case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+		case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+		case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+		case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+		case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+		default:
+			throw std::runtime_error("[ERROR] : Unsupported SPIR-V execution model " + std::to_string(executionModel) + "!");
+		}
+	}
+
+	// Instruction operands of a type, constant or variable, by result id
+	struct Instruction {
+		uint32_t opcode;
+		std::vector<uint32_t> operands;		/* everything after the result id */
+	};
+
+	// Decorations of an id (or of a struct member)
+	struct Decorations {
+		std::unordered_map<uint32_t, uint32_t> values;	/* decoration : first literal (0 if none) */
+
+		bool has(uint32_t decoration) const { return values.count(decoration) != 0; }
+		uint32_t get(uint32_t decoration) const { return has(decoration) ? values.at(decoration) : 0; }
+	};
+
+	class Module
+	{
+	public:
+		std::unordered_map<uint32_t, Instruction> types;
+		std::unordered_map<uint32_t, Instruction> constants;
+		std::unordered_map<uint32_t, Decorations> decorations;
+		// (struct id << 32) | member index
+		std::unordered_map<uint64_t, Decorations> memberDecorations;
+
+		const Instruction& type(uint32_t id) const
+		{
+			auto found = types.find(id);
+			if (found == types.end())
+			{
+				throw std::runtime_error("[ERROR] : SPIR-V references an unknown type!");
+			}
+			return found->second;
+		}
+
+		const Decorations& decorationsOf(uint32_t id) const
+		{
+			static const Decorations none;
+			auto found = decorations.find(id);
+			return found == decorations.end() ? none : found->second;
+		}
+
+		const Decorations& memberDecorationsOf(uint32_t structId, uint32_t member) const
+		{
+			static const Decorations none;
+			auto found = memberDecorations.find((static_cast<uint64_t>(structId) << 32) | member);
+			return found == memberDecorations.end() ? none : found->second;
+		}
+
+		// Value of an OpConstant (array lengths)
+		uint32_t constantValue(uint32_t id) const
+		{
+			auto found = constants.find(id);
+			if (found == constants.end() || found->second.opcode != OpConstant || found->second.operands.size() < 2)
+			{
+				throw std::runtime_error("[ERROR] : SPIR-V array length isn't a constant!");
+			}
+			return found->second.operands[1];
+		}
+
+		// Bytes a value of the type takes in a buffer block (explicit layout),
+		// matrices and arrays use the strides the compiler decorated them with
+		uint32_t sizeOf(uint32_t id, uint32_t matrixStride = 0) const
+		{
+			const Instruction& t = type(id);
+			switch (t.opcode)
+			{
+			case OpTypeBool:
+				return 4;
+			case OpTypeInt:
+			case OpTypeFloat:
+				return t.operands[0] / 8;
+			case OpTypeVector:
+				return sizeOf(t.operands[0]) * t.operands[1];
+			case OpTypeMatrix:
+				// Column major : one stride per column
+				return (matrixStride != 0 ? matrixStride : sizeOf(t.operands[0])) * t.operands[1];
+			case OpTypeArray:
+			{
+				uint32_t stride = decorationsOf(id).get(DecorationArrayStride);
+				uint32_t length = constantValue(t.operands[1]);
+				return (stride != 0 ? stride : sizeOf(t.operands[0])) * length;
+			}
+			case OpTypeStruct:
+			{
+				// End of the member ending last
+				uint32_t size = 0;
+				for (uint32_t member = 0; member < t.operands.size(); ++member)
+				{
+					const Decorations& memberDecoration = memberDecorationsOf(id, member);
+					uint32_t end = memberDecoration.get(DecorationOffset) +
+						sizeOf(t.operands[member], memberDecoration.get(DecorationMatrixStride));
+					size = std::max(size, end);
+				}
+				return size;
+			}
+			default:
+				// Runtime arrays have no size of their own
+				return 0;
+			}
+		}
+
+		// Attribute format of a vertex input type (32 bit scalars and vectors)
+		VkFormat formatOf(uint32_t id) const
+		{
+			const Instruction& t = type(id);
+			uint32_t componentType = id;
+			uint32_t components = 1;
+			if (t.opcode == OpTypeVector)
+			{
+				componentType = t.operands[0];
+				components = t.operands[1];
+			}
+
+			const Instruction& component = type(componentType);
+			if ((component.opcode != OpTypeFloat && component.opcode != OpTypeInt) || component.operands[0] != 32)
+			{
+				return VK_FORMAT_UNDEFINED;
+			}
+
+			static const VkFormat floatFormats[] = { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+			static const VkFormat intFormats[] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+			static const VkFormat uintFormats[] = { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+
+			if (components < 1 || components > 4)
+			{
+				return VK_FORMAT_UNDEFINED;
+			}
+			if (component.opcode == OpTypeFloat)
+			{
+				return floatFormats[components - 1];
+			}
+			return component.operands[1] != 0 ? intFormats[components - 1] : uintFormats[components - 1];
+		}
+
+		// Descriptor type of a resource variable, count : array size
+		VkDescriptorType descriptorTypeOf(uint32_t storageClass, uint32_t id, uint32_t& count) const
+		{
+			count = 1;
+			const Instruction* t = &type(id);
+			if (t->opcode == OpTypeArray)
+			{
+				count = constantValue(t->operands[1]);
+				id = t->operands[0];
+				t = &type(id);
+			}
+			else if (t->opcode == OpTypeRuntimeArray)
+			{
+				// Needs descriptor indexing (variable descriptor counts), not used here
+				throw std::runtime_error("[ERROR] : Runtime descriptor arrays aren't supported by the reflection!");
+			}
+
+			switch (t->opcode)
+			{
+			case OpTypeSampledImage:
+				return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			case OpTypeSampler:
+				return VK_DESCRIPTOR_TYPE_SAMPLER;
+			case OpTypeAccelerationStructureKHR:
+				return VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+			case OpTypeImage:
+			{
+				// Operands : sampled type, dim, depth, arrayed, multisampled, sampled (1 : sampled, 2 : storage)
+				uint32_t dim = t->operands[1];
+				bool storage = t->operands[5] == 2;
+				if (dim == DimSubpassData)	return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+				if (dim == DimBuffer)		return storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+				return storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+			}
+			case OpTypeStruct:
+				// SPIR-V before 1.3 declared storage buffers as Uniform + BufferBlock
+				if (storageClass == StorageClassStorageBuffer || decorationsOf(id).has(DecorationBufferBlock))
+				{
+					return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				}
+				return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			default:
+				throw std::runtime_error("[ERROR] : Unsupported SPIR-V resource type!");
+			}
+		}
+	};
+}
+
+ShaderReflection ShaderReflection::reflect(const std::vector<uint32_t>& words)
+{
+	if (words.size() < SPIRV_HEADER_WORDS)
+	{
+		throw std::runtime_error("[ERROR] : SPIR-V code is shorter than its header!");
+	}
+
+	if (words[0] != SPIRV_MAGIC)
+	{
+		throw std::runtime_error("[ERROR] : Not a SPIR-V module (or not in host byte order)!");
+	}
+
+	Module module;
+	ShaderReflection reflection;
+
+	struct Variable {
+		uint32_t id;
+		uint32_t pointerType;
+		uint32_t storageClass;
+	};
+	std::vector<Variable> variables;
+	std::vector<std::pair<uint32_t, uint32_t>> specConstants;	/* result id, result type (0 : bool) */
+
+	// Every instruction starts with a word holding its word count (high 16 bits) and opcode
+	size_t offset = SPIRV_HEADER_WORDS;
+	while (offset < words.size())
+	{
+		uint32_t wordCount = words[offset] >> 16;
+		uint32_t opcode = words[offset] & 0xffff;
+		if (wordCount == 0 || offset + wordCount > words.size())
+		{
+			throw std::runtime_error("[ERROR] : Truncated SPIR-V instruction!");
+		}
+		const uint32_t* operands = &words[offset + 1];
+		uint32_t operandCount = wordCount - 1;
+
+		switch (opcode)
+		{
+		case OpEntryPoint:
+			reflection.stages |= stageOf(operands[0]);
+			break;
+
+		case OpTypeBool: case OpTypeInt: case OpTypeFloat: case OpTypeVector: case OpTypeMatrix:
+		case OpTypeImage: case OpTypeSampler: case OpTypeSampledImage: case OpTypeArray:
+		case OpTypeRuntimeArray: case OpTypeStruct: case OpTypePointer: case OpTypeAccelerationStructureKHR:
+			// Result id first
+			module.types[operands[0]] = { opcode, std::vector<uint32_t>(operands + 1, operands + operandCount) };
+			break;
+
+		case OpConstant:
+			// Result type, result id, value
+			module.constants[operands[1]] = { opcode, { operands[0], operandCount > 2 ? operands[2] : 0 } };
+			break;
+
+		case OpSpecConstantTrue:
+		case OpSpecConstantFalse:
+			specConstants.emplace_back(operands[1], 0);
+			break;
+
+		case OpSpecConstant:
+			specConstants.emplace_back(operands[1], operands[0]);
+			break;
+
+		case OpVariable:
+			// Result type (a pointer), result id, storage class
+			variables.push_back({ operands[1], operands[0], operands[2] });
+			break;
+
+		case OpDecorate:
+			module.decorations[operands[0]].values[operands[1]] = operandCount > 2 ? operands[2] : 0;
+			break;
+
+		case OpMemberDecorate:
+			module.memberDecorations[(static_cast<uint64_t>(operands[0]) << 32) | operands[1]]
+				.values[operands[2]] = operandCount > 3 ? operands[3] : 0;
+			break;
+
+		default:
+			break;
+		}
+
+		offset += wordCount;
+	}
+
+	for (const Variable& variable : variables)
+	{
+		const Decorations& decoration = module.decorationsOf(variable.id);
+		// Pointer : storage class, pointee type
+		uint32_t typeId = module.type(variable.pointerType).operands[1];
+
+		switch (variable.storageClass)
+		{
+		case StorageClassUniformConstant:
+		case StorageClassUniform:
+		case StorageClassStorageBuffer:
+		{
+			ReflectedBinding binding{};
+			binding.set		= decoration.get(DecorationDescriptorSet);
+			binding.binding	= decoration.get(DecorationBinding);
+			binding.type	= module.descriptorTypeOf(variable.storageClass, typeId, binding.count);
+			binding.stages	= reflection.stages;
+			reflection.bindings.push_back(binding);
+			break;
+		}
+
+		case StorageClassPushConstant:
+			reflection.pushConstants.stageFlags	= reflection.stages;
+			reflection.pushConstants.offset		= 0;
+			reflection.pushConstants.size		= module.sizeOf(typeId);
+			break;
+
+		case StorageClassInput:
+		{
+			// Built-ins (gl_VertexIndex, ...) aren't vertex attributes
+			if (!(reflection.stages & VK_SHADER_STAGE_VERTEX_BIT) ||
+				decoration.has(DecorationBuiltIn) ||
+				!decoration.has(DecorationLocation))
+			{
+				break;
+			}
+
+			// A matrix takes one location per column
+			uint32_t location = decoration.get(DecorationLocation);
+			const Instruction& t = module.type(typeId);
+			if (t.opcode == OpTypeMatrix)
+			{
+				for (uint32_t column = 0; column < t.operands[1]; ++column)
+				{
+					reflection.inputs.push_back({ location + column, module.formatOf(t.operands[0]) });
+				}
+			}
+			else
+			{
+				reflection.inputs.push_back({ location, module.formatOf(typeId) });
+			}
+			break;
+		}
+
+		default:
+			break;
+		}
+	}
+
+	for (const auto& [id, typeId] : specConstants)
+	{
+		const Decorations& decoration = module.decorationsOf(id);
+		if (!decoration.has(DecorationSpecId))
+		{
+			continue;	/* part of a composite, no constant_id */
+		}
+		// Booleans are passed as VkBool32
+		uint32_t size = typeId == 0 ? static_cast<uint32_t>(sizeof(VkBool32)) : module.sizeOf(typeId);
+		reflection.specConstants.push_back({ decoration.get(DecorationSpecId), size, reflection.stages });
+	}
+
+	std::sort(reflection.bindings.begin(), reflection.bindings.end(),
+		[](const ReflectedBinding& a, const ReflectedBinding& b) {
+			return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+		});
+	std::sort(reflection.inputs.begin(), reflection.inputs.end(),
+		[](const ReflectedInput& a, const ReflectedInput& b) { return a.location < b.location; });
+
+	return reflection;
+}
+
+void ShaderReflection::merge(const ShaderReflection& other)
+{
+	stages |= other.stages;
+
+	for (const ReflectedBinding& binding : other.bindings)
+	{
+		auto found = std::find_if(bindings.begin(), bindings.end(),
+			[&binding](const ReflectedBinding& existing) {
+				return existing.set == binding.set && existing.binding == binding.binding;
+			});
+
+		if (found == bindings.end())
+		{
+			bindings.push_back(binding);
+			continue;
+		}
+
+		// Stages sharing a binding have to agree on what it is
+		if (found->type != binding.type || found->count != binding.count)
+		{
+			throw std::runtime_error("[ERROR] : Shader stages declare set " + std::to_string(binding.set) +
+				", binding " + std::to_string(binding.binding) + " differently!");
+		}
+		found->stages |= binding.stages;
+	}
+
+	std::sort(bindings.begin(), bindings.end(),
+		[](const ReflectedBinding& a, const ReflectedBinding& b) {
+			return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+		});
+
+	// Stages share one range (the same push_constant block is included everywhere)
+	if (other.pushConstants.size != 0)
+	{
+		if (pushConstants.size == 0)
+		{
+			pushConstants = other.pushConstants;
+		}
+		else
+		{
+			uint32_t end = std::max(pushConstants.offset + pushConstants.size, other.pushConstants.offset + other.pushConstants.size);
+			pushConstants.offset		= std::min(pushConstants.offset, other.pushConstants.offset);
+			pushConstants.size			= end - pushConstants.offset;
+			pushConstants.stageFlags	|= other.pushConstants.stageFlags;
+		}
+	}
+
+	inputs.insert(inputs.end(), other.inputs.begin(), other.inputs.end());
+	specConstants.insert(specConstants.end(), other.specConstants.begin(), other.specConstants.end());
+}
+
+void ShaderReflection::makeUniformBuffersDynamic()
+{
+	for (ReflectedBinding& binding : bindings)
+	{
+		if (binding.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+		{
+			binding.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		}
+	}
+}
+
+uint32_t ShaderReflection::setCount() const
+{
+	// Sorted : the last binding has the highest set
+	return bindings.empty() ? 0 : bindings.back().set + 1;
+}
+
+std::vector<VkDescriptorSetLayoutBinding> ShaderReflection::setBindings(uint32_t set) const
+{
+	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings;
+	for (const ReflectedBinding& binding : bindings)
+	{
+		if (binding.set != set)
+		{
+			continue;
+		}
+
+		VkDescriptorSetLayoutBinding layoutBinding{};
+		layoutBinding.binding				= binding.binding;
+		layoutBinding.descriptorType		= binding.type;
+		layoutBinding.descriptorCount		= binding.count;
+		layoutBinding.stageFlags			= binding.stages;
+		layoutBinding.pImmutableSamplers	= nullptr;
+		setLayoutBindings.push_back(layoutBinding);
+	}
+	return setLayoutBindings;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// Descriptor declared by a shader : layout(set = ..., binding = ...)
+struct ReflectedBinding {
+	uint32_t set;
+	uint32_t binding;
+	VkDescriptorType type;
+	uint32_t count;					/* array size, 1 for a single descriptor */
+	VkShaderStageFlags stages;		/* stages declaring it */
+};
+
+// Input of a vertex shader : layout(location = ...) in
+struct ReflectedInput {
+	uint32_t location;
+	VkFormat format;				/* VK_FORMAT_UNDEFINED : no attribute format matches the type */
+};
+
+// Specialization constant : layout(constant_id = ...) const
+struct ReflectedSpecConstant {
+	uint32_t id;
+	uint32_t size;					/* bytes the VkSpecializationMapEntry must have (bool : VkBool32) */
+	VkShaderStageFlags stages;
+};
+
+/// <summary>
+/// Interface of shader stages read from their SPIR-V :
+/// descriptor bindings, push constant range, vertex inputs and specialization constants.
+/// Only the instructions describing the interface are parsed (decorations, types, variables),
+/// which is enough to build the descriptor set and pipeline layouts from the shaders
+/// instead of keeping hand written tables in sync with them.
+/// </summary>
+struct ShaderReflection
+{
+	VkShaderStageFlags stages = 0;
+	std::vector<ReflectedBinding> bindings;			/* sorted by set, then binding */
+	VkPushConstantRange pushConstants{};			/* size 0 : no push_constant block */
+	std::vector<ReflectedInput> inputs;				/* vertex stage only, sorted by location */
+	std::vector<ReflectedSpecConstant> specConstants;
+
+	// Interface of a single stage, throws if the code isn't valid SPIR-V
+	static ShaderReflection reflect(const std::vector<uint32_t>& words);
+
+	// Add the stages of other (same pipeline) : shared bindings and push constants combine their stages
+	void merge(const ShaderReflection& other);
+	// Uniform buffers bound with a dynamic offset look like any other uniform buffer in SPIR-V
+	void makeUniformBuffersDynamic();
+
+	// Number of sets the pipeline layout needs (highest set + 1)
+	uint32_t setCount() const;
+	// Bindings of a set, as the set layout expects them
+	std::vector<VkDescriptorSetLayoutBinding> setBindings(uint32_t set) const;
+};
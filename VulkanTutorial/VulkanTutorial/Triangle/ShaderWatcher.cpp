@@ -0,0 +1,175 @@
+#include "ShaderWatcher.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// How long a file must stay untouched before it is reported
+	const auto SETTLE_TIME = std::chrono::milliseconds(100);
+	// Polling interval of the fallback, and how often the inotify loop checks for stop()
+	const auto POLL_INTERVAL = std::chrono::milliseconds(250);
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+	stop();
+}
+
+bool ShaderWatcher::isShaderSource(const std::filesystem::path& file)
+{
+	std::string extension = file.extension().string();
+	return extension == ".vert" || extension == ".frag" || extension == ".comp" || extension == ".glsl";
+}
+
+void ShaderWatcher::start(const std::filesystem::path& directory)
+{
+	this->directory = directory;
+
+#ifdef __linux__
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyFd < 0)
+	{
+		throw std::runtime_error("[ERROR] : Failed to initialize inotify!");
+	}
+	// Written and closed, or renamed into the directory (editors saving through a temporary file)
+	if (inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+	{
+		close(inotifyFd);
+		inotifyFd = -1;
+		throw std::runtime_error("[ERROR] : Failed to watch shader directory " + directory.string() + "!");
+	}
+#else
+	// Current write times, only later changes are reported
+	scan(false);
+#endif
+
+	running = true;
+	thread = std::thread(&ShaderWatcher::watch, this);
+
+	std::cout << "[SHADER WATCHER]: watching " << std::filesystem::absolute(directory).string() << std::endl;
+}
+
+void ShaderWatcher::stop()
+{
+	if (!running.exchange(false))
+	{
+		return;
+	}
+	thread.join();
+
+#ifdef __linux__
+	close(inotifyFd);
+	inotifyFd = -1;
+#endif
+}
+
+void ShaderWatcher::recordChange(const std::filesystem::path& file)
+{
+	if (!isShaderSource(file))
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	changes[(directory / file.filename()).lexically_normal().generic_string()] = Clock::now();
+}
+
+#ifdef __linux__
+void ShaderWatcher::watch()
+{
+	// Large enough for several events, aligned like struct inotify_event
+	alignas(inotify_event) char buffer[4096];
+
+	pollfd descriptor{};
+	descriptor.fd		= inotifyFd;
+	descriptor.events	= POLLIN;
+
+	while (running)
+	{
+		// Wake up regularly to notice stop()
+		if (poll(&descriptor, 1, static_cast<int>(POLL_INTERVAL.count())) <= 0)
+		{
+			continue;
+		}
+
+		ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+		for (ssize_t offset = 0; offset < length; )
+		{
+			const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+			if (event->len > 0)
+			{
+				recordChange(event->name);
+			}
+			offset += sizeof(inotify_event) + event->len;
+		}
+	}
+}
+#else
+void ShaderWatcher::scan(bool report)
+{
+	std::error_code error;
+	for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+	{
+		if (!entry.is_regular_file(error) || !isShaderSource(entry.path()))
+		{
+			continue;
+		}
+
+		std::filesystem::file_time_type writeTime = entry.last_write_time(error);
+		if (error)
+		{
+			continue;	/* removed meanwhile */
+		}
+
+		std::string name = entry.path().filename().string();
+		auto found = writeTimes.find(name);
+		if (found == writeTimes.end() || found->second != writeTime)
+		{
+			writeTimes[name] = writeTime;
+			if (report)
+			{
+				recordChange(entry.path());
+			}
+		}
+	}
+}
+
+void ShaderWatcher::watch()
+{
+	while (running)
+	{
+		std::this_thread::sleep_for(POLL_INTERVAL);
+		scan(true);
+	}
+}
+#endif
+
+std::vector<std::string> ShaderWatcher::takeChanges()
+{
+	std::vector<std::string> settled;
+	Clock::time_point now = Clock::now();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto it = changes.begin(); it != changes.end(); )
+	{
+		if (now - it->second >= SETTLE_TIME)
+		{
+			settled.push_back(it->first);
+			it = changes.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	return settled;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/// <summary>
+/// Watches a directory for edited shader sources (.vert, .frag, .comp, .glsl) on a background thread.
+/// Linux uses inotify, other platforms compare the last write times a few times per second.
+/// Editors save in several steps (truncate, write, rename), so a file is only reported
+/// once it stayed unchanged for a short moment.
+/// </summary>
+class ShaderWatcher
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+private:
+	std::filesystem::path directory;
+	std::thread thread;
+	std::atomic<bool> running{ false };
+
+	// Changed files and when they were last touched
+	std::mutex mutex;
+	std::unordered_map<std::string, Clock::time_point> changes;
+
+#ifdef __linux__
+	int inotifyFd = -1;
+#else
+	std::unordered_map<std::string, std::filesystem::file_time_type> writeTimes;
+	void scan(bool report);
+#endif
+
+	void watch();
+	void recordChange(const std::filesystem::path& file);
+
+public:
+	~ShaderWatcher();
+
+	void start(const std::filesystem::path& directory);
+	void stop();
+
+	// Files that changed since the last call (and settled), relative to the watched directory
+	std::vector<std::string> takeChanges();
+
+	static bool isShaderSource(const std::filesystem::path& file);
+};
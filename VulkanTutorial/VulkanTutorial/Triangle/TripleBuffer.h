@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/// <summary>
+/// Lock-free triple buffer between one producer and one consumer thread.
+/// The producer fills its slot and publishes it, the consumer picks up
+/// the most recently published slot. Neither side ever waits for the other:
+/// the third slot always holds the latest complete value,
+/// older values the consumer didn't pick up are simply overwritten.
+/// </summary>
+template<typename T>
+class TripleBuffer
+{
+private:
+	static constexpr uint8_t INDEX_MASK = 0x3;
+	static constexpr uint8_t FRESH_BIT = 0x4;	/* published since the consumer last picked up */
+
+	T slots[3];
+	uint8_t writeIndex = 0;					/* owned by the producer */
+	uint8_t readIndex = 2;					/* owned by the consumer */
+	std::atomic<uint8_t> readyIndex{ 1 };	/* latest published slot (+ FRESH_BIT) */
+
+public:
+	// ------------------------------- PRODUCER -------------------------------
+
+	// Slot to fill, not visible to the consumer until publish()
+	T& writeSlot()
+	{
+		return slots[writeIndex];
+	}
+
+	// Make the write slot the latest value and continue with the slot it replaces
+	// (release : the content of the slot is visible to the consumer that acquires it)
+	void publish()
+	{
+		uint8_t previous = readyIndex.exchange(writeIndex | FRESH_BIT, std::memory_order_acq_rel);
+		writeIndex = previous & INDEX_MASK;
+	}
+
+	// ------------------------------- CONSUMER -------------------------------
+
+	// Switch to the latest published value, false if nothing new was published
+	// (the read slot then keeps its previous value)
+	bool acquire()
+	{
+		if ((readyIndex.load(std::memory_order_relaxed) & FRESH_BIT) == 0)
+		{
+			return false;
+		}
+
+		uint8_t previous = readyIndex.exchange(readIndex, std::memory_order_acq_rel);
+		readIndex = previous & INDEX_MASK;
+		return true;
+	}
+
+	const T& readSlot() const
+	{
+		return slots[readIndex];
+	}
+};
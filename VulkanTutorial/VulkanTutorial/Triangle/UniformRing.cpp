@@ -0,0 +1,44 @@
+#include "UniformRing.h"
+
+VkDeviceSize UniformRing::alignUp(VkDeviceSize size, VkDeviceSize alignment)
+{
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+void UniformRing::init(void* mappedMemory, VkDeviceSize frameCapacity, VkDeviceSize alignment)
+{
+	this->mapped = static_cast<uint8_t*>(mappedMemory);
+	this->alignment = alignment;
+	// Keep every frame region starting on an aligned offset as well
+	this->frameCapacity = alignUp(frameCapacity, alignment);
+	this->frameBase = 0;
+	this->head = 0;
+}
+
+void UniformRing::beginFrame(uint32_t frameIndex)
+{
+	frameBase = frameIndex * frameCapacity;
+	head = 0;
+}
+
+uint32_t UniformRing::push(const void* data, VkDeviceSize size)
+{
+	VkDeviceSize alignedSize = alignUp(size, alignment);
+
+	if (head + alignedSize > frameCapacity)
+	{
+		throw std::runtime_error("[ERROR] : Uniform ring frame region is full!");
+	}
+
+	VkDeviceSize offset = frameBase + head;
+	memcpy(mapped + offset, data, static_cast<size_t>(size));
+	head += alignedSize;
+
+	// Dynamic offsets are passed to vkCmdBindDescriptorSets as uint32_t
+	return static_cast<uint32_t>(offset);
+}
+
+VkDeviceSize UniformRing::used() const
+{
+	return head;
+}
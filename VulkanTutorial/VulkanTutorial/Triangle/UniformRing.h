@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+/// <summary>
+/// Linear allocator over one persistently mapped uniform buffer.
+/// The buffer is split into one region per frame in flight,
+/// each region is filled front-to-back and rewound when its frame starts again.
+/// Returned offsets are meant to be used as dynamic descriptor offsets.
+/// </summary>
+class UniformRing
+{
+private:
+	uint8_t* mapped = nullptr;			/* start of the persistently mapped buffer */
+	VkDeviceSize alignment = 1;			/* minUniformBufferOffsetAlignment of the device */
+	VkDeviceSize frameCapacity = 0;		/* size of one frame region (in bytes) */
+	VkDeviceSize frameBase = 0;			/* offset of the current frame region */
+	VkDeviceSize head = 0;				/* next free byte inside the current frame region */
+
+public:
+	// Round size up to the next multiple of alignment (alignment is a power of two)
+	static VkDeviceSize alignUp(VkDeviceSize size, VkDeviceSize alignment);
+
+	void init(void* mappedMemory, VkDeviceSize frameCapacity, VkDeviceSize alignment);
+	// Rewind the region belonging to frameIndex, its previous content must not be in use anymore
+	void beginFrame(uint32_t frameIndex);
+	// Copy data into the current frame region and return its offset from the start of the buffer
+	uint32_t push(const void* data, VkDeviceSize size);
+	VkDeviceSize used() const;
+};
@@ -53,4 +53,39 @@ bool Vertex::operator==(const Vertex& other) const
 		pos == other.pos &&
 		color == other.color &&
 		texCoord == other.texCoord;
+}
+
+VkVertexInputBindingDescription InstanceData::getBindingDescription()
+{
+	VkVertexInputBindingDescription bindingDescription{};
+	bindingDescription.binding = 1; // Second binding, next to the per-vertex data
+	bindingDescription.stride = sizeof(InstanceData);
+	// Move to the next entry once every vertex of an instance was processed
+	bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+	return bindingDescription;
+}
+
+std::array<VkVertexInputAttributeDescription, 5> InstanceData::attributeDescriptions()
+{
+	// Locations continue after the ones used by Vertex (0-2)
+	std::array<VkVertexInputAttributeDescription, 5> attributeDescriptions{};
+
+	// Model matrix
+	// An attribute holds at most a vec4, so a mat4 takes 4 locations (one per column)
+	for (uint32_t column = 0; column < 4; ++column)
+	{
+		attributeDescriptions[column].binding	= 1;
+		attributeDescriptions[column].location	= 3 + column;
+		attributeDescriptions[column].format	= VK_FORMAT_R32G32B32A32_SFLOAT;
+		attributeDescriptions[column].offset	= offsetof(InstanceData, model) + column * sizeof(glm::vec4);
+	}
+
+	// Tint
+	attributeDescriptions[4].binding	= 1;
+	attributeDescriptions[4].location	= 7;
+	attributeDescriptions[4].format		= VK_FORMAT_R32G32B32A32_SFLOAT;
+	attributeDescriptions[4].offset		= offsetof(InstanceData, tint);
+
+	return attributeDescriptions;
 }
\ No newline at end of file
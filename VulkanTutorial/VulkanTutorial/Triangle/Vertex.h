@@ -21,6 +21,19 @@ struct Vertex {
 	static std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions();
 };
 
+/// <summary>
+/// Per-instance data, read from a second vertex binding
+/// that advances once per instance instead of once per vertex
+/// Model matrix (float4x4, 4 locations) and Tint (float4)
+/// </summary>
+struct InstanceData {
+	glm::mat4 model;
+	glm::vec4 tint;
+
+	static VkVertexInputBindingDescription getBindingDescription();
+	static std::array<VkVertexInputAttributeDescription, 5> attributeDescriptions();
+};
+
 namespace std 
 {
 	template<> struct hash<Vertex> 
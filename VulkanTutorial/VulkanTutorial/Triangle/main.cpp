@@ -1,12 +1,74 @@
 #define NDEBUG
 #include "HelloTriangleApp.h"
 
-int main() 
+int main(int argc, char* argv[]) 
 {
 	HelloTriangleApp app;
 
 	try
 	{
+		// Usage : Triangle [--frames-in-flight <1-4>] [--present-policy <low-latency|power-saving|throughput>]
+		//                 [--objects <count>] [--gpu-driven <on|off>] [--instanced <on|off>]
+		//                 [--parallel-recording <on|off>] [--cached-command-buffers <on|off>]
+		//                 [--swap-chain-check <frames>]
+		// e.g. per-object draws recorded on every thread : --gpu-driven off --instanced off --objects 256
+		auto parseSwitch = [](const std::string& option, const std::string& value)
+		{
+			if (value == "on")	return true;
+			if (value == "off")	return false;
+			throw std::runtime_error("[ERROR] : " + option + " expects on or off, not " + value + "!");
+		};
+
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string option = argv[i];
+			if (i + 1 >= argc)
+			{
+				throw std::runtime_error("[ERROR] : Missing value for " + option + "!");
+			}
+			std::string value = argv[++i];
+
+			if (option == "--frames-in-flight")
+			{
+				app.setFramesInFlight(static_cast<uint32_t>(std::stoul(value)));
+			}
+			else if (option == "--present-policy")
+			{
+				if (value == "low-latency")			app.setPresentPolicy(PresentPolicy::LowLatency);
+				else if (value == "power-saving")	app.setPresentPolicy(PresentPolicy::PowerSaving);
+				else if (value == "throughput")		app.setPresentPolicy(PresentPolicy::Throughput);
+				else throw std::runtime_error("[ERROR] : Unknown present policy " + value + "!");
+			}
+			else if (option == "--objects")
+			{
+				app.setSceneObjectCount(static_cast<uint32_t>(std::stoul(value)));
+			}
+			else if (option == "--gpu-driven")
+			{
+				app.setGpuDrivenRendering(parseSwitch(option, value));
+			}
+			else if (option == "--instanced")
+			{
+				app.setInstancedRendering(parseSwitch(option, value));
+			}
+			else if (option == "--parallel-recording")
+			{
+				app.setParallelRecording(parseSwitch(option, value));
+			}
+			else if (option == "--cached-command-buffers")
+			{
+				app.setCachedCommandBuffers(parseSwitch(option, value));
+			}
+			else if (option == "--swap-chain-check")
+			{
+				app.setSwapChainStressFrames(static_cast<uint32_t>(std::stoul(value)));
+			}
+			else
+			{
+				throw std::runtime_error("[ERROR] : Unknown option " + option + "!");
+			}
+		}
+
 		app.run();
 	}
 	catch (const std::exception& e)
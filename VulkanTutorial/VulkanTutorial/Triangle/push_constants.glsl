@@ -0,0 +1,7 @@
+// Per-draw data, must match PushConstantData and the push constant range
+// Only one push_constant block is allowed per shader stage,
+// every stage includes this one so the pipeline layouts stay compatible
+layout(push_constant) uniform PushConstants {
+	mat4 model;
+	uint materialIndex;
+} pc;
@@ -1,15 +1,73 @@
 #version 450
 
+// Features are specialization constants (see ShaderFeatures) :
+// every pipeline variant bakes its own values, the driver removes the branches
+// of disabled features, so one SPIR-V module serves all variants
+layout(constant_id = 0) const bool USE_TEXTURE = true;
+layout(constant_id = 1) const bool USE_VERTEX_COLOR = true;
+layout(constant_id = 2) const bool ALPHA_TEST = false;
+layout(constant_id = 3) const uint LIGHT_COUNT = 0;	/* 0 : unlit */
+
 layout(binding = 1) uniform sampler2D texSampler;
 
+// Same block as in the vertex shader, materialIndex selects the material of the draw
+#include "push_constants.glsl"
+
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) in vec3 fragWorldPosition;
 
 // layout(location = 0) : specifies the index of framebuffer
 layout(location = 0) out vec4 outColor;
 
+const float ALPHA_CUTOFF = 0.5;
+
+// Fixed directional lights (world space, pointing towards the light)
+const uint MAX_LIGHTS = 4;
+const vec3 LIGHT_DIRECTIONS[MAX_LIGHTS] = vec3[](
+	vec3( 0.577,  0.577,  0.577),
+	vec3(-0.707,  0.0,    0.707),
+	vec3( 0.0,   -0.707,  0.707),
+	vec3( 0.0,    0.0,   -1.0)
+);
+const vec3 LIGHT_COLORS[MAX_LIGHTS] = vec3[](
+	vec3(0.8, 0.8, 0.7),
+	vec3(0.2, 0.3, 0.5),
+	vec3(0.3, 0.2, 0.2),
+	vec3(0.2, 0.2, 0.2)
+);
+const vec3 AMBIENT_LIGHT = vec3(0.2);
+
 void main() {
-//	outColor = vec4(fragColor, 1.0);
-//	outColor = vec4(fragTexCoord, 0.0,1.0);
-	outColor = texture(texSampler, fragTexCoord);
-}
\ No newline at end of file
+	vec4 color = vec4(1.0);
+
+	if (USE_TEXTURE)
+	{
+		color *= texture(texSampler, fragTexCoord);
+	}
+	// fragColor is white unless tinted (instanced path)
+	if (USE_VERTEX_COLOR)
+	{
+		color.rgb *= fragColor;
+	}
+	if (ALPHA_TEST && color.a < ALPHA_CUTOFF)
+	{
+		discard;
+	}
+
+	if (LIGHT_COUNT > 0)
+	{
+		// The vertices have no normals : flat normal of the triangle from the screen space derivatives
+		// (dFdy first, the projection flips Y)
+		vec3 normal = normalize(cross(dFdy(fragWorldPosition), dFdx(fragWorldPosition)));
+
+		vec3 light = AMBIENT_LIGHT;
+		for (uint i = 0; i < LIGHT_COUNT && i < MAX_LIGHTS; ++i)
+		{
+			light += LIGHT_COLORS[i] * max(dot(normal, LIGHT_DIRECTIONS[i]), 0.0);
+		}
+		color.rgb *= light;
+	}
+
+	outColor = color;
+}
@@ -6,6 +6,8 @@ layout(binding = 0) uniform UniformBufferObject {
 	mat4 proj;
 } ubo;
 
+#include "push_constants.glsl"
+
 //layout(location = 0) in dvec3 inPosition; /* dvec3 uses multiple slots */
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
@@ -14,10 +16,14 @@ layout(location = 2) in vec2 inTexCoord;
 // There can also be multiple sets at the same binding : layout(set = 0, ...)
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragWorldPosition;	/* lit variants of shader.frag */
 
 void main() 
 {
-	gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition,1.0);
+	// pc.model is identity when transforms come from the uniform ring (and vice versa)
+	vec4 worldPosition = ubo.model * pc.model * vec4(inPosition,1.0);
+	gl_Position = ubo.proj * ubo.view * worldPosition;
+	fragWorldPosition = worldPosition.xyz;
 	fragColor = inColor;
 	fragTexCoord = inTexCoord;
 }
\ No newline at end of file
@@ -0,0 +1,44 @@
+#version 450
+
+// Vertex shader of the GPU-driven path
+// Transforms come from the object buffer written by the CPU
+// and are looked up through the firstInstance of the indirect draw
+
+layout(binding = 0) uniform UniformBufferObject {
+	mat4 model;
+	mat4 view;
+	mat4 proj;
+} ubo;
+
+// Must match GpuObjectData (std430)
+struct ObjectData {
+	mat4 model;
+	vec4 boundingSphere;
+	uint meshIndex;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer ObjectBuffer {
+	ObjectData objects[];
+};
+
+// Same block as shader.vert, keeps the pipeline layouts compatible
+#include "push_constants.glsl"
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec2 inTexCoord;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragWorldPosition;
+
+void main() 
+{
+	// gl_InstanceIndex includes firstInstance, which the culling shader set to the object index
+	mat4 model = objects[gl_InstanceIndex].model;
+	vec4 worldPosition = ubo.model * model * vec4(inPosition,1.0);
+	gl_Position = ubo.proj * ubo.view * worldPosition;
+	fragWorldPosition = worldPosition.xyz;
+	fragColor = inColor;
+	fragTexCoord = inTexCoord;
+}
@@ -0,0 +1,35 @@
+#version 450
+
+// Vertex shader of the instanced path
+// Per-instance data comes from a second vertex binding (VK_VERTEX_INPUT_RATE_INSTANCE)
+
+layout(binding = 0) uniform UniformBufferObject {
+	mat4 model;
+	mat4 view;
+	mat4 proj;
+} ubo;
+
+// Same block as shader.vert, keeps the pipeline layouts compatible
+#include "push_constants.glsl"
+
+// Per-vertex data (binding 0)
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec2 inTexCoord;
+
+// Per-instance data (binding 1), must match InstanceData
+layout(location = 3) in mat4 inInstanceModel;	/* takes up locations 3-6 */
+layout(location = 7) in vec4 inInstanceTint;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragWorldPosition;
+
+void main() 
+{
+	vec4 worldPosition = ubo.model * inInstanceModel * vec4(inPosition,1.0);
+	gl_Position = ubo.proj * ubo.view * worldPosition;
+	fragWorldPosition = worldPosition.xyz;
+	fragColor = inColor * inInstanceTint.rgb;
+	fragTexCoord = inTexCoord;
+}